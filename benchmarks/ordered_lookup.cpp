@@ -0,0 +1,68 @@
+// Measures the cost of a lookup in an OrderedRegistry's map depending on its size, to find where the hash index starts paying off.
+// Usage: reg-benchmarks
+// For each size it prints the average time of a successful lookup (in nanoseconds) with:
+//   - pairs:  the plain linear scan that compares the keys one by one
+//   - tags:   the SIMD scan of the packed tags (what OrderPreservingMap does below its IndexThreshold)
+//   - index:  the hash index (what OrderPreservingMap does above its IndexThreshold)
+// The crossover between "tags" and "index" is the best value for the IndexThreshold of OrderPreservingMap.
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <reg/reg.hpp>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Id    = reg::Id<float>;
+
+template<std::size_t IndexThreshold>
+using Map = reg::internal::OrderPreservingMap<Id, float, IndexThreshold>;
+
+volatile float sink{}; // Prevents the compiler from optimizing the lookups away
+
+/// Returns the average duration of `lookup(id)` in nanoseconds, when looking up all the `ids` in a random order.
+template<typename Lookup>
+auto measure(std::vector<Id> const& ids, Lookup const& lookup) -> double
+{
+    auto order = ids;
+    std::shuffle(order.begin(), order.end(), std::mt19937{42}); // So that we don't always find the objects in the order they were inserted
+
+    auto const lookups_count = std::max<std::size_t>(1'000'000, ids.size() * 100);
+    auto const start         = Clock::now();
+    for (std::size_t i = 0; i < lookups_count; ++i)
+        sink = sink + lookup(order[i % order.size()]);
+    auto const duration = std::chrono::duration<double, std::nano>{Clock::now() - start};
+    return duration.count() / static_cast<double>(lookups_count);
+}
+
+} // namespace
+
+auto main() -> int
+{
+    std::printf("%8s %10s %10s %10s\n", "size", "pairs", "tags", "index");
+    for (std::size_t const size : std::array<std::size_t, 16>{1, 2, 4, 8, 12, 16, 24, 32, 40, 48, 56, 64, 96, 128, 256, 512})
+    {
+        auto ids         = std::vector<Id>{};
+        auto scanned_map = Map<std::numeric_limits<std::size_t>::max()>{};
+        auto indexed_map = Map<0>{};
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            ids.emplace_back(reg::generate_uuid());
+            scanned_map.try_emplace(ids.back(), static_cast<float>(i));
+            indexed_map.try_emplace(ids.back(), static_cast<float>(i));
+        }
+        auto const& pairs = scanned_map.underlying_container();
+
+        auto const pairs_duration = measure(ids, [&](Id const& id) {
+            return std::find_if(pairs.begin(), pairs.end(), [&](auto const& pair) { return pair.first == id; })->second;
+        });
+        auto const tags_duration  = measure(ids, [&](Id const& id) { return scanned_map.find(id)->second; });
+        auto const index_duration = measure(ids, [&](Id const& id) { return indexed_map.find(id)->second; });
+        std::printf("%8zu %10.2f %10.2f %10.2f\n", size, pairs_duration, tags_duration, index_duration);
+    }
+}
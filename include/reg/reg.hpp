@@ -1,11 +1,27 @@
 #pragma once
 
 #include "../../src/AnyId.hpp"
+#include "../../src/AsyncSharedMutex.hpp"
+#include "../../src/HashedRegistry.hpp"
+#include "../../src/HierarchyRegistry.hpp"
 #include "../../src/Id.hpp"
+#include "../../src/MemoryUsage.hpp"
+#include "../../src/IndexedRegistry.hpp"
+#include "../../src/NullMutex.hpp"
+#include "../../src/PersistentRegistry.hpp"
 #include "../../src/RawRegistry.hpp"
+#include "../../src/ReaderBiasedSharedMutex.hpp"
+#include "../../src/References.hpp"
 #include "../../src/Registries.hpp"
 #include "../../src/Registry.hpp"
+#include "../../src/RegistryDiff.hpp"
+#include "../../src/RegistryNode.hpp"
+#include "../../src/ResolvedId.hpp"
 #include "../../src/SharedId.hpp"
+#include "../../src/SortedRegistry.hpp"
+#include "../../src/SpinSharedMutex.hpp"
+#include "../../src/Trace.hpp"
 #include "../../src/UniqueId.hpp"
+#include "../../src/VersionedRegistry.hpp"
 #include "../../src/generate_uuid.hpp"
 #include "../../src/utils.hpp"
\ No newline at end of file
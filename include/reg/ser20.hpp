@@ -6,6 +6,7 @@
 #include <ser20/types/variant.hpp>
 #include <ser20/types/vector.hpp>
 #include <stdexcept>
+#include <utility>
 #include "reg.hpp"
 
 namespace ser20 {
@@ -13,12 +14,14 @@ namespace ser20 {
 template<class Archive>
 auto save_minimal(Archive const&, uuids::uuid const& uuid) -> std::string
 {
-    return uuids::to_string(uuid);
+    return reg::to_string(reg::AnyId{uuid});
 }
 template<class Archive>
 void load_minimal(Archive const&, uuids::uuid& uuid, std::string const& value)
 {
-    auto const maybe_uuid = uuids::uuid::from_string(value);
+    auto maybe_uuid = value.size() == reg::id_chars_size ? reg::internal::decode_uuid(value.data()) : std::nullopt; // Fast path for the canonical form, that we always save
+    if (!maybe_uuid)
+        maybe_uuid = uuids::uuid::from_string(value); // Also accept the other forms that stduuid can parse (e.g. with braces)
     if (!maybe_uuid)
         throw std::runtime_error{"[load(uuids::uuid)] Couldn't parse uuid: " + value};
 
@@ -47,34 +50,105 @@ void load_minimal(Archive const& ar, reg::AnyId& id, std::string const& value)
     load_minimal(ar, id.underlying_uuid(), value);
 }
 
-template<class Archive, typename T, typename Map>
-void serialize(Archive& archive, reg::internal::OrderPreservingMap<T, Map>& map)
+template<class Archive, typename T, typename Map, std::size_t IndexThreshold>
+void serialize(Archive& archive, reg::internal::OrderPreservingMap<T, Map, IndexThreshold>& map)
 {
     archive(ser20::make_nvp("Underlying container", map.underlying_container()));
+    if constexpr (Archive::is_loading::value)
+        map.rebuild_lookup();
 }
 
-template<class Archive, typename T>
-void serialize(Archive& archive, reg::RawRegistry<T>& registry)
+template<class Archive, typename Key, typename Value, std::size_t NodeCapacity>
+void save(Archive& archive, reg::internal::BPlusTreeMap<Key, Value, NodeCapacity> const& map)
+{
+    archive(ser20::make_size_tag(static_cast<ser20::size_type>(map.size())));
+    for (auto const& key_value_pair : map) // In increasing order of id, so that the output is deterministic
+        archive(key_value_pair);
+}
+template<class Archive, typename Key, typename Value, std::size_t NodeCapacity>
+void load(Archive& archive, reg::internal::BPlusTreeMap<Key, Value, NodeCapacity>& map)
 {
-    archive(ser20::make_nvp("Underlying container", registry.underlying_container()));
+    auto size = ser20::size_type{};
+    archive(ser20::make_size_tag(size));
+    map.clear();
+    for (ser20::size_type i = 0; i < size; ++i)
+    {
+        auto key_value_pair = std::pair<Key, Value>{};
+        archive(key_value_pair);
+        map.try_emplace(key_value_pair.first, std::move(key_value_pair.second));
+    }
 }
 
-template<class Archive, typename T>
-void serialize(Archive& archive, reg::RawOrderedRegistry<T>& registry)
+template<class Archive, typename T, typename Lock>
+void serialize(Archive& archive, reg::RawRegistry<T, Lock>& registry)
+{
+    if constexpr (Archive::is_saving::value)
+    {
+        archive(ser20::make_nvp("Underlying container", std::as_const(registry).underlying_container())); // The const access doesn't detach the registry from its snapshots
+    }
+    else
+    {
+        archive(ser20::make_nvp("Underlying container", registry.underlying_container()));
+        registry.rebuild_membership_filter();
+    }
+}
+
+template<class Archive, typename T, typename Lock>
+void serialize(Archive& archive, reg::RawOrderedRegistry<T, Lock>& registry)
 {
-    archive(ser20::make_nvp("Underlying container", registry.underlying_container().underlying_container()));
+    if constexpr (Archive::is_saving::value)
+    {
+        archive(ser20::make_nvp("Underlying container", std::as_const(registry).underlying_container().underlying_container())); // The const access doesn't detach the registry from its snapshots
+    }
+    else
+    {
+        archive(ser20::make_nvp("Underlying container", registry.underlying_container().underlying_container()));
+        registry.underlying_container().rebuild_lookup();
+        registry.rebuild_membership_filter();
+    }
 }
 
-template<class Archive, typename T, typename Map>
-void serialize(Archive& archive, reg::internal::RegistryImpl<T, Map>& registry)
+template<class Archive, typename T, typename Lock>
+void serialize(Archive& archive, reg::RawSortedRegistry<T, Lock>& registry)
 {
-    archive(ser20::make_nvp("Underlying registry", registry.underlying_wrapped_registry()));
+    if constexpr (Archive::is_saving::value)
+    {
+        archive(ser20::make_nvp("Underlying container", std::as_const(registry).underlying_container())); // The const access doesn't detach the registry from its snapshots
+    }
+    else
+    {
+        archive(ser20::make_nvp("Underlying container", registry.underlying_container()));
+        registry.rebuild_membership_filter();
+    }
+}
+
+template<class Archive, typename T, typename Map, typename Lock>
+void serialize(Archive& archive, reg::internal::RegistryImpl<T, Map, Lock>& registry)
+{
+    if constexpr (Archive::is_loading::value)
+    {
+        auto const previous = registry.underlying_wrapped_registry(); // Loading replaces it with a new instance...
+        archive(ser20::make_nvp("Underlying registry", registry.underlying_wrapped_registry()));
+        if (previous && registry.underlying_wrapped_registry() != previous)
+            registry.underlying_wrapped_registry()->copy_settings_from(*previous); // ... that must keep the observers, the membership filter and the trace recorder
+    }
+    else
+    {
+        archive(ser20::make_nvp("Underlying registry", registry.underlying_wrapped_registry()));
+    }
 }
 
 template<class Archive, typename... Ts>
 void serialize(Archive& archive, reg::Registries<Ts...>& registries)
 {
     archive(ser20::make_nvp("Underlying registries", registries.underlying_registries()));
+    if constexpr (Archive::is_loading::value)
+    {
+        if (registries.has_id_directory())
+            registries.rebuild_id_directory(); // Loading has replaced the underlying registries, which don't know about the directory
+        if (registries.has_reference_index())
+            registries.rebuild_reference_index(); // Same for the reference index
+    }
 }
 
 template<class Archive, typename T>
@@ -84,6 +158,14 @@ void serialize(Archive& archive, reg::internal::IdDestroyer<T>& destroyer)
         ser20::make_nvp("UUID", destroyer.underlying_uuid()),
         ser20::make_nvp("Registry", destroyer.underlying_registry())
     );
+    if constexpr (Archive::is_loading::value)
+        destroyer.count_in_registry();
+}
+
+template<class Archive, typename T>
+void serialize(Archive&, reg::internal::ErasedRawRegistry<T>&)
+{
+    throw std::runtime_error{"[serialize(reg::UniqueId / reg::SharedId)] Owning ids can only be serialized if they belong to a reg::Registry or a reg::OrderedRegistry with the default Lock"};
 }
 
 template<class Archive, typename T>
@@ -96,6 +178,11 @@ template<class Archive, typename T>
 void serialize(Archive& archive, reg::SharedId<T>& id)
 {
     archive(ser20::make_nvp("Underlying", id.underlying_object()));
+    if constexpr (Archive::is_loading::value)
+    {
+        if (id.underlying_object())
+            id.underlying_object()->mark_as_shared();
+    }
 }
 
 } // namespace ser20
\ No newline at end of file
@@ -0,0 +1,479 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ser20_sections.hpp"
+
+namespace reg {
+
+/// Options of a `BoundedRegistry`.
+template<typename T>
+struct BoundedRegistryOptions {
+    /// The file where the evicted objects are written. It is created (or truncated) by the registry, and deleted when the registry is destroyed.
+    std::filesystem::path spill_file{};
+    /// The maximum number of objects that are kept in memory...
+    std::size_t max_objects_in_memory{std::numeric_limits<std::size_t>::max()};
+    /// ... and the maximum number of bytes that they can use, as computed by `size_of`.
+    std::size_t max_bytes_in_memory{std::numeric_limits<std::size_t>::max()};
+    /// The number of bytes used by an object. Override it if your objects own memory on the heap (e.g. `[](Mesh const& mesh) { return sizeof(Mesh) + mesh.vertices.size() * sizeof(Vertex); }`).
+    std::function<std::size_t(T const&)> size_of = [](T const&) { return sizeof(T); };
+};
+
+/// A registry that keeps at most a given number of objects (or bytes) in memory, and spills the other ones to a file.
+/// When the budget is exceeded, the least recently used objects are evicted: they are encoded with `OutputArchive` and written to the spill file, and get decoded again (with `InputArchive`) the next time they are accessed.
+/// This is all transparent: the ids of the evicted objects stay valid, `contains()` is not affected, and `get()` / `with_ref()` / `with_mutable_ref()` bring the objects back into memory when needed.
+/// The least recently used objects are approximated with the CLOCK algorithm: an access only sets a flag on the object that is accessed (so that reads can share the lock and don't all write to the same memory),
+/// and the eviction sweeps over the objects in memory, evicting the first one whose flag is not set and clearing the flags on its way.
+/// An object that hasn't been modified since it was read back from the spill file is not written again when it gets evicted.
+/// The space of the objects that have been written again or destroyed is reused by the next writes, so the spill file doesn't grow beyond the size of the objects it holds (plus some fragmentation).
+/// NB: this registry doesn't support `UniqueId`s and `SharedId`s, only raw `Id`s.
+template<typename T, typename InputArchive, typename OutputArchive>
+class BoundedRegistry {
+public:
+    /// The type of values stored in this registry.
+    using ValueType = T;
+
+    /// Throws if the spill file can't be created.
+    explicit BoundedRegistry(BoundedRegistryOptions<T> options)
+        : _options{std::move(options)}
+    {
+        _spill_file.open(_options.spill_file, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+        if (!_spill_file)
+            throw std::runtime_error{"[BoundedRegistry()] Couldn't create the spill file: " + _options.spill_file.string()};
+    }
+
+    ~BoundedRegistry()
+    {
+        _spill_file.close();
+        auto error = std::error_code{};
+        std::filesystem::remove(_options.spill_file, error);
+    }
+
+    BoundedRegistry(BoundedRegistry const&)                    = delete;
+    auto operator=(BoundedRegistry const&) -> BoundedRegistry& = delete;
+    BoundedRegistry(BoundedRegistry&&)                         = delete;
+    auto operator=(BoundedRegistry&&) -> BoundedRegistry&      = delete;
+
+    /// Thread-safe.
+    /// Returns a copy of the object referenced by `id`, or null if the `id` doesn't refer to an object in this registry.
+    /// Reads the object back from the spill file if it has been evicted.
+    [[nodiscard]] auto get(Id<T> const& id) const -> std::optional<T>
+    {
+        auto result = std::optional<T>{};
+        with_ref(id, [&](T const& value) { result.emplace(value); });
+        return result;
+    }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`, reading it back from the spill file first if it has been evicted.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_ref(Id<T> const& id, std::function<void(T const&)> const& callback) const -> bool
+    {
+        while (true)
+        {
+            auto bytes    = std::string{};
+            auto location = Location{};
+            {
+                std::shared_lock lock{_mutex};
+                auto const       it = _entries.find(id);
+                if (it == _entries.end())
+                    return false;
+                auto const& entry = it->second;
+                if (entry.value)
+                {
+                    entry.is_referenced.store(true, std::memory_order_relaxed);
+                    callback(std::as_const(*entry.value));
+                    return true;
+                }
+                location = *entry.location;
+                bytes    = read_spilled(location);
+            }
+
+            // The object has been evicted: decode it without holding the lock, and then put it back into memory
+            auto             value = decode(bytes);
+            std::unique_lock lock{_mutex};
+            auto const       it = _entries.find(id);
+            if (it == _entries.end()) // It has been destroyed in the meantime
+                return false;
+            auto& entry = it->second;
+            if (entry.value) // Another thread has put it back into memory in the meantime (and might have modified it)
+            {
+                entry.is_referenced.store(true, std::memory_order_relaxed);
+                callback(std::as_const(*entry.value));
+                return true;
+            }
+            if (entry.location != location) // It has been modified and evicted again in the meantime, so what we decoded is outdated
+                continue;
+            callback(std::as_const(make_resident(id, entry, std::move(value))));
+            return true;
+        }
+    }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`, reading it back from the spill file first if it has been evicted.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool
+    {
+        std::unique_lock lock{_mutex};
+        auto const       it = _entries.find(id);
+        if (it == _entries.end())
+            return false;
+        auto& entry = it->second;
+        auto& value = entry.value ? *entry.value : make_resident(id, entry, decode(read_spilled(*entry.location)));
+        entry.is_referenced.store(true, std::memory_order_relaxed);
+        callback(value);
+        entry.is_dirty = true;
+        resize(entry, _options.size_of(value));
+        evict_if_needed(id);
+        return true;
+    }
+
+    /// Thread-safe.
+    /// Sets the value of the object referenced by `id` to `value`, without reading its previous value back from the spill file.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto set(Id<T> const& id, T value) -> bool
+    {
+        std::unique_lock lock{_mutex};
+        auto const       it = _entries.find(id);
+        if (it == _entries.end())
+            return false;
+        auto& entry = it->second;
+        if (entry.value)
+        {
+            *entry.value = std::move(value);
+            resize(entry, _options.size_of(*entry.value));
+        }
+        else
+        {
+            make_resident(id, entry, std::make_unique<T>(std::move(value)));
+        }
+        entry.is_referenced.store(true, std::memory_order_relaxed);
+        entry.is_dirty = true;
+        evict_if_needed(id);
+        return true;
+    }
+
+    /// Thread-safe.
+    /// Returns true iff `id` references an object in the registry, whether it is in memory or has been evicted.
+    [[nodiscard]] auto contains(Id<T> const& id) const -> bool
+    {
+        std::shared_lock lock{_mutex};
+        return _entries.contains(id);
+    }
+
+    /// Thread-safe.
+    /// Inserts `value` into the registry, and returns the id that will then be used to reference it.
+    /// This might evict other objects.
+    [[nodiscard]] auto create_raw(T value) -> Id<T>
+    {
+        auto const id = Id<T>{generate_uuid()};
+        insert_raw(id, std::move(value));
+        return id;
+    }
+
+    /// Thread-safe.
+    /// Inserts `value` into the registry with the given `id`. Does nothing if `id` is already present in the registry.
+    /// This might evict other objects.
+    void insert_raw(Id<T> const& id, T value)
+    {
+        std::unique_lock lock{_mutex};
+        auto const [it, has_been_inserted] = _entries.try_emplace(id);
+        if (!has_been_inserted)
+            return;
+        make_resident(id, it->second, std::make_unique<T>(std::move(value)));
+        it->second.is_dirty = true;
+    }
+
+    /// Thread-safe.
+    /// Destroys the object and removes it from the registry, whether it is in memory or has been evicted.
+    /// From then on, trying to get an object using `id` is still safe but will return null.
+    void destroy(Id<T> const& id)
+    {
+        std::unique_lock lock{_mutex};
+        auto const       it = _entries.find(id);
+        if (it == _entries.end())
+            return;
+        if (it->second.value)
+            remove_from_memory(it->second);
+        if (it->second.location)
+            free_spilled(*it->second.location);
+        _entries.erase(it);
+    }
+
+    /// Thread-safe.
+    /// Destroys all the objects in the registry.
+    void clear()
+    {
+        std::unique_lock lock{_mutex};
+        _entries.clear();
+        _clock.clear();
+        _clock_hand      = 0;
+        _bytes_in_memory = 0;
+        std::lock_guard file_lock{_spill_file_mutex};
+        _spill_file.close();
+        _spill_file.open(_options.spill_file, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+        _spill_file_size = 0;
+        _free_extents.clear();
+    }
+
+    /// Thread-safe.
+    /// Returns true iff the registry contains no objects at all.
+    [[nodiscard]] auto is_empty() const -> bool
+    {
+        std::shared_lock lock{_mutex};
+        return _entries.empty();
+    }
+
+    /// Thread-safe.
+    /// Returns the number of objects in the registry, whether they are in memory or have been evicted.
+    [[nodiscard]] auto objects_count() const -> std::size_t
+    {
+        std::shared_lock lock{_mutex};
+        return _entries.size();
+    }
+
+    /// Thread-safe.
+    /// Returns the number of objects that are currently in memory.
+    [[nodiscard]] auto objects_in_memory_count() const -> std::size_t
+    {
+        std::shared_lock lock{_mutex};
+        return _clock.size();
+    }
+
+    /// Thread-safe.
+    /// Returns the number of bytes used by the objects that are currently in memory, as computed by `BoundedRegistryOptions::size_of`.
+    [[nodiscard]] auto bytes_in_memory() const -> std::size_t
+    {
+        std::shared_lock lock{_mutex};
+        return _bytes_in_memory;
+    }
+
+    /// Returns the mutex guarding this registry, to allow you to lock it manually.
+    [[nodiscard]] auto mutex() const -> std::shared_mutex& { return _mutex; }
+
+private:
+    /// Where the encoded value of an evicted object is in the spill file.
+    struct Location {
+        std::uint64_t offset{};
+        std::uint64_t size{};
+        std::uint64_t write_index{}; // Tells apart two writes that happened to reuse the same extent
+
+        auto operator==(Location const&) const -> bool = default;
+    };
+
+    struct Entry {
+        std::unique_ptr<T>        value{};              // Null iff the object has been evicted
+        std::optional<Location>   location{};           // Set iff the object has been written to the spill file
+        bool                      is_dirty{false};      // True iff `value` differs from what is in the spill file (or has never been written to it)
+        mutable std::atomic<bool> is_referenced{false}; // The flag of the CLOCK algorithm. Set by the readers, which only hold a shared lock
+        std::size_t               clock_position{0};    // The position of the object in `_clock`, if it is in memory
+        std::size_t               size{0};              // As computed by `size_of`, if it is in memory
+    };
+
+    [[nodiscard]] static auto encode(T const& value) -> std::string
+    {
+        auto stream = std::ostringstream{};
+        {
+            auto archive = OutputArchive{stream};
+            archive(value);
+        }
+        return std::move(stream).str();
+    }
+
+    [[nodiscard]] static auto decode(std::string const& bytes) -> std::unique_ptr<T>
+    {
+        auto value   = std::make_unique<T>();
+        auto buffer  = internal::ReadOnlyStreamBuffer{bytes};
+        auto stream  = std::istream{&buffer};
+        auto archive = InputArchive{stream};
+        archive(*value);
+        return value;
+    }
+
+    [[nodiscard]] auto read_spilled(Location const& location) const -> std::string
+    {
+        std::lock_guard file_lock{_spill_file_mutex};
+        auto            bytes = std::string(static_cast<std::size_t>(location.size), '\0');
+        _spill_file.seekg(static_cast<std::streamoff>(location.offset));
+        _spill_file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!_spill_file)
+            throw std::runtime_error{"[BoundedRegistry] Failed to read an object from the spill file"};
+        return bytes;
+    }
+
+    /// Writes `bytes` in the first free extent that is big enough, or at the end of the file.
+    [[nodiscard]] auto write_spilled(std::string const& bytes) const -> Location
+    {
+        std::lock_guard file_lock{_spill_file_mutex};
+        auto const      location = Location{.offset = allocate_extent(bytes.size()), .size = bytes.size(), .write_index = _writes_count++};
+        _spill_file.seekp(static_cast<std::streamoff>(location.offset));
+        _spill_file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        _spill_file.flush();
+        if (!_spill_file)
+        {
+            free_extent(location);
+            throw std::runtime_error{"[BoundedRegistry] Failed to write an object to the spill file"};
+        }
+        return location;
+    }
+
+    /// Lets the next writes reuse the space of an object that is no longer in the spill file.
+    void free_spilled(Location const& location) const
+    {
+        std::lock_guard file_lock{_spill_file_mutex};
+        free_extent(location);
+    }
+
+    /// Must be called while `_spill_file_mutex` is locked.
+    [[nodiscard]] auto allocate_extent(std::uint64_t size) const -> std::uint64_t
+    {
+        for (auto it = _free_extents.begin(); it != _free_extents.end(); ++it)
+        {
+            auto const [offset, free_size] = *it;
+            if (free_size < size)
+                continue;
+            _free_extents.erase(it);
+            if (free_size > size)
+                _free_extents.emplace(offset + size, free_size - size);
+            return offset;
+        }
+        auto const offset = _spill_file_size;
+        _spill_file_size += size;
+        return offset;
+    }
+
+    /// Must be called while `_spill_file_mutex` is locked.
+    /// Merges the extent with its free neighbours, so that bigger objects can fit in it later.
+    void free_extent(Location const& location) const
+    {
+        auto offset = location.offset;
+        auto size   = location.size;
+        if (size == 0)
+            return;
+
+        auto next = _free_extents.lower_bound(offset);
+        if (next != _free_extents.end() && next->first == offset + size)
+        {
+            size += next->second;
+            next = _free_extents.erase(next);
+        }
+        if (next != _free_extents.begin())
+        {
+            auto const previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                offset = previous->first;
+                size += previous->second;
+                _free_extents.erase(previous);
+            }
+        }
+        if (offset + size == _spill_file_size) // The next objects will be appended there anyway
+            _spill_file_size = offset;
+        else
+            _free_extents.emplace(offset, size);
+    }
+
+    /// Must be called while `_mutex` is locked exclusively.
+    /// Puts `value` into memory as the value of `entry`, which must have been evicted, and evicts other objects if needed.
+    auto make_resident(Id<T> const& id, Entry& entry, std::unique_ptr<T> value) const -> T&
+    {
+        entry.is_referenced.store(true, std::memory_order_relaxed);
+        entry.value          = std::move(value);
+        entry.size           = _options.size_of(*entry.value);
+        entry.clock_position = _clock.size();
+        _clock.push_back(id);
+        _bytes_in_memory += entry.size;
+        evict_if_needed(id);
+        return *entry.value;
+    }
+
+    /// Must be called while `_mutex` is locked exclusively.
+    void resize(Entry& entry, std::size_t new_size) const
+    {
+        _bytes_in_memory = _bytes_in_memory - entry.size + new_size;
+        entry.size       = new_size;
+    }
+
+    /// Must be called while `_mutex` is locked exclusively.
+    /// Evicts objects until we are within our budget. Never evicts `id_to_keep`, which is the object that is being accessed.
+    void evict_if_needed(Id<T> const& id_to_keep) const
+    {
+        while ((_clock.size() > _options.max_objects_in_memory || _bytes_in_memory > _options.max_bytes_in_memory) && _clock.size() > 1)
+        {
+            if (_clock_hand >= _clock.size())
+                _clock_hand = 0;
+            auto& entry = _entries.find(_clock[_clock_hand])->second;
+            if (_clock[_clock_hand] == id_to_keep || entry.is_referenced.exchange(false, std::memory_order_relaxed))
+            {
+                ++_clock_hand; // Give it a second chance
+                continue;
+            }
+            evict(entry);
+        }
+    }
+
+    /// Must be called while `_mutex` is locked exclusively.
+    void evict(Entry& entry) const
+    {
+        if (entry.is_dirty || !entry.location)
+        {
+            auto const previous_location = entry.location;
+            entry.location               = write_spilled(encode(*entry.value)); // Before freeing the previous location, so that we still have it if the write fails
+            entry.is_dirty               = false;
+            if (previous_location)
+                free_spilled(*previous_location);
+        }
+        remove_from_memory(entry);
+    }
+
+    /// Must be called while `_mutex` is locked exclusively.
+    void remove_from_memory(Entry& entry) const
+    {
+        _bytes_in_memory -= entry.size;
+        entry.value.reset();
+
+        // Swap with the last object of the clock, so that removing is O(1)
+        auto const position = entry.clock_position;
+        if (position != _clock.size() - 1)
+        {
+            _clock[position]                                       = _clock.back();
+            _entries.find(_clock[position])->second.clock_position = position;
+        }
+        _clock.pop_back();
+    }
+
+private:
+    BoundedRegistryOptions<T>                      _options;
+    mutable std::shared_mutex                      _mutex;
+    mutable std::unordered_map<Id<T>, Entry>       _entries;            // Mutable because the const accessors can bring objects back into memory (and evict others)
+    mutable std::vector<Id<T>>                     _clock;              // The objects that are in memory, in the order the hand of the CLOCK algorithm visits them
+    mutable std::size_t                            _clock_hand{0};      // The next position of `_clock` that the eviction will look at
+    mutable std::size_t                            _bytes_in_memory{0};
+    mutable std::mutex                             _spill_file_mutex;
+    mutable std::fstream                           _spill_file;
+    mutable std::uint64_t                          _spill_file_size{0}; // The end of the last extent in use, which is where the objects that don't fit in a free extent are appended
+    mutable std::map<std::uint64_t, std::uint64_t> _free_extents;       // The offset and size of the unused parts of the spill file, in order
+    mutable std::uint64_t                          _writes_count{0};
+};
+
+} // namespace reg
@@ -0,0 +1,413 @@
+#pragma once
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ser20_sections.hpp"
+
+namespace reg {
+
+/// A registry backed by a file, that only decodes the value of an object the first time it gets accessed.
+/// Opening the file only reads its index (the id, offset and size of each object), so opening a huge file is fast, and only the objects that you actually use get decoded and take memory.
+/// Each value is encoded on its own with `OutputArchive` (and decoded with `InputArchive`), so any ser20 archive can be used.
+/// `save()` writes the modified and new objects, and copies the bytes of all the other ones from the current file without decoding them.
+/// NB: this registry doesn't support `UniqueId`s and `SharedId`s, only raw `Id`s.
+template<typename T, typename InputArchive, typename OutputArchive>
+class LazyRegistry {
+public:
+    /// The type of values stored in this registry.
+    using ValueType = T;
+
+    /// Creates an empty registry, that isn't backed by any file until you `save()` it.
+    LazyRegistry() = default;
+
+    /// Opens a file written by `save()`. Only its index is read, the values are decoded on demand.
+    /// Throws if the file cannot be opened or is not a valid file.
+    explicit LazyRegistry(std::filesystem::path const& path)
+    {
+        open(path);
+    }
+
+    LazyRegistry(LazyRegistry const&)                    = delete;
+    auto operator=(LazyRegistry const&) -> LazyRegistry& = delete;
+    LazyRegistry(LazyRegistry&&)                         = delete;
+    auto operator=(LazyRegistry&&) -> LazyRegistry&      = delete;
+    ~LazyRegistry()                                      = default;
+
+    /// Thread-safe.
+    /// Returns a copy of the object referenced by `id`, or null if the `id` doesn't refer to an object in this registry.
+    /// Decodes the object if this is the first time it is accessed.
+    [[nodiscard]] auto get(Id<T> const& id) const -> std::optional<T>
+    {
+        auto result = std::optional<T>{};
+        with_ref(id, [&](T const& value) { result.emplace(value); });
+        return result;
+    }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`, decoding it first if this is the first time it is accessed.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_ref(Id<T> const& id, std::function<void(T const&)> const& callback) const -> bool
+    {
+        if (!load_if_needed(id))
+            return false;
+
+        std::shared_lock lock{_mutex};
+        auto const       it = _entries.find(id);
+        if (it == _entries.end()) // It has been destroyed in the meantime
+            return false;
+        callback(std::as_const(*it->second.value));
+        return true;
+    }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`, decoding it first if this is the first time it is accessed.
+    /// The object will then be encoded again by the next `save()`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool
+    {
+        if (!load_if_needed(id))
+            return false;
+
+        std::unique_lock lock{_mutex};
+        auto const       it = _entries.find(id);
+        if (it == _entries.end()) // It has been destroyed in the meantime
+            return false;
+        callback(*it->second.value);
+        it->second.is_modified = true;
+        return true;
+    }
+
+    /// Thread-safe.
+    /// Sets the value of the object referenced by `id` to `value`, without decoding its previous value.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto set(Id<T> const& id, T value) -> bool
+    {
+        std::unique_lock lock{_mutex};
+        auto const       it = _entries.find(id);
+        if (it == _entries.end())
+            return false;
+        it->second.value       = std::make_unique<T>(std::move(value));
+        it->second.is_modified = true;
+        return true;
+    }
+
+    /// Thread-safe.
+    /// Returns true iff `id` references an object in the registry. Never decodes anything.
+    [[nodiscard]] auto contains(Id<T> const& id) const -> bool
+    {
+        std::shared_lock lock{_mutex};
+        return _entries.contains(id);
+    }
+
+    /// Thread-safe.
+    /// Inserts `value` into the registry, and returns the id that will then be used to reference it.
+    [[nodiscard]] auto create_raw(T value) -> Id<T>
+    {
+        auto const id = Id<T>{generate_uuid()};
+        insert_raw(id, std::move(value));
+        return id;
+    }
+
+    /// Thread-safe.
+    /// Inserts `value` into the registry with the given `id`. Does nothing if `id` is already present in the registry.
+    void insert_raw(Id<T> const& id, T value)
+    {
+        std::unique_lock lock{_mutex};
+        _entries.try_emplace(id, Entry{.value = std::make_unique<T>(std::move(value)), .is_modified = true});
+    }
+
+    /// Thread-safe.
+    /// Destroys the object and removes it from the registry.
+    /// From then on, trying to get an object using `id` is still safe but will return null.
+    void destroy(Id<T> const& id)
+    {
+        std::unique_lock lock{_mutex};
+        _entries.erase(id);
+    }
+
+    /// Thread-safe.
+    /// Returns true iff the registry contains no objects at all.
+    [[nodiscard]] auto is_empty() const -> bool
+    {
+        std::shared_lock lock{_mutex};
+        return _entries.empty();
+    }
+
+    /// Thread-safe.
+    /// Returns the number of objects in the registry, whether they have been decoded or not.
+    [[nodiscard]] auto objects_count() const -> std::size_t
+    {
+        std::shared_lock lock{_mutex};
+        return _entries.size();
+    }
+
+    /// Thread-safe.
+    /// Returns the number of objects whose value is currently in memory (because they have been accessed, created or modified since the file was opened).
+    [[nodiscard]] auto loaded_objects_count() const -> std::size_t
+    {
+        std::shared_lock lock{_mutex};
+        return static_cast<std::size_t>(std::count_if(_entries.begin(), _entries.end(), [](auto const& id_and_entry) {
+            return id_and_entry.second.value != nullptr;
+        }));
+    }
+
+    /// Thread-safe.
+    /// Writes all the objects to `path`: the modified and new ones get encoded, and the others are copied from the current file byte-for-byte, without being decoded.
+    /// The file is first written next to `path`, synced to the disk and then renamed, so `path` can be the file this registry is currently backed by, and is never left half-written (even if the machine crashes).
+    /// From then on, the registry is backed by `path`.
+    /// The registry is locked during the whole save.
+    void save(std::filesystem::path const& path)
+    {
+        std::unique_lock lock{_mutex};
+
+        auto temporary_path = path;
+        temporary_path += ".tmp";
+        auto new_locations = std::vector<std::pair<Entry*, Location>>{};
+        new_locations.reserve(_entries.size());
+        {
+            auto file = std::ofstream{temporary_path, std::ios::binary | std::ios::trunc};
+            if (!file)
+                throw std::runtime_error{"[LazyRegistry::save()] Couldn't open file: " + temporary_path.string()};
+
+            // The values come first, so that we can stream them to the file one by one, and the index comes last once we know where each value is
+            file.write(magic_number.data(), magic_number.size());
+            write_integer(file, 0); // Placeholder for the position of the index
+            for (auto& [id, entry] : _entries)
+            {
+                auto const bytes    = entry.is_modified ? encode(*entry.value) : read_bytes(entry.location);
+                auto const location = Location{.offset = static_cast<std::uint64_t>(file.tellp()), .size = bytes.size()};
+                file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+                new_locations.emplace_back(&entry, location);
+            }
+
+            auto const index_position = static_cast<std::uint64_t>(file.tellp());
+            write_integer(file, static_cast<std::uint64_t>(_entries.size()));
+            for (auto const& [id, entry] : _entries)
+            {
+                auto const bytes = id.underlying_uuid().as_bytes();
+                file.write(reinterpret_cast<char const*>(bytes.data()), static_cast<std::streamsize>(bytes.size())); // NOLINT(*-reinterpret-cast)
+            }
+            for (auto const& [entry, location] : new_locations)
+            {
+                write_integer(file, location.offset);
+                write_integer(file, location.size);
+            }
+            file.seekp(static_cast<std::streamoff>(magic_number.size()));
+            write_integer(file, index_position);
+            file.close(); // Flushes the file, which can fail too
+            if (!file)
+                throw std::runtime_error{"[LazyRegistry::save()] Failed to write file: " + temporary_path.string()};
+        }
+        sync_file(temporary_path); // Otherwise the rename could reach the disk before the content of the file
+
+        {
+            std::lock_guard file_lock{_file_mutex};
+            _file.close(); // Some platforms can't replace a file that is still open
+            std::filesystem::rename(temporary_path, path);
+            sync_directory(path); // Makes the rename durable
+            open_file(path);
+        }
+        for (auto& [entry, location] : new_locations)
+        {
+            entry->location    = location;
+            entry->is_modified = false;
+        }
+    }
+
+    /// Returns the mutex guarding this registry, to allow you to lock it manually.
+    [[nodiscard]] auto mutex() const -> std::shared_mutex& { return _mutex; }
+
+private:
+    /// Where the encoded value of an object is in the file.
+    struct Location {
+        std::uint64_t offset{};
+        std::uint64_t size{};
+    };
+
+    struct Entry {
+        Location           location{};
+        std::unique_ptr<T> value{};           // Null until the object gets accessed
+        bool               is_modified{false}; // True if the object is not in the file, or has been modified since it was read from the file. Implies that `value` is not null.
+    };
+
+    static constexpr std::array<char, 8> magic_number{'r', 'e', 'g', '-', 'l', 'a', 'z', 'y'};
+
+    /// The integers are always stored in little-endian order, so that the files can be shared between machines.
+    static void write_integer(std::ostream& stream, std::uint64_t integer)
+    {
+        auto bytes = std::array<char, sizeof(integer)>{};
+        for (auto& byte : bytes)
+        {
+            byte = static_cast<char>(integer & 0xFF);
+            integer >>= 8;
+        }
+        stream.write(bytes.data(), bytes.size());
+    }
+
+    [[nodiscard]] static auto read_integer(std::istream& stream) -> std::uint64_t
+    {
+        auto bytes = std::array<char, sizeof(std::uint64_t)>{};
+        stream.read(bytes.data(), bytes.size());
+        auto integer = std::uint64_t{};
+        for (auto it = bytes.rbegin(); it != bytes.rend(); ++it)
+            integer = (integer << 8) | static_cast<unsigned char>(*it);
+        return integer;
+    }
+
+    /// Does nothing on the platforms where we don't know how to sync a file.
+    static void sync_file(std::filesystem::path const& path)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT(*-vararg)
+        if (fd < 0)
+            throw std::runtime_error{"[LazyRegistry::save()] Couldn't open file: " + path.string()};
+        auto const result = ::fsync(fd);
+        ::close(fd);
+        if (result != 0)
+            throw std::runtime_error{"[LazyRegistry::save()] Failed to sync file: " + path.string()};
+#else
+        std::ignore = path;
+#endif
+    }
+
+    /// Makes the creation and renaming of `path` durable. Does nothing on the platforms where we don't know how to sync a directory.
+    static void sync_directory(std::filesystem::path const& path)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        auto const directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path{"."};
+        auto const fd        = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT(*-vararg)
+        if (fd < 0)
+            return;
+        std::ignore = ::fsync(fd);
+        ::close(fd);
+#else
+        std::ignore = path;
+#endif
+    }
+
+    [[nodiscard]] static auto encode(T const& value) -> std::string
+    {
+        auto stream = std::ostringstream{};
+        {
+            auto archive = OutputArchive{stream};
+            archive(value);
+        }
+        return std::move(stream).str();
+    }
+
+    [[nodiscard]] static auto decode(std::string const& bytes) -> std::unique_ptr<T>
+    {
+        auto value   = std::make_unique<T>();
+        auto buffer  = internal::ReadOnlyStreamBuffer{bytes};
+        auto stream  = std::istream{&buffer};
+        auto archive = InputArchive{stream};
+        archive(*value);
+        return value;
+    }
+
+    void open(std::filesystem::path const& path)
+    {
+        std::lock_guard file_lock{_file_mutex};
+        open_file(path);
+
+        auto magic = std::array<char, 8>{};
+        _file.read(magic.data(), magic.size());
+        if (!_file || magic != magic_number)
+            throw std::runtime_error{"[LazyRegistry()] Not a file written by LazyRegistry::save(): " + path.string()};
+
+        // The index stores all the ids, followed by all the locations, so that we can read each of them in one go
+        _file.seekg(static_cast<std::streamoff>(read_integer(_file)));
+        auto const objects_count = static_cast<std::size_t>(read_integer(_file));
+        auto       ids           = std::vector<std::array<uuids::uuid::value_type, 16>>(objects_count);
+        auto       locations     = std::vector<Location>(objects_count);
+        _file.read(reinterpret_cast<char*>(ids.data()), static_cast<std::streamsize>(ids.size() * sizeof(ids[0]))); // NOLINT(*-reinterpret-cast)
+        for (auto& location : locations)
+        {
+            location.offset = read_integer(_file);
+            location.size   = read_integer(_file);
+        }
+        if (!_file)
+            throw std::runtime_error{"[LazyRegistry()] Truncated index: " + path.string()};
+
+        _entries.reserve(objects_count);
+        for (std::size_t i = 0; i < objects_count; ++i)
+            _entries.try_emplace(Id<T>{uuids::uuid{ids[i]}}, Entry{.location = locations[i]});
+    }
+
+    /// Must be called while `_file_mutex` is locked.
+    void open_file(std::filesystem::path const& path)
+    {
+        _file.open(path, std::ios::binary);
+        if (!_file)
+            throw std::runtime_error{"[LazyRegistry()] Couldn't open file: " + path.string()};
+    }
+
+    [[nodiscard]] auto read_bytes(Location const& location) const -> std::string
+    {
+        std::lock_guard file_lock{_file_mutex};
+        auto            bytes = std::string(static_cast<std::size_t>(location.size), '\0');
+        _file.clear();
+        _file.seekg(static_cast<std::streamoff>(location.offset));
+        _file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!_file)
+            throw std::runtime_error{"[LazyRegistry] Failed to read an object from the file"};
+        return bytes;
+    }
+
+    /// Decodes the object if it has never been accessed. The object is decoded without holding the registry's lock, so the other threads can keep using the registry meanwhile.
+    /// Returns false iff the object is not in the registry.
+    auto load_if_needed(Id<T> const& id) const -> bool
+    {
+        auto bytes = std::string{};
+        {
+            std::shared_lock lock{_mutex}; // Prevents `save()` from replacing the file while we read from it
+            auto const       it = _entries.find(id);
+            if (it == _entries.end())
+                return false;
+            if (it->second.value)
+                return true;
+            bytes = read_bytes(it->second.location);
+        }
+
+        auto value = decode(bytes);
+
+        std::unique_lock lock{_mutex};
+        auto const       it = _entries.find(id);
+        if (it == _entries.end())
+            return false;
+        if (!it->second.value) // Another thread might have decoded it in the meantime
+            it->second.value = std::move(value);
+        return true;
+    }
+
+private:
+    mutable std::shared_mutex                _mutex;
+    mutable std::unordered_map<Id<T>, Entry> _entries; // Mutable because the values get decoded by the const accessors
+    mutable std::mutex                       _file_mutex;
+    mutable std::ifstream                    _file;
+};
+
+} // namespace reg
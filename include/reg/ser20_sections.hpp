@@ -0,0 +1,214 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "../../src/internal/parallel_for.hpp"
+#include "ser20.hpp"
+
+namespace reg {
+
+/// Options of `save_sections()` and `load_sections()`.
+struct SectionsOptions {
+    /// Big registries get split into several sections containing at most this many objects, so that they can be encoded and decoded by several threads.
+    std::size_t max_objects_per_section{4096};
+    /// Number of threads used to encode and decode the sections (including the calling thread).
+    unsigned int thread_count{internal::default_thread_count()};
+};
+
+namespace internal {
+
+template<typename T>
+using SectionObjects = std::vector<std::pair<Id<T>, T>>;
+
+/// Allows us to read a section through an `std::istream` without copying it.
+class ReadOnlyStreamBuffer : public std::streambuf {
+public:
+    explicit ReadOnlyStreamBuffer(std::string const& data)
+    {
+        auto* const begin = const_cast<char*>(data.data()); // NOLINT(*-const-cast) We never write through these pointers: std::streambuf just doesn't have a const version
+        setg(begin, begin, begin + data.size());
+    }
+};
+
+/// Binary archives store the ids as raw bytes, which is both smaller and faster to decode than their string representation.
+template<class Archive, typename T>
+void save_section_id(Archive& archive, Id<T> const& id)
+{
+    if constexpr (ser20::traits::is_text_archive<Archive>::value)
+    {
+        archive(id);
+    }
+    else
+    {
+        auto const bytes = id.underlying_uuid().as_bytes();
+        archive(ser20::binary_data(bytes.data(), bytes.size()));
+    }
+}
+
+template<class Archive, typename T>
+void load_section_id(Archive& archive, Id<T>& id)
+{
+    if constexpr (ser20::traits::is_text_archive<Archive>::value)
+    {
+        archive(id);
+    }
+    else
+    {
+        auto bytes = std::array<uuids::uuid::value_type, 16>{};
+        archive(ser20::binary_data(bytes.data(), bytes.size()));
+        id = Id<T>{uuids::uuid{bytes}};
+    }
+}
+
+template<typename OutputArchive, typename Iterator>
+auto encode_section(std::size_t registry_index, Iterator begin, Iterator end, std::size_t objects_count) -> std::string
+{
+    auto stream = std::ostringstream{};
+    {
+        auto archive = OutputArchive{stream};
+        archive(
+            ser20::make_nvp("Registry", static_cast<std::uint64_t>(registry_index)),
+            ser20::make_nvp("Objects count", static_cast<std::uint64_t>(objects_count))
+        );
+        for (auto it = begin; it != end; ++it)
+        {
+            save_section_id(archive, it->first);
+            archive(it->second);
+        }
+    }
+    return std::move(stream).str();
+}
+
+template<typename InputArchive, typename T>
+void decode_section_objects(InputArchive& archive, std::size_t objects_count, SectionObjects<T>& objects)
+{
+    objects.reserve(objects_count);
+    for (std::size_t i = 0; i < objects_count; ++i)
+    {
+        auto id    = Id<T>{};
+        auto value = T{};
+        load_section_id(archive, id);
+        archive(value);
+        objects.emplace_back(id, std::move(value));
+    }
+}
+
+template<typename OutputArchive, typename Tuple, std::size_t... Is>
+void list_section_encoders(Tuple const& registries, std::size_t max_objects_per_section, std::vector<std::function<std::string()>>& encoders, std::index_sequence<Is...>)
+{
+    auto const list_encoders_of_registry = [&](std::size_t registry_index, auto const& container) {
+        auto const objects_count  = static_cast<std::size_t>(std::distance(container.begin(), container.end()));
+        auto       section_begin  = container.begin();
+        auto       objects_so_far = std::size_t{0};
+        do // Even an empty registry gets a section, so that we know that it must be cleared when loading
+        {
+            auto const section_size = std::min(max_objects_per_section, objects_count - objects_so_far);
+            auto const section_end  = std::next(section_begin, static_cast<std::ptrdiff_t>(section_size));
+            encoders.emplace_back([=]() {
+                return encode_section<OutputArchive>(registry_index, section_begin, section_end, section_size);
+            });
+            section_begin = section_end;
+            objects_so_far += section_size;
+        } while (objects_so_far < objects_count);
+    };
+    (list_encoders_of_registry(Is, std::get<Is>(registries).underlying_container()), ...);
+}
+
+} // namespace internal
+
+/// Thread-safe.
+/// Saves the registries as a list of sections that can be encoded and decoded independently of each other, and therefore in parallel.
+/// Big registries are split into several sections, so that they can be spread over several threads too (see `SectionsOptions`).
+/// The encoding happens on a consistent `snapshot()` of the registries, so we don't need to lock them while we encode.
+/// You can then write the sections to a file however you want (for example with ser20: `archive(sections)`), and load them back with `load_sections()`.
+template<typename OutputArchive, typename... Ts>
+[[nodiscard]] auto save_sections(Registries<Ts...> const& registries, SectionsOptions const& options = {}) -> std::vector<std::string>
+{
+    auto const snapshot = registries.snapshot();
+
+    auto encoders = std::vector<std::function<std::string()>>{};
+    internal::list_section_encoders<OutputArchive>(snapshot.underlying_registries(), std::max<std::size_t>(options.max_objects_per_section, 1), encoders, std::index_sequence_for<Ts...>{});
+
+    auto sections = std::vector<std::string>(encoders.size());
+    internal::parallel_for(encoders.size(), options.thread_count, [&](std::size_t i) {
+        sections[i] = encoders[i]();
+    });
+    return sections;
+}
+
+/// Thread-safe.
+/// Loads sections created by `save_sections()`: they are decoded in parallel, and then each registry gets filled in parallel too.
+/// The result is the same as if you had loaded the registries with the usual (sequential) `archive(registries)`:
+/// the previous content of the registries is replaced by the one stored in the sections.
+template<typename InputArchive, typename... Ts>
+void load_sections(Registries<Ts...>& registries, std::vector<std::string> const& sections, SectionsOptions const& options = {})
+{
+    // Decode all the sections in parallel.
+    // Each section writes to its own slot, in the vector corresponding to the type of its registry
+    auto decoded = std::tuple<std::vector<internal::SectionObjects<typename Ts::ValueType>>...>{
+        std::vector<internal::SectionObjects<typename Ts::ValueType>>(sections.size())...
+    };
+    auto const decode_section = [&]<std::size_t... Is>(std::size_t section_index, std::index_sequence<Is...>) {
+        auto buffer  = internal::ReadOnlyStreamBuffer{sections[section_index]};
+        auto stream  = std::istream{&buffer};
+        auto archive = InputArchive{stream};
+
+        auto registry_index = std::uint64_t{};
+        auto objects_count  = std::uint64_t{};
+        archive(
+            ser20::make_nvp("Registry", registry_index),
+            ser20::make_nvp("Objects count", objects_count)
+        );
+        if (registry_index >= sizeof...(Ts))
+            throw std::runtime_error{"[load_sections()] Invalid registry index: " + std::to_string(registry_index)};
+
+        std::ignore = ((Is == registry_index
+                            ? (internal::decode_section_objects(archive, static_cast<std::size_t>(objects_count), std::get<Is>(decoded)[section_index]), true)
+                            : false)
+                       || ...);
+    };
+    internal::parallel_for(sections.size(), options.thread_count, [&](std::size_t section_index) {
+        decode_section(section_index, std::index_sequence_for<Ts...>{});
+    });
+
+    // Fill each registry on its own thread.
+    // The new storage is built without locking the registry, and then swapped in at once, so other threads see either the old content or the new one, never a mix of both
+    auto const fill_registry = [&]<std::size_t... Is>(std::size_t registry_index, std::index_sequence<Is...>) {
+        auto const fill = [&](auto& registry, auto& sections_objects) {
+            auto objects_count = std::size_t{0};
+            for (auto const& objects : sections_objects)
+                objects_count += objects.size();
+
+            using Map = std::remove_cvref_t<decltype(registry.underlying_container())>;
+            auto map  = std::make_shared<Map>();
+            if constexpr (requires { map->reserve(objects_count); })
+                map->reserve(objects_count);
+            for (auto& objects : sections_objects)
+            {
+                for (auto& [id, value] : objects)
+                    map->try_emplace(id, std::move(value));
+            }
+            registry.underlying_wrapped_registry()->restore(std::move(map));
+        };
+        std::ignore = ((Is == registry_index
+                            ? (fill(std::get<Is>(registries.underlying_registries()), std::get<Is>(decoded)), true)
+                            : false)
+                       || ...);
+    };
+    internal::parallel_for(sizeof...(Ts), options.thread_count, [&](std::size_t registry_index) {
+        fill_registry(registry_index, std::index_sequence_for<Ts...>{});
+    });
+}
+
+} // namespace reg
@@ -0,0 +1,124 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ser20_sections.hpp"
+
+namespace reg {
+
+/// Options of `save_stream()`.
+struct StreamOptions {
+    /// A chunk is emitted as soon as it contains that many objects...
+    std::size_t max_objects_per_chunk{1024};
+    /// ... or as soon as its encoded size reaches that many bytes (it can go slightly over it, by the size of one object).
+    std::size_t max_bytes_per_chunk{1024 * 1024};
+};
+
+/// Thread-safe.
+/// Saves the registry as a sequence of chunks of bounded size, that get passed to `sink(std::string_view chunk)` one after the other.
+/// Only one chunk is held in memory at any given time, so this can export registries of any size (e.g. to a file or a pipe, see `ostream_sink()`).
+/// `sink` is called synchronously, so a slow sink naturally slows the export down instead of making the chunks pile up in memory.
+/// The registry is (shared-)locked during the whole export: other threads can keep reading it, but not modify it.
+template<typename OutputArchive, typename T, typename Map, typename Lock, typename Sink>
+void save_stream(internal::RawRegistryImpl<T, Map, Lock> const& registry, Sink&& sink, StreamOptions const& options = {})
+{
+    std::shared_lock lock{registry.mutex()};
+
+    auto       it           = registry.begin();
+    auto const end          = registry.end();
+    auto       chunk_stream = std::ostringstream{};
+    while (it != end)
+    {
+        chunk_stream.str({});
+        {
+            auto archive       = OutputArchive{chunk_stream};
+            auto objects_count = std::size_t{0};
+            // Each object is preceded by a `true` flag, and the chunk ends with a `false` flag.
+            // This allows us to decide when to end the chunk after having encoded its objects.
+            for (; it != end && objects_count < options.max_objects_per_chunk && static_cast<std::size_t>(chunk_stream.tellp()) < options.max_bytes_per_chunk; ++it, ++objects_count)
+            {
+                archive(true);
+                internal::save_section_id(archive, it->first);
+                archive(it->second);
+            }
+            archive(false);
+        }
+        sink(std::string_view{chunk_stream.view()});
+    }
+}
+
+/// Thread-safe.
+/// Loads a registry saved with `save_stream()`: `source(std::string& chunk)` must fill `chunk` with the next chunk and return true, or return false once there are no chunks left.
+/// Only one chunk is held in memory at any given time. The objects are decoded into a new storage, that replaces the previous content of the registry once all the chunks have been decoded:
+/// if `source` or the decoding throws, the registry is left untouched. The registry is only locked while we swap the new storage in, so other threads never see it partially loaded.
+template<typename InputArchive, typename T, typename Map, typename Lock, typename Source>
+void load_stream(internal::RawRegistryImpl<T, Map, Lock>& registry, Source&& source)
+{
+    auto map   = std::make_shared<Map>();
+    auto chunk = std::string{};
+    while (source(chunk))
+    {
+        auto buffer          = internal::ReadOnlyStreamBuffer{chunk};
+        auto stream          = std::istream{&buffer};
+        auto archive         = InputArchive{stream};
+        auto has_next_object = bool{};
+        for (archive(has_next_object); has_next_object; archive(has_next_object))
+        {
+            auto id    = Id<T>{};
+            auto value = T{};
+            internal::load_section_id(archive, id);
+            archive(value);
+            map->try_emplace(id, std::move(value));
+        }
+    }
+    registry.restore(std::move(map));
+}
+
+template<typename OutputArchive, typename T, typename Map, typename Lock, typename Sink>
+void save_stream(internal::RegistryImpl<T, Map, Lock> const& registry, Sink&& sink, StreamOptions const& options = {})
+{
+    save_stream<OutputArchive>(*registry.underlying_wrapped_registry(), std::forward<Sink>(sink), options);
+}
+
+template<typename InputArchive, typename T, typename Map, typename Lock, typename Source>
+void load_stream(internal::RegistryImpl<T, Map, Lock>& registry, Source&& source)
+{
+    load_stream<InputArchive>(*registry.underlying_wrapped_registry(), std::forward<Source>(source));
+}
+
+/// A sink for `save_stream()` that writes each chunk to `stream`, preceded by its size.
+inline auto ostream_sink(std::ostream& stream)
+{
+    return [&stream](std::string_view chunk) {
+        auto const size = static_cast<std::uint64_t>(chunk.size());
+        stream.write(reinterpret_cast<char const*>(&size), sizeof(size)); // NOLINT(*-reinterpret-cast)
+        stream.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        if (!stream)
+            throw std::runtime_error{"[ostream_sink()] Failed to write a chunk"};
+    };
+}
+
+/// A source for `load_stream()` that reads the chunks written to `stream` by an `ostream_sink()`.
+inline auto istream_source(std::istream& stream)
+{
+    return [&stream](std::string& chunk) {
+        auto size = std::uint64_t{};
+        if (!stream.read(reinterpret_cast<char*>(&size), sizeof(size))) // NOLINT(*-reinterpret-cast)
+            return false;
+        chunk.resize(static_cast<std::size_t>(size));
+        if (!stream.read(chunk.data(), static_cast<std::streamsize>(size)))
+            throw std::runtime_error{"[istream_source()] Truncated chunk"};
+        return true;
+    };
+}
+
+} // namespace reg
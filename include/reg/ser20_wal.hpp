@@ -0,0 +1,545 @@
+#pragma once
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "ser20_sections.hpp"
+
+namespace reg {
+
+namespace internal {
+
+/// One operation stored in a `WriteAheadLog`. `value` is the encoded value of the object (empty for an erase), and points into the buffer the log has been read into.
+struct WriteAheadLogRecord {
+    enum class Operation : std::uint8_t {
+        Put   = 1, // The object has been created or modified, and now has this value
+        Erase = 2, // The object has been destroyed
+    };
+
+    Operation        operation{};
+    std::uint32_t    registry_index{};
+    uuids::uuid      uuid{};
+    std::string_view value{};
+};
+
+/// The file of a `WriteAheadLog`, along with the records that haven't been written to it yet.
+/// It is shared with the observers of the registries, which may outlive the `WriteAheadLog` itself.
+/// Each record is stored as its size, a checksum, and then its content, so that a record that was only partially written when the process crashed can be detected and ignored.
+class WriteAheadLogFile {
+public:
+    /// Replays the records of the log that was interrupted in the middle of a checkpoint (if any), then the ones of the current log, and opens the current log to append new records to it.
+    WriteAheadLogFile(std::filesystem::path path, std::function<void(WriteAheadLogRecord const&)> const& on_record)
+        : _path{std::move(path)}
+    {
+        if (std::filesystem::exists(old_path()))
+            replay(old_path(), on_record);
+        if (std::filesystem::exists(_path))
+        {
+            replay(_path, on_record);
+            open_file("WriteAheadLog()");
+        }
+        else
+        {
+            create_file();
+        }
+    }
+
+    ~WriteAheadLogFile()
+    {
+        try
+        {
+            commit();
+        }
+        catch (...) // NOLINT(*-empty-catch) Destructors can't throw, and there is nobody to report the error to
+        {
+        }
+        ::close(_fd);
+    }
+
+    WriteAheadLogFile(WriteAheadLogFile const&)                    = delete;
+    auto operator=(WriteAheadLogFile const&) -> WriteAheadLogFile& = delete;
+    WriteAheadLogFile(WriteAheadLogFile&&)                         = delete;
+    auto operator=(WriteAheadLogFile&&) -> WriteAheadLogFile&      = delete;
+
+    [[nodiscard]] static auto encode_record(WriteAheadLogRecord::Operation operation, std::uint32_t registry_index, uuids::uuid const& uuid, std::string_view value) -> std::string
+    {
+        auto const payload_size = static_cast<std::uint32_t>(sizeof(operation) + sizeof(registry_index) + 16 + value.size());
+        auto       record       = std::string{};
+        record.reserve(record_header_size + payload_size);
+        append_integer(record, payload_size);
+        append_integer(record, std::uint64_t{0}); // Placeholder for the checksum
+        append_integer(record, static_cast<std::uint8_t>(operation));
+        append_integer(record, registry_index);
+        auto const uuid_bytes = uuid.as_bytes();
+        record.append(reinterpret_cast<char const*>(uuid_bytes.data()), uuid_bytes.size()); // NOLINT(*-reinterpret-cast)
+        record.append(value);
+        auto const checksum = fnv1a(std::string_view{record}.substr(record_header_size));
+        std::memcpy(record.data() + sizeof(payload_size), &checksum, sizeof(checksum));
+        return record;
+    }
+
+    /// Thread-safe.
+    /// Only appends `record` to a buffer in memory: this is called by the observers, while a registry is locked, so it must be fast. `commit()` is the one that writes to the file.
+    void append(std::string_view record)
+    {
+        std::lock_guard lock{_mutex};
+        _pending.append(record);
+        ++_appended_count;
+    }
+
+    /// Thread-safe.
+    /// Blocks until all the records appended so far are on disk.
+    /// The first thread that needs to write becomes the leader: it writes all the pending records (including the ones of the threads that are waiting) and syncs the file once for all of them.
+    /// The threads that call `commit()` in the meantime wait for the leader, and then either return right away (if their records have been written) or one of them becomes the next leader.
+    void commit()
+    {
+        std::unique_lock lock{_mutex};
+        auto const       target = _appended_count;
+        while (_durable_count < target)
+        {
+            if (_is_writing)
+            {
+                _written.wait(lock);
+                continue;
+            }
+
+            _is_writing            = true;
+            auto const batch       = std::exchange(_pending, {});
+            auto const batch_count = _appended_count;
+            lock.unlock();
+            try
+            {
+                write_all(_fd, batch, "commit()");
+                sync(_fd, "commit()");
+            }
+            catch (...)
+            {
+                lock.lock();
+                std::ignore = ::ftruncate(_fd, static_cast<off_t>(_file_size)); // Don't leave a partial batch in front of the records that will be written next
+                _pending.insert(0, batch);
+                _is_writing = false;
+                _written.notify_all();
+                throw;
+            }
+            lock.lock();
+            _file_size += batch.size();
+            _durable_count = batch_count;
+            ++_syncs_count;
+            _is_writing = false;
+            _written.notify_all();
+        }
+    }
+
+    /// Thread-safe.
+    /// Starts a new, empty, log, and calls `save()`. The records of the current log are kept in a separate file until `save()` returns, so that they still get replayed if we crash before the checkpoint is saved.
+    void checkpoint(std::function<void()> const& save)
+    {
+        std::lock_guard lock{_checkpoint_mutex};
+        begin_checkpoint();
+        save();
+        end_checkpoint();
+    }
+
+    [[nodiscard]] auto syncs_count() const -> std::uint64_t
+    {
+        std::lock_guard lock{_mutex};
+        return _syncs_count;
+    }
+
+private:
+    static constexpr std::array<char, 8> magic_number{'r', 'e', 'g', '-', 'w', 'a', 'l', '1'};
+    static constexpr std::size_t         record_header_size = sizeof(std::uint32_t) + sizeof(std::uint64_t); // The size of the payload, and its checksum
+
+    void begin_checkpoint()
+    {
+        commit();
+
+        std::unique_lock lock{_mutex};
+        _written.wait(lock, [&] { return !_is_writing; });
+        write_all(_fd, std::exchange(_pending, {}), "checkpoint()"); // Records appended since the `commit()` above
+        sync(_fd, "checkpoint()");
+        _durable_count = _appended_count;
+        ::close(_fd);
+        _fd = -1;
+
+        try
+        {
+            if (std::filesystem::exists(old_path()))
+            {
+                // A previous checkpoint failed: its records have not been saved anywhere else, so we keep them, followed by the current ones
+                auto       current = read_file(_path);
+                auto const old_fd  = ::open(old_path().c_str(), O_WRONLY | O_APPEND | O_CLOEXEC); // NOLINT(*-vararg)
+                if (old_fd < 0)
+                    throw_errno("checkpoint()", "Couldn't open " + old_path().string());
+                write_all(old_fd, std::string_view{current}.substr(magic_number.size()), "checkpoint()");
+                sync(old_fd, "checkpoint()");
+                ::close(old_fd);
+                std::filesystem::remove(_path);
+            }
+            else
+            {
+                std::filesystem::rename(_path, old_path());
+            }
+            create_file();
+        }
+        catch (...)
+        {
+            // Keep appending to whichever log is still there, so that the next commits don't fail too
+            if (_fd < 0)
+            {
+                if (std::filesystem::exists(_path))
+                {
+                    open_file("checkpoint()");
+                    _file_size = std::filesystem::file_size(_path);
+                }
+                else
+                {
+                    create_file();
+                }
+            }
+            throw;
+        }
+    }
+
+    /// Called once the checkpoint has been saved: the records of the previous log are not needed anymore.
+    void end_checkpoint()
+    {
+        std::lock_guard lock{_mutex};
+        std::filesystem::remove(old_path());
+        sync_directory();
+    }
+
+    [[nodiscard]] auto old_path() const -> std::filesystem::path
+    {
+        auto path = _path;
+        path += ".old";
+        return path;
+    }
+
+    template<typename Integer>
+    static void append_integer(std::string& bytes, Integer integer)
+    {
+        bytes.append(reinterpret_cast<char const*>(&integer), sizeof(integer)); // NOLINT(*-reinterpret-cast)
+    }
+
+    template<typename Integer>
+    [[nodiscard]] static auto read_integer(std::string_view bytes) -> Integer
+    {
+        auto integer = Integer{};
+        std::memcpy(&integer, bytes.data(), sizeof(integer));
+        return integer;
+    }
+
+    [[nodiscard]] static auto fnv1a(std::string_view bytes) -> std::uint64_t
+    {
+        auto hash = std::uint64_t{0xcbf29ce484222325};
+        for (auto const byte : bytes)
+        {
+            hash ^= static_cast<unsigned char>(byte);
+            hash *= 0x100000001b3;
+        }
+        return hash;
+    }
+
+    [[noreturn]] static void throw_errno(char const* function_name, std::string const& message)
+    {
+        throw std::runtime_error{std::string{"[WriteAheadLog::"} + function_name + "] " + message + ": " + std::strerror(errno)};
+    }
+
+    [[nodiscard]] static auto read_file(std::filesystem::path const& path) -> std::string
+    {
+        auto file = std::ifstream{path, std::ios::binary};
+        if (!file)
+            throw std::runtime_error{"[WriteAheadLog()] Couldn't open " + path.string()};
+        return std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+    }
+
+    static void write_all(int fd, std::string_view bytes, char const* function_name)
+    {
+        while (!bytes.empty())
+        {
+            auto const written = ::write(fd, bytes.data(), bytes.size());
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw_errno(function_name, "Failed to write the log");
+            }
+            bytes.remove_prefix(static_cast<std::size_t>(written));
+        }
+    }
+
+    static void sync(int fd, char const* function_name)
+    {
+#if defined(__APPLE__)
+        auto const result = ::fsync(fd);
+#else
+        auto const result = ::fdatasync(fd); // We only append, so the metadata that matters (the size of the file) is synced too
+#endif
+        if (result != 0)
+            throw_errno(function_name, "Failed to sync the log");
+    }
+
+    /// Makes the creation, renaming and removal of our files durable.
+    void sync_directory() const
+    {
+        auto const directory = _path.has_parent_path() ? _path.parent_path() : std::filesystem::path{"."};
+        auto const fd        = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT(*-vararg)
+        if (fd < 0)
+            return;
+        std::ignore = ::fsync(fd);
+        ::close(fd);
+    }
+
+    /// Opens the existing log to append new records to it.
+    void open_file(char const* function_name)
+    {
+        _fd = ::open(_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC); // NOLINT(*-vararg)
+        if (_fd < 0)
+            throw_errno(function_name, "Couldn't open " + _path.string());
+    }
+
+    void create_file()
+    {
+        _fd = ::open(_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC, 0644); // NOLINT(*-vararg)
+        if (_fd < 0)
+            throw_errno("WriteAheadLog()", "Couldn't create " + _path.string());
+        write_all(_fd, std::string_view{magic_number.data(), magic_number.size()}, "WriteAheadLog()");
+        sync(_fd, "WriteAheadLog()");
+        sync_directory();
+        _file_size = magic_number.size();
+    }
+
+    /// Calls `on_record` on each complete record of the file at `path`, and cuts the file right after the last one, in case we crashed while writing the next one.
+    void replay(std::filesystem::path const& path, std::function<void(WriteAheadLogRecord const&)> const& on_record)
+    {
+        auto const content = read_file(path);
+        if (content.size() < magic_number.size() || std::string_view{content}.substr(0, magic_number.size()) != std::string_view{magic_number.data(), magic_number.size()})
+            throw std::runtime_error{"[WriteAheadLog()] Not a write-ahead log: " + path.string()};
+
+        auto       bytes      = std::string_view{content}.substr(magic_number.size());
+        auto const fixed_size = sizeof(WriteAheadLogRecord::Operation) + sizeof(std::uint32_t) + 16;
+        auto       valid_size = magic_number.size();
+        while (bytes.size() >= record_header_size)
+        {
+            auto const payload_size = read_integer<std::uint32_t>(bytes);
+            if (payload_size < fixed_size || bytes.size() < record_header_size + payload_size)
+                break;
+            auto const payload = bytes.substr(record_header_size, payload_size);
+            if (fnv1a(payload) != read_integer<std::uint64_t>(bytes.substr(sizeof(payload_size))))
+                break;
+
+            auto uuid_bytes = std::array<std::uint8_t, 16>{};
+            std::memcpy(uuid_bytes.data(), payload.data() + sizeof(WriteAheadLogRecord::Operation) + sizeof(std::uint32_t), uuid_bytes.size());
+            on_record(WriteAheadLogRecord{
+                .operation      = static_cast<WriteAheadLogRecord::Operation>(read_integer<std::uint8_t>(payload)),
+                .registry_index = read_integer<std::uint32_t>(payload.substr(sizeof(WriteAheadLogRecord::Operation))),
+                .uuid           = uuids::uuid{uuid_bytes},
+                .value          = payload.substr(fixed_size),
+            });
+            bytes.remove_prefix(record_header_size + payload_size);
+            valid_size += record_header_size + payload_size;
+        }
+
+        if (valid_size != content.size())
+            std::filesystem::resize_file(path, valid_size);
+        _file_size = valid_size;
+    }
+
+private:
+    std::filesystem::path   _path;
+    int                     _fd{-1};
+    std::uint64_t           _file_size{0};      // Only the records that have been synced. Only accessed by the thread that is writing.
+    std::string             _pending{};         // The records that have been appended but not written yet
+    std::uint64_t           _appended_count{0}; // The number of records that have been appended since the log was opened...
+    std::uint64_t           _durable_count{0};  // ... and how many of them are on disk
+    std::uint64_t           _syncs_count{0};
+    bool                    _is_writing{false}; // True while a leader is writing and syncing a batch of records, without holding `_mutex`
+    std::condition_variable _written;
+    mutable std::mutex      _mutex;
+    std::mutex              _checkpoint_mutex; // Only one checkpoint at a time
+};
+
+} // namespace internal
+
+/// Logs every creation, modification and destruction of objects in some registries to a file, so that they can be recovered after a crash.
+/// This is much cheaper than saving the whole registries after each modification: each modification only appends its id and the value of its object (encoded with `OutputArchive`) to the log.
+/// The modifications are only buffered in memory until you call `commit()`, which writes them all and syncs the file once. When several threads `commit()` at the same time, one of them writes and syncs the modifications of all the others (group commit).
+/// When you open the log again, it replays the modifications that have been committed on top of the registries you pass to it (i.e. the ones you have loaded from your last checkpoint).
+/// `checkpoint()` lets you save the registries and start over with an empty log, so that the log doesn't grow forever.
+/// NB: the modifications done through `get_mutable_ref()`, the iterators and the `underlying_container()` can't be observed, and therefore are not logged.
+template<typename InputArchive, typename OutputArchive>
+class WriteAheadLog {
+public:
+    /// Replays the log at `path` (if it exists) on top of `registries`, and then logs all their modifications to it.
+    /// NOT Thread-safe: `registries` must not be used by other threads while the log is being replayed, and they must not have been given to another `WriteAheadLog`.
+    /// Throws if the file is not a write-ahead log, or if it doesn't match the types of the registries.
+    template<typename... Ts>
+    WriteAheadLog(std::filesystem::path const& path, Registries<Ts...>& registries)
+    {
+        open(path, registries.underlying_registries());
+    }
+
+    /// Replays the log at `path` (if it exists) on top of `registry`, and then logs all its modifications to it.
+    /// NOT Thread-safe: `registry` must not be used by other threads while the log is being replayed, and it must not have been given to another `WriteAheadLog`.
+    template<typename T, typename Map, typename Lock>
+    WriteAheadLog(std::filesystem::path const& path, internal::RegistryImpl<T, Map, Lock>& registry)
+    {
+        auto registries = std::tie(registry);
+        open(path, registries);
+    }
+
+    /// Commits the last modifications. The registries keep logging their modifications to the file (they can't be detached from it), and the file commits them once they are destroyed.
+    ~WriteAheadLog()
+    {
+        if (!_file)
+            return; // Moved-from
+        try
+        {
+            commit();
+        }
+        catch (...) // NOLINT(*-empty-catch) Destructors can't throw. The modifications will be written again by the next commit.
+        {
+        }
+    }
+
+    WriteAheadLog(WriteAheadLog const&)                        = delete;
+    auto operator=(WriteAheadLog const&) -> WriteAheadLog&     = delete;
+    WriteAheadLog(WriteAheadLog&&) noexcept                    = default;
+    auto operator=(WriteAheadLog&&) noexcept -> WriteAheadLog& = default;
+
+    /// Thread-safe.
+    /// Blocks until all the modifications made so far are on disk. Call it whenever you want your modifications to be durable (e.g. after each action of the user).
+    /// Several threads that commit at the same time share a single write and sync.
+    void commit()
+    {
+        _file->commit();
+    }
+
+    /// Thread-safe.
+    /// Starts a new, empty log, and then calls `save()`, which must take a snapshot of the registries (e.g. with `registries.snapshot()`) and write it to disk. The old log is deleted once `save()` returns.
+    /// `save()` should write to a temporary file and then rename it, so that a crash never leaves you with a half-written checkpoint.
+    /// If we crash (or if `save()` throws) before the checkpoint is saved, the old log is kept, and gets replayed along with the new one next time, on top of the previous checkpoint.
+    /// Replaying the records of the new log on top of the new checkpoint, even though it may already contain some of them, is harmless: each record holds the latest value of its object.
+    /// The other threads can keep modifying the registries during `save()`.
+    void checkpoint(std::function<void()> const& save)
+    {
+        _file->checkpoint(save);
+    }
+
+    /// Thread-safe.
+    /// The number of times the log has been synced to disk, which tells you how well the commits are grouped.
+    [[nodiscard]] auto syncs_count() const -> std::uint64_t
+    {
+        return _file->syncs_count();
+    }
+
+private:
+    using Record = internal::WriteAheadLogRecord;
+
+    template<typename T>
+    [[nodiscard]] static auto encode(T const& value) -> std::string
+    {
+        auto stream = std::ostringstream{};
+        {
+            auto archive = OutputArchive{stream};
+            archive(value);
+        }
+        return std::move(stream).str();
+    }
+
+    template<typename T>
+    [[nodiscard]] static auto decode(std::string_view bytes) -> T
+    {
+        auto value   = T{};
+        auto data    = std::string{bytes};
+        auto buffer  = internal::ReadOnlyStreamBuffer{data};
+        auto stream  = std::istream{&buffer};
+        auto archive = InputArchive{stream};
+        archive(value);
+        return value;
+    }
+
+    template<typename Tuple>
+    void open(std::filesystem::path const& path, Tuple& registries)
+    {
+        constexpr auto indices = std::make_index_sequence<std::tuple_size_v<Tuple>>{};
+        _file                  = std::make_shared<internal::WriteAheadLogFile>(path, [&](Record const& record) {
+            replay_record(registries, record, indices);
+        });
+        attach(registries, indices);
+    }
+
+    template<typename Tuple, std::size_t... Is>
+    static void replay_record(Tuple& registries, Record const& record, std::index_sequence<Is...>)
+    {
+        if (record.registry_index >= sizeof...(Is))
+            throw std::runtime_error{"[WriteAheadLog()] The log doesn't match the registries"};
+        std::ignore = ((Is == record.registry_index && (replay_record_in(std::get<Is>(registries), record), true)) || ...);
+    }
+
+    template<typename Registry>
+    static void replay_record_in(Registry& registry, Record const& record)
+    {
+        using T       = typename Registry::ValueType;
+        auto const id = Id<T>{record.uuid};
+        if (record.operation == Record::Operation::Erase)
+        {
+            registry.destroy(id);
+        }
+        else
+        {
+            auto value = decode<T>(record.value);
+            if (!registry.set(id, value))
+                registry.underlying_wrapped_registry()->insert_raw(id, std::move(value));
+        }
+    }
+
+    template<typename Tuple, std::size_t... Is>
+    void attach(Tuple& registries, std::index_sequence<Is...>)
+    {
+        (attach_to(std::get<Is>(registries), static_cast<std::uint32_t>(Is)), ...);
+    }
+
+    template<typename Registry>
+    void attach_to(Registry& registry, std::uint32_t registry_index)
+    {
+        using T        = typename Registry::ValueType;
+        auto const put = [file = _file, registry_index](Id<T> const& id, T const& value) {
+            file->append(internal::WriteAheadLogFile::encode_record(Record::Operation::Put, registry_index, id.underlying_uuid(), encode(value)));
+        };
+        registry.underlying_wrapped_registry()->add_observer(internal::RegistryObserver<T>{
+            .on_insert = put,
+            .on_erase  = [file = _file, registry_index](Id<T> const& id, T const&) {
+                file->append(internal::WriteAheadLogFile::encode_record(Record::Operation::Erase, registry_index, id.underlying_uuid(), {}));
+            },
+            .on_change = put,
+        });
+    }
+
+private:
+    std::shared_ptr<internal::WriteAheadLogFile> _file;
+};
+
+} // namespace reg
+
+#endif
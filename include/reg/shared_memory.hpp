@@ -0,0 +1,394 @@
+#pragma once
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "../../src/internal/cpu_relax.hpp"
+#include "reg.hpp"
+
+namespace reg {
+
+/// A reader-writer lock that lives in shared memory and can be locked by several processes (a `pthread_rwlock_t` with `PTHREAD_PROCESS_SHARED`).
+/// It is the `mutex()` of a `SharedMemoryRegistry`, so you can lock it with `std::shared_lock` / `std::unique_lock` like the mutex of any other registry.
+class SharedMemoryMutex {
+public:
+    void lock() { check(pthread_rwlock_wrlock(&_lock), "lock()"); }
+    [[nodiscard]] auto try_lock() -> bool { return pthread_rwlock_trywrlock(&_lock) == 0; }
+    void unlock() { check(pthread_rwlock_unlock(&_lock), "unlock()"); }
+
+    void lock_shared() { check(pthread_rwlock_rdlock(&_lock), "lock_shared()"); }
+    [[nodiscard]] auto try_lock_shared() -> bool { return pthread_rwlock_tryrdlock(&_lock) == 0; }
+    void unlock_shared() { check(pthread_rwlock_unlock(&_lock), "unlock_shared()"); }
+
+private:
+    template<typename T>
+        requires std::is_trivially_copyable_v<T>
+    friend class SharedMemoryRegistry;
+
+    SharedMemoryMutex()
+    {
+        auto attributes = pthread_rwlockattr_t{};
+        check(pthread_rwlockattr_init(&attributes), "SharedMemoryMutex()");
+        check(pthread_rwlockattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED), "SharedMemoryMutex()");
+        check(pthread_rwlock_init(&_lock, &attributes), "SharedMemoryMutex()");
+        pthread_rwlockattr_destroy(&attributes);
+    }
+
+    static void check(int error_code, char const* function_name)
+    {
+        if (error_code != 0)
+            throw std::runtime_error{std::string{"[SharedMemoryMutex::"} + function_name + "] " + std::strerror(error_code)};
+    }
+
+private:
+    pthread_rwlock_t _lock{};
+};
+
+/// A registry that lives in a POSIX shared memory segment, so that several processes can read and modify the same objects, without copying them nor serializing them.
+/// Each process opens the segment by its name; the first one creates it with room for `max_objects_count` objects (the segment cannot grow afterwards).
+/// The storage is an open-addressing hash table that only contains offsets (no pointers), so each process can map it at a different address.
+/// `T` must be trivially copyable, since its bytes are shared as-is between the processes.
+/// It is guarded by a `SharedMemoryMutex`, that is shared between the processes too.
+/// NB: the segment outlives the processes that use it, until you call `SharedMemoryRegistry::remove(name)`. On glibc < 2.34 you need to link with `-lrt`.
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+class SharedMemoryRegistry {
+public:
+    /// The type of values stored in this registry.
+    using ValueType = T;
+    /// The type of mutex used to guard this registry.
+    using LockType = SharedMemoryMutex;
+
+    /// Opens the shared memory segment called `name` (e.g. "/my-app-meshes"), or creates it if it doesn't exist yet.
+    /// `max_objects_count` is only used when creating the segment.
+    /// Throws if the segment can't be opened, or if it has been created for a different type of registry.
+    SharedMemoryRegistry(std::string const& name, std::size_t max_objects_count)
+    {
+        open(name, max_objects_count);
+    }
+
+    ~SharedMemoryRegistry()
+    {
+        if (_header)
+            munmap(_header, _mapping_size);
+    }
+
+    SharedMemoryRegistry(SharedMemoryRegistry const&)                    = delete;
+    auto operator=(SharedMemoryRegistry const&) -> SharedMemoryRegistry& = delete;
+    SharedMemoryRegistry(SharedMemoryRegistry&&)                         = delete;
+    auto operator=(SharedMemoryRegistry&&) -> SharedMemoryRegistry&      = delete;
+
+    /// Destroys the shared memory segment called `name`. The processes that have it opened can keep using it, but it can't be opened anymore.
+    /// Returns false if there was no such segment.
+    static auto remove(std::string const& name) -> bool
+    {
+        return shm_unlink(name.c_str()) == 0;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Returns a copy of the object referenced by `id`, or null if the `id` doesn't refer to an object in this registry.
+    [[nodiscard]] auto get(Id<T> const& id) const -> std::optional<T>
+    {
+        std::shared_lock lock{mutex()};
+        auto const*      slot = find(id);
+        if (!slot)
+            return std::nullopt;
+        return slot->value;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Sets the value of the object referenced by `id` to `value`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto set(Id<T> const& id, T const& value) -> bool
+    {
+        std::unique_lock lock{mutex()};
+        auto* const      slot = find(id);
+        if (!slot)
+            return false;
+        slot->value = value;
+        return true;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Returns true iff `id` references an object in the registry.
+    [[nodiscard]] auto contains(Id<T> const& id) const -> bool
+    {
+        std::shared_lock lock{mutex()};
+        return find(id) != nullptr;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Applies `callback` to the object referenced by `id`, directly in the shared memory.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_ref(Id<T> const& id, std::function<void(T const&)> const& callback) const -> bool
+    {
+        std::shared_lock lock{mutex()};
+        auto const*      slot = find(id);
+        if (!slot)
+            return false;
+        callback(slot->value);
+        return true;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Applies `callback` to the object referenced by `id`, directly in the shared memory.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool
+    {
+        std::unique_lock lock{mutex()};
+        auto* const      slot = find(id);
+        if (!slot)
+            return false;
+        callback(slot->value);
+        return true;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Inserts a copy of `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    /// Throws if the registry already contains `max_objects_count()` objects.
+    [[nodiscard]] auto create_raw(T const& value) -> Id<T>
+    {
+        auto const id = Id<T>{generate_uuid()};
+        insert_raw(id, value);
+        return id;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Inserts a copy of `value` into the registry, with the given `id`. Does nothing if `id` is already present in the registry.
+    /// Throws if the registry already contains `max_objects_count()` objects.
+    void insert_raw(Id<T> const& id, T const& value)
+    {
+        std::unique_lock lock{mutex()};
+        auto             index = home_index(id);
+        for (; _slots[index].is_occupied; index = next_index(index))
+        {
+            if (_slots[index].id == id)
+                return;
+        }
+        if (_header->objects_count == _header->max_objects_count)
+            throw std::runtime_error{"[SharedMemoryRegistry::insert_raw()] The registry is full"};
+
+        _slots[index] = Slot{.is_occupied = true, .id = id, .value = value};
+        ++_header->objects_count;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Destroys the object and removes it from the registry.
+    /// From then on, trying to get an object using `id` is still safe but will return null.
+    void destroy(Id<T> const& id)
+    {
+        std::unique_lock lock{mutex()};
+        auto* const      slot = find(id);
+        if (!slot)
+            return;
+
+        // Backward-shift deletion: move the following objects of the cluster back, so that lookups never need tombstones
+        auto hole = static_cast<std::size_t>(slot - _slots);
+        for (auto index = next_index(hole); _slots[index].is_occupied; index = next_index(index))
+        {
+            auto const home = home_index(_slots[index].id);
+            // The object can fill the hole iff its home is not in (hole, index], taking wrap-around into account
+            auto const can_move = hole <= index
+                                      ? (home <= hole || home > index)
+                                      : (home <= hole && home > index);
+            if (can_move)
+            {
+                _slots[hole] = _slots[index];
+                hole         = index;
+            }
+        }
+        _slots[hole].is_occupied = false;
+        --_header->objects_count;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Returns true iff the registry contains no objects at all.
+    [[nodiscard]] auto is_empty() const -> bool
+    {
+        return objects_count() == 0;
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Returns the number of objects in the registry.
+    [[nodiscard]] auto objects_count() const -> std::size_t
+    {
+        std::shared_lock lock{mutex()};
+        return static_cast<std::size_t>(_header->objects_count);
+    }
+
+    /// The maximum number of objects that the registry can contain, as chosen by the process that created it.
+    [[nodiscard]] auto max_objects_count() const -> std::size_t
+    {
+        return static_cast<std::size_t>(_header->max_objects_count);
+    }
+
+    /// Thread-safe, and process-safe.
+    /// Destroys all the objects in the registry.
+    void clear()
+    {
+        std::unique_lock lock{mutex()};
+        for (std::uint64_t i = 0; i < _header->slots_count; ++i)
+            _slots[i].is_occupied = false;
+        _header->objects_count = 0;
+    }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    /// Calls `callback(id, value)` on each object in the registry.
+    template<typename Callback>
+    void for_each(Callback&& callback) const
+    {
+        for (std::uint64_t i = 0; i < _header->slots_count; ++i)
+        {
+            if (_slots[i].is_occupied)
+                callback(_slots[i].id, _slots[i].value);
+        }
+    }
+
+    /// Returns the mutex that guards the registry, in all the processes. Use it to lock the registry manually, e.g. to use `for_each()`.
+    [[nodiscard]] auto mutex() const -> SharedMemoryMutex& { return _header->mutex; }
+
+private:
+    struct Slot {
+        bool  is_occupied;
+        Id<T> id;
+        T     value;
+    };
+
+    struct Header {
+        std::atomic<std::uint32_t> state; // See `State`
+        std::uint32_t              layout_signature;
+        std::uint64_t              max_objects_count;
+        std::uint64_t              slots_count; // A power of 2
+        std::uint64_t              objects_count;
+        SharedMemoryMutex          mutex;
+    };
+
+    enum State : std::uint32_t {
+        Uninitialized = 0, // A freshly created segment is filled with zeros
+        Ready         = 1,
+    };
+
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "The state of the segment is shared between processes, so it must not rely on a lock that lives in one of them");
+    static_assert(std::is_trivially_copyable_v<Id<T>>);
+
+    /// Allows us to detect a segment that has been created with a different type (or by an incompatible build).
+    static constexpr auto layout_signature = static_cast<std::uint32_t>(sizeof(Slot) << 16 | alignof(Slot) << 8 | sizeof(Header) % 256);
+
+    [[nodiscard]] static auto slots_offset() -> std::size_t
+    {
+        return (sizeof(Header) + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+    }
+
+    void open(std::string const& name, std::size_t max_objects_count)
+    {
+        auto const slots_count = std::bit_ceil(std::max<std::size_t>(max_objects_count + max_objects_count / 3, 1) + 1); // Keeps the load factor below 75%, and at least one slot free so that the probes always end
+        auto       size        = slots_offset() + slots_count * sizeof(Slot);
+
+        auto       is_creator = true;
+        auto const fd         = [&]() {
+            auto const new_fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (new_fd != -1 || errno != EEXIST)
+                return new_fd;
+            is_creator = false;
+            return shm_open(name.c_str(), O_RDWR, 0600);
+        }();
+        if (fd == -1)
+            throw std::runtime_error{"[SharedMemoryRegistry()] Couldn't open the shared memory segment " + name + ": " + std::strerror(errno)};
+
+        if (is_creator)
+        {
+            if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+            {
+                close(fd);
+                shm_unlink(name.c_str());
+                throw std::runtime_error{"[SharedMemoryRegistry()] Couldn't allocate the shared memory segment " + name};
+            }
+        }
+        else
+        {
+            // The creator might not have set the size of the segment yet
+            struct stat file_status{};
+            internal::spin_until([&]() { return fstat(fd, &file_status) != 0 || file_status.st_size != 0; });
+            size = static_cast<std::size_t>(file_status.st_size);
+        }
+
+        auto* const mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd); // The mapping keeps the segment alive
+        if (mapping == MAP_FAILED) // NOLINT(*-cstyle-cast, performance-no-int-to-ptr)
+            throw std::runtime_error{"[SharedMemoryRegistry()] Couldn't map the shared memory segment " + name};
+        _mapping_size = size;
+
+        if (is_creator)
+        {
+            _header                    = new (mapping) Header{}; // The header and the slots are created in-place, in the zero-filled segment
+            _header->layout_signature  = layout_signature;
+            _header->max_objects_count = max_objects_count;
+            _header->slots_count       = slots_count;
+            _slots                     = new (static_cast<std::byte*>(mapping) + slots_offset()) Slot[slots_count]{};
+            _header->state.store(Ready, std::memory_order_release);
+        }
+        else
+        {
+            _header = std::launder(static_cast<Header*>(mapping));
+            internal::spin_until([&]() { return _header->state.load(std::memory_order_acquire) == Ready; });
+            _slots = std::launder(reinterpret_cast<Slot*>(static_cast<std::byte*>(mapping) + slots_offset())); // NOLINT(*-reinterpret-cast)
+            if (_header->layout_signature != layout_signature || slots_offset() + _header->slots_count * sizeof(Slot) > _mapping_size)
+                throw std::runtime_error{"[SharedMemoryRegistry()] The shared memory segment " + name + " has been created for a different type of registry"};
+        }
+    }
+
+    [[nodiscard]] auto home_index(Id<T> const& id) const -> std::size_t
+    {
+        // We can't use std::hash because it is not guaranteed to give the same result in all the processes.
+        // The first bytes of a UUID are random, so they make a good hash.
+        auto hash = std::uint64_t{};
+        std::memcpy(&hash, id.underlying_uuid().as_bytes().data(), sizeof(hash));
+        return static_cast<std::size_t>(hash & (_header->slots_count - 1));
+    }
+
+    [[nodiscard]] auto next_index(std::size_t index) const -> std::size_t
+    {
+        return static_cast<std::size_t>((index + 1) & (_header->slots_count - 1));
+    }
+
+    /// Must be called while the mutex is locked.
+    [[nodiscard]] auto find(Id<T> const& id) const -> Slot*
+    {
+        for (auto index = home_index(id); _slots[index].is_occupied; index = next_index(index))
+        {
+            if (_slots[index].id == id)
+                return &_slots[index];
+        }
+        return nullptr;
+    }
+
+private:
+    Header*     _header{nullptr};
+    Slot*       _slots{nullptr};
+    std::size_t _mapping_size{0};
+};
+
+} // namespace reg
+
+#endif
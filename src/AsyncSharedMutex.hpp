@@ -0,0 +1,259 @@
+#pragma once
+#include <coroutine>
+#include <cstddef>
+#include <mutex>
+#include <semaphore>
+
+namespace reg {
+
+/// A reader-writer lock that coroutines can `co_await` instead of blocking their thread: `co_await mutex.async_lock()` and `co_await mutex.async_lock_shared()`.
+/// If the lock is not available, the coroutine is suspended and queued, and the thread that releases the lock resumes it once the lock is available, after the coroutines that were queued before it.
+/// It can also be used like a `std::shared_mutex` by regular threads, which get queued in the same way but block until the lock is handed over to them.
+/// The waiters are served in FIFO order, so that neither the readers nor the writers can get starved.
+/// A registry using this lock gets `async_with_ref()` and `async_with_mutable_ref()`.
+class AsyncSharedMutex {
+    /// Lives in the frame of the suspended coroutine (or on the stack of the blocked thread), so that queuing doesn't need any allocation.
+    struct Waiter {
+        Waiter*                 next{nullptr};
+        bool                    exclusive{false};
+        std::coroutine_handle<> continuation{};     // Set if the waiter is a coroutine...
+        std::binary_semaphore*  semaphore{nullptr}; // ... and this one if it is a blocked thread
+        AsyncSharedMutex*       mutex{nullptr};     // The mutex the waiter is waiting for, which a coroutine only acquires once it is about to be resumed
+    };
+
+public:
+    /// The result of `async_lock()` and `async_lock_shared()`. Once it has been `co_await`ed, the lock is held and you must release it with `unlock()` / `unlock_shared()`.
+    class Awaiter {
+    public:
+        [[nodiscard]] auto await_ready() -> bool { return _mutex->try_acquire(_waiter.exclusive); }
+
+        auto await_suspend(std::coroutine_handle<> continuation) -> bool
+        {
+            _waiter.continuation = continuation;
+            return !_mutex->acquire_or_enqueue(_waiter);
+        }
+
+        void await_resume() const noexcept {}
+
+    private:
+        friend AsyncSharedMutex;
+        Awaiter(AsyncSharedMutex& mutex, bool exclusive)
+            : _mutex{&mutex}
+            , _waiter{.exclusive = exclusive}
+        {}
+
+    private:
+        AsyncSharedMutex* _mutex;
+        Waiter            _waiter;
+    };
+
+    [[nodiscard]] auto async_lock() -> Awaiter { return Awaiter{*this, true}; }
+    [[nodiscard]] auto async_lock_shared() -> Awaiter { return Awaiter{*this, false}; }
+
+    void lock() { acquire_blocking(true); }
+    [[nodiscard]] auto try_lock() -> bool { return try_acquire(true); }
+    void unlock() { release(true); }
+
+    void lock_shared() { acquire_blocking(false); }
+    [[nodiscard]] auto try_lock_shared() -> bool { return try_acquire(false); }
+    void unlock_shared() { release(false); }
+
+private:
+    /// Must be called while `_state_mutex` is locked.
+    [[nodiscard]] auto is_available(bool exclusive) const -> bool
+    {
+        return !_has_writer && (!exclusive || _readers_count == 0);
+    }
+
+    /// Must be called while `_state_mutex` is locked.
+    [[nodiscard]] auto can_acquire(bool exclusive) const -> bool
+    {
+        return !_first_waiter && is_available(exclusive); // Nobody can jump the queue
+    }
+
+    /// Must be called while `_state_mutex` is locked.
+    void acquire(bool exclusive)
+    {
+        if (exclusive)
+            _has_writer = true;
+        else
+            ++_readers_count;
+    }
+
+    [[nodiscard]] auto try_acquire(bool exclusive) -> bool
+    {
+        std::lock_guard lock{_state_mutex};
+        if (!can_acquire(exclusive))
+            return false;
+        acquire(exclusive);
+        return true;
+    }
+
+    /// Returns true if the lock has been acquired, and false if `waiter` has been queued (it will be woken up once the lock has been handed over to it).
+    [[nodiscard]] auto acquire_or_enqueue(Waiter& waiter) -> bool
+    {
+        std::lock_guard lock{_state_mutex};
+        if (can_acquire(waiter.exclusive))
+        {
+            acquire(waiter.exclusive);
+            return true;
+        }
+        waiter.mutex = this;
+        waiter.next  = nullptr;
+        if (_last_waiter)
+            _last_waiter->next = &waiter;
+        else
+            _first_waiter = &waiter;
+        _last_waiter = &waiter;
+        return false;
+    }
+
+    void acquire_blocking(bool exclusive)
+    {
+        if (!wake_queue().is_empty())
+        {
+            // The coroutines that this thread still has to resume are at the front of the queue, but they don't own the lock yet, and they can't run before we return:
+            // we can't wait behind them, so we take the lock if it is available
+            std::lock_guard lock{_state_mutex};
+            if (is_available(exclusive))
+            {
+                acquire(exclusive);
+                return;
+            }
+        }
+
+        auto semaphore = std::binary_semaphore{0};
+        auto waiter    = Waiter{.exclusive = exclusive, .semaphore = &semaphore};
+        if (!acquire_or_enqueue(waiter))
+            semaphore.acquire();
+    }
+
+    void release(bool exclusive)
+    {
+        auto* waiters_to_wake = static_cast<Waiter*>(nullptr);
+        {
+            std::lock_guard lock{_state_mutex};
+            if (exclusive)
+                _has_writer = false;
+            else
+                --_readers_count;
+            waiters_to_wake = hand_over_to_waiters();
+        }
+        // Wake the waiters outside of the critical section, because resuming a coroutine can run arbitrary code (including code that uses this mutex)
+        wake(waiters_to_wake);
+    }
+
+    /// The coroutines that have been taken out of the queue of their mutex, and that the current thread still has to resume.
+    struct WakeQueue {
+        Waiter* first{nullptr};
+        Waiter* last{nullptr};
+        bool    is_draining{false};
+
+        [[nodiscard]] auto is_empty() const -> bool { return first == nullptr; }
+
+        void push(Waiter& waiter)
+        {
+            waiter.next = nullptr;
+            if (last)
+                last->next = &waiter;
+            else
+                first = &waiter;
+            last = &waiter;
+        }
+
+        [[nodiscard]] auto pop() -> Waiter&
+        {
+            auto& waiter = *first;
+            first        = waiter.next;
+            if (!first)
+                last = nullptr;
+            return waiter;
+        }
+    };
+
+    [[nodiscard]] static auto wake_queue() -> WakeQueue&
+    {
+        thread_local auto queue = WakeQueue{};
+        return queue;
+    }
+
+    /// The blocked threads already own the lock, and are woken up right away.
+    /// A resumed coroutine typically releases the lock, which wakes the next waiters: if we resumed them from there, the stack would grow with each coroutine of the queue.
+    /// Instead, the coroutines are queued, and only the outermost call resumes them, one after the other.
+    static void wake(Waiter* waiters)
+    {
+        auto& queue = wake_queue();
+        while (waiters)
+        {
+            auto* const next = waiters->next; // The waiter can be destroyed as soon as it has been woken up
+            if (waiters->continuation)
+                queue.push(*waiters);
+            else
+                waiters->semaphore->release();
+            waiters = next;
+        }
+        if (queue.is_draining)
+            return;
+
+        queue.is_draining = true;
+        while (!queue.is_empty())
+        {
+            auto& waiter = queue.pop();
+            if (waiter.mutex->acquire_for_resumption(waiter))
+                waiter.continuation.resume();
+        }
+        queue.is_draining = false;
+    }
+
+    /// A coroutine only gets the lock right before it is resumed, so that the coroutine that is currently running on this thread can still take the lock in the meantime (e.g. to call `registry.get()`),
+    /// instead of waiting for a coroutine that can't be resumed before it returns.
+    /// Returns false if the lock has been taken by someone else since `waiter` was taken out of the queue: it is then put back at the front of the queue.
+    [[nodiscard]] auto acquire_for_resumption(Waiter& waiter) -> bool
+    {
+        std::lock_guard lock{_state_mutex};
+        if (is_available(waiter.exclusive)) // The waiters that are still in the queue were queued after this one
+        {
+            acquire(waiter.exclusive);
+            return true;
+        }
+        waiter.next   = _first_waiter;
+        _first_waiter = &waiter;
+        if (!_last_waiter)
+            _last_waiter = &waiter;
+        return false;
+    }
+
+    /// Must be called while `_state_mutex` is locked.
+    /// Takes the first waiter out of the queue if it is a writer, or all the readers at the front of the queue, if the lock is available for them.
+    /// The blocked threads get the lock right away, and the coroutines get it when they are about to be resumed (see `acquire_for_resumption()`).
+    /// Returns the list of the waiters that must be woken up.
+    [[nodiscard]] auto hand_over_to_waiters() -> Waiter*
+    {
+        if (!_first_waiter || !is_available(_first_waiter->exclusive))
+            return nullptr;
+
+        auto* const first = _first_waiter;
+        auto*       last  = first;
+        while (!last->exclusive && last->next && !last->next->exclusive)
+            last = last->next;
+        for (auto* waiter = first; waiter != last->next; waiter = waiter->next)
+        {
+            if (!waiter->continuation)
+                acquire(waiter->exclusive);
+        }
+        _first_waiter = last->next;
+        if (!_first_waiter)
+            _last_waiter = nullptr;
+        last->next = nullptr;
+        return first;
+    }
+
+private:
+    std::mutex  _state_mutex;
+    bool        _has_writer{false};
+    std::size_t _readers_count{0};
+    Waiter*     _first_waiter{nullptr};
+    Waiter*     _last_waiter{nullptr};
+};
+
+} // namespace reg
@@ -0,0 +1,176 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include "Registry.hpp"
+#include "RegistryDiff.hpp"
+#include "internal/ContentHashes.hpp"
+
+namespace reg {
+
+namespace internal {
+
+/// Wraps a registry (`RegistryImpl`) and maintains a hash tree over its content (see `ContentHashes`), so that `diff()` can compare two registries in a time proportional to the number of differences
+/// instead of the size of the registries. It works for any two registries, e.g. one that has been loaded from a save file and one from an autosave, or your copy of a document and a collaborator's.
+/// The tree is updated whenever an object is created, modified through `set()` or `with_mutable_ref()`, or destroyed (including by a `UniqueId` or `SharedId` going out of scope),
+/// and is guarded by the same mutex as the registry.
+/// `Hash` must give the same hash for equal values in all the registries that you compare (e.g. `std::hash`, as long as all the registries live in programs built with the same standard library).
+/// It has the same interface as a registry, except for the functions that would allow you to modify an object without the tree knowing about it (`get_mutable_ref()` and non-const iteration).
+template<typename Registry, typename Hash>
+class HashedRegistryImpl {
+public:
+    /// The type of values stored in this registry.
+    using ValueType = typename Registry::ValueType;
+    /// The type of mutex used to guard this registry.
+    using LockType = typename Registry::LockType;
+
+private:
+    using T = ValueType;
+
+public:
+    HashedRegistryImpl()
+        : HashedRegistryImpl{Registry{}}
+    {}
+
+    /// Starts maintaining the hashes of an existing registry (e.g. one that you just loaded from a file).
+    /// This hashes all of its objects once, and then only the ones that change.
+    explicit HashedRegistryImpl(Registry registry)
+        : _registry{std::move(registry)}
+    {
+        std::unique_lock lock{_registry.mutex()};
+        for (auto const& [id, value] : std::as_const(_registry))
+            _hashes->insert(id, value);
+        _registry.underlying_wrapped_registry()->add_observer({
+            .on_insert = [hashes = _hashes](Id<T> const& id, T const& value) { hashes->insert(id, value); },
+            .on_erase  = [hashes = _hashes](Id<T> const& id, T const&) { hashes->erase(id); },
+            .on_change = [hashes = _hashes](Id<T> const& id, T const& value) { hashes->change(id, value); },
+        });
+    }
+    ~HashedRegistryImpl()                                                 = default;
+    HashedRegistryImpl(HashedRegistryImpl&&) noexcept                     = default;
+    auto operator=(HashedRegistryImpl&&) noexcept -> HashedRegistryImpl& = default;
+
+    HashedRegistryImpl(HashedRegistryImpl const&)                    = delete; // This class is non-copyable
+    auto operator=(HashedRegistryImpl const&) -> HashedRegistryImpl& = delete; // because it is the unique owner of the objects it stores
+
+    /// Thread-safe.
+    /// Returns a hash of the whole content of the registry. Two registries with the same content have the same hash (whatever the order in which their objects were created), so this is an O(1) equality check.
+    [[nodiscard]] auto content_hash() const -> std::uint64_t
+    {
+        std::shared_lock lock{mutex()};
+        return _hashes->root_hash();
+    }
+
+    /// Thread-safe.
+    /// Returns the value of the objet referenced by `id`, or null if the `id` doesn't refer to a an object in this registry.
+    [[nodiscard]] auto get(Id<T> const& id) const -> std::optional<T> { return _registry.get(id); }
+
+    /// Thread-safe.
+    /// Sets the value of the object referenced by `id` to `value`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto set(Id<T> const& id, T const& value) -> bool { return _registry.set(id, value); }
+    auto set(Id<T> const& id, T&& value) -> bool { return _registry.set(id, std::move(value)); }
+
+    /// Thread-safe.
+    /// Returns true iff `id` references an object in the registry.
+    [[nodiscard]] auto contains(Id<T> const& id) const -> bool { return _registry.contains(id); }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_ref(Id<T> const& id, std::function<void(T const&)> const& callback) const -> bool { return _registry.with_ref(id, callback); }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`, and then updates its hash.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool { return _registry.with_mutable_ref(id, callback); }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    /// Only use this if you need to avoid the copy that `get()` would perform and `with_ref()` doesn't fit your needs.
+    [[nodiscard]] auto get_ref(Id<T> const& id) const -> T const* { return _registry.get_ref(id); }
+
+    /// Thread-safe.
+    [[nodiscard]] auto create_unique(T const& value) -> UniqueId<T> { return _registry.create_unique(value); }
+    [[nodiscard]] auto create_unique(T&& value) -> UniqueId<T> { return _registry.create_unique(std::move(value)); }
+    [[nodiscard]] auto create_shared(T const& value) -> SharedId<T> { return _registry.create_shared(value); }
+    [[nodiscard]] auto create_shared(T&& value) -> SharedId<T> { return _registry.create_shared(std::move(value)); }
+    [[nodiscard]] auto create_raw(T const& value) -> Id<T> { return _registry.create_raw(value); }
+    [[nodiscard]] auto create_raw(T&& value) -> Id<T> { return _registry.create_raw(std::move(value)); }
+    template<typename... Args>
+    [[nodiscard]] auto emplace_unique(Args&&... args) -> UniqueId<T> { return _registry.emplace_unique(std::forward<Args>(args)...); }
+    template<typename... Args>
+    [[nodiscard]] auto emplace_shared(Args&&... args) -> SharedId<T> { return _registry.emplace_shared(std::forward<Args>(args)...); }
+    template<typename... Args>
+    [[nodiscard]] auto emplace_raw(Args&&... args) -> Id<T> { return _registry.emplace_raw(std::forward<Args>(args)...); }
+
+    /// Thread-safe.
+    /// Destroys the object and removes it from the registry and from the hashes.
+    void destroy(Id<T> const& id) { _registry.destroy(id); }
+
+    /// Thread-safe.
+    /// Returns true iff the registry contains no objects at all.
+    [[nodiscard]] auto is_empty() const -> bool { return _registry.is_empty(); }
+
+    /// Thread-safe.
+    /// Destroys all the objects in the registry.
+    void clear() { _registry.clear(); }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    [[nodiscard]] auto begin() const { return _registry.begin(); }
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    [[nodiscard]] auto end() const { return _registry.end(); }
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    [[nodiscard]] auto cbegin() const { return _registry.cbegin(); }
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    [[nodiscard]] auto cend() const { return _registry.cend(); }
+
+    /// Returns the mutex guarding this registry and its hashes, see `RegistryImpl::mutex()`.
+    [[nodiscard]] auto mutex() const -> auto& { return _registry.mutex(); }
+
+    /// Gives read-only access to the registry that is wrapped.
+    /// (Modifying it directly through `get_mutable_ref()` or its iterators would make the hashes out of date, which is why we don't give you a mutable access to it.)
+    [[nodiscard]] auto underlying_registry() const -> Registry const& { return _registry; }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    [[nodiscard]] auto underlying_hashes() const -> ContentHashes<T, Hash> const& { return *_hashes; }
+
+private:
+    // The hashes are shared with the observer that keeps them up to date, because the registry can outlive us (a `UniqueId` can keep it alive while it destroys its object).
+    std::shared_ptr<ContentHashes<T, Hash>> _hashes = std::make_shared<ContentHashes<T, Hash>>();
+    Registry                                _registry;
+};
+
+} // namespace internal
+
+template<typename T, typename Hash = std::hash<T>>
+using HashedRegistry = internal::HashedRegistryImpl<Registry<T>, Hash>;
+
+template<typename T, typename Hash = std::hash<T>>
+using HashedOrderedRegistry = internal::HashedRegistryImpl<OrderedRegistry<T>, Hash>;
+
+/// Thread-safe.
+/// Returns the differences between `before` and `after`, which can be any two hashed registries (e.g. two versions of the same document, loaded from different files).
+/// This only looks at the parts of the hash trees that differ, so it is proportional to the number of differences, not to the size of the registries.
+/// An object is listed as `modified` iff its value has a different hash in the two registries.
+/// Both registries are (shared-)locked together, in a deadlock-free way.
+template<typename RegistryBefore, typename RegistryAfter, typename Hash>
+[[nodiscard]] auto diff(internal::HashedRegistryImpl<RegistryBefore, Hash> const& before, internal::HashedRegistryImpl<RegistryAfter, Hash> const& after) -> RegistryDiff<typename RegistryBefore::ValueType>
+{
+    auto lock_before = std::shared_lock{before.mutex(), std::defer_lock};
+    auto lock_after  = std::shared_lock{after.mutex(), std::defer_lock};
+    if (static_cast<void const*>(&before) == static_cast<void const*>(&after))
+        lock_before.lock();
+    else
+        std::lock(lock_before, lock_after);
+
+    auto result = RegistryDiff<typename RegistryBefore::ValueType>{};
+    internal::ContentHashes<typename RegistryBefore::ValueType, Hash>::diff(before.underlying_hashes(), after.underlying_hashes(), result);
+    return result;
+}
+
+} // namespace reg
@@ -0,0 +1,168 @@
+#pragma once
+#include <memory>
+#include "internal/RawHierarchyRegistry.hpp"
+
+namespace reg {
+
+/// A registry whose objects form a hierarchy (e.g. the objects of a scene, or the layers of a document): each object has at most one parent, and an ordered list of children.
+/// The links are stored inside the registry, as indices into a dense vector of nodes, instead of as `Id`s inside your values: walking a subtree doesn't look up each id in a map,
+/// and the whole walk happens under a single lock. `for_each_in_subtree()`, `reparent()` and `destroy()` are all proportional to the size of the subtree (or of the list of siblings), not to the size of the registry.
+/// NB: this registry doesn't support `UniqueId`s and `SharedId`s, only raw `Id`s.
+template<typename T, typename Lock = std::shared_mutex>
+class HierarchyRegistry {
+public:
+    /// The type of values stored in this registry.
+    using ValueType = T;
+    /// The type of mutex used to guard this registry.
+    using LockType = Lock;
+
+    HierarchyRegistry()                                                = default;
+    ~HierarchyRegistry()                                               = default;
+    HierarchyRegistry(HierarchyRegistry&&) noexcept                    = default;
+    auto operator=(HierarchyRegistry&&) noexcept -> HierarchyRegistry& = default;
+
+    HierarchyRegistry(HierarchyRegistry const&)                    = delete; // This class is non-copyable
+    auto operator=(HierarchyRegistry const&) -> HierarchyRegistry& = delete; // because it is the unique owner of the objects it stores
+
+    /// Thread-safe.
+    /// Returns a copy of the object referenced by `id`, or null if the `id` doesn't refer to an object in this registry.
+    [[nodiscard]] auto get(Id<T> const& id) const -> std::optional<T>
+    {
+        return _wrapped->get(id);
+    }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_ref(Id<T> const& id, std::function<void(T const&)> const& callback) const -> bool
+    {
+        return _wrapped->with_ref(id, callback);
+    }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool
+    {
+        return _wrapped->with_mutable_ref(id, callback);
+    }
+
+    /// Thread-safe.
+    /// Sets the value of the object referenced by `id` to `value`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto set(Id<T> const& id, T value) -> bool
+    {
+        return _wrapped->set(id, std::move(value));
+    }
+
+    /// Thread-safe.
+    /// Returns true iff `id` references an object in the registry.
+    [[nodiscard]] auto contains(Id<T> const& id) const -> bool
+    {
+        return _wrapped->contains(id);
+    }
+
+    /// Thread-safe.
+    /// Inserts `value` into the registry, as the last child of `parent` (or as a root if `parent` is null).
+    /// Returns the id that will then be used to reference the object that has just been created.
+    /// Throws if `parent` doesn't refer to an object in this registry.
+    [[nodiscard]] auto create_raw(T value, std::optional<Id<T>> const& parent = std::nullopt) -> Id<T>
+    {
+        return _wrapped->create_raw(std::move(value), parent);
+    }
+
+    /// Thread-safe.
+    /// Returns the parent of the object referenced by `id`, or null if it is a root (or if the `id` doesn't refer to an object in this registry).
+    [[nodiscard]] auto parent_of(Id<T> const& id) const -> std::optional<Id<T>>
+    {
+        return _wrapped->parent_of(id);
+    }
+
+    /// Thread-safe.
+    /// Returns the children of the object referenced by `id`, in order.
+    [[nodiscard]] auto children_of(Id<T> const& id) const -> std::vector<Id<T>>
+    {
+        return _wrapped->children_of(id);
+    }
+
+    /// Thread-safe.
+    /// Returns all the objects that don't have a parent. This is O(n).
+    [[nodiscard]] auto roots() const -> std::vector<Id<T>>
+    {
+        return _wrapped->roots();
+    }
+
+    /// Thread-safe.
+    /// Moves the object referenced by `id`, along with its whole subtree, to the end of the children of `new_parent` (or makes it a root if `new_parent` is null).
+    /// Returns false iff one of the ids doesn't refer to an object in this registry, or if `new_parent` is in the subtree of `id` (which would create a cycle), and this function did nothing.
+    auto reparent(Id<T> const& id, std::optional<Id<T>> const& new_parent) -> bool
+    {
+        return _wrapped->reparent(id, new_parent);
+    }
+
+    /// Thread-safe.
+    /// Calls `callback(id, value, depth)` on the object referenced by `id` and on all its descendants, depth-first: each object before its children, and the children in order.
+    /// `depth` is 0 for the object referenced by `id`, 1 for its children, etc.
+    /// `value` is mutable, and the registry is locked exclusively during the whole walk: `callback` must not call other functions of this registry.
+    template<typename Callback>
+    void for_each_in_subtree(Id<T> const& id, Callback&& callback)
+    {
+        _wrapped->for_each_in_subtree(id, callback);
+    }
+
+    /// Thread-safe.
+    /// Calls `callback(id, value, depth)` on the object referenced by `id` and on all its descendants, depth-first: each object before its children, and the children in order.
+    /// `depth` is 0 for the object referenced by `id`, 1 for its children, etc.
+    /// The registry is (shared-)locked during the whole walk: `callback` must not modify it.
+    template<typename Callback>
+    void for_each_in_subtree(Id<T> const& id, Callback&& callback) const
+    {
+        std::as_const(*_wrapped).for_each_in_subtree(id, callback);
+    }
+
+    /// Thread-safe.
+    /// Destroys the object and its whole subtree, and removes them from the registry.
+    /// From then on, trying to get one of these objects using its id is still safe but will return null.
+    /// Returns the number of objects that have been destroyed.
+    auto destroy(Id<T> const& id) -> std::size_t
+    {
+        return _wrapped->destroy(id);
+    }
+
+    /// Thread-safe.
+    /// Returns true iff the registry contains no objects at all.
+    [[nodiscard]] auto is_empty() const -> bool
+    {
+        return _wrapped->is_empty();
+    }
+
+    /// Thread-safe.
+    /// Returns the number of objects in the registry.
+    [[nodiscard]] auto objects_count() const -> std::size_t
+    {
+        return _wrapped->objects_count();
+    }
+
+    /// Thread-safe.
+    /// Destroys all the objects in the registry.
+    void clear()
+    {
+        _wrapped->clear();
+    }
+
+    /// Returns the mutex guarding this registry, to allow you to lock it manually, e.g. to use `underlying_container()`.
+    [[nodiscard]] auto mutex() const -> Lock& { return _wrapped->mutex(); }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    /// The vector of nodes (id, value, index of the parent and indices of the children), in no particular order.
+    [[nodiscard]] auto underlying_container() const -> auto const& { return _wrapped->underlying_container(); }
+    [[nodiscard]] auto underlying_wrapped_registry() const -> auto const& { return _wrapped; }
+
+private:
+    std::shared_ptr<internal::RawHierarchyRegistry<T, Lock>> _wrapped = std::make_shared<internal::RawHierarchyRegistry<T, Lock>>();
+};
+
+} // namespace reg
@@ -4,7 +4,7 @@
 namespace reg {
 
 namespace internal {
-template<typename SomeType, typename Map>
+template<typename SomeType, typename Map, typename Lock>
 class RawRegistryImpl;
 }
 
@@ -24,7 +24,7 @@ public:
     [[nodiscard]] auto underlying_uuid() const -> uuids::uuid const& { return _uuid; }
 
 private:
-    template<typename SomeType, typename Map>
+    template<typename SomeType, typename Map, typename Lock>
     friend class internal::RawRegistryImpl;
     friend class AnyId;
     friend std::hash<Id<T>>;
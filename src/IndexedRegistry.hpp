@@ -0,0 +1,191 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <tuple>
+#include <type_traits>
+#include "Registry.hpp"
+#include "internal/SecondaryIndex.hpp"
+
+namespace reg {
+
+/// Describes an index of an `IndexedRegistry`.
+/// `KeyExtractor` computes the key of an object from its value: it can be a pointer to a data member (e.g. `&Person::name`), or any function or lambda taking a `T const&`.
+/// You should give a name to your indices by inheriting from one of these types, e.g. `struct ByName : reg::HashedUniqueIndex<&Person::name> {};`.
+template<auto KeyExtractor, bool IsUnique, bool IsOrdered>
+struct IndexDescription {
+    static constexpr auto key_extractor = KeyExtractor;
+    static constexpr bool is_unique     = IsUnique;
+    static constexpr bool is_ordered    = IsOrdered;
+};
+
+/// At most one object per key. Keys need to be hashable. O(1) lookups.
+template<auto KeyExtractor>
+struct HashedUniqueIndex : IndexDescription<KeyExtractor, true, false> {};
+/// Any number of objects per key. Keys need to be hashable. O(1) lookups.
+template<auto KeyExtractor>
+struct HashedMultiIndex : IndexDescription<KeyExtractor, false, false> {};
+/// At most one object per key. Keys need to be comparable with `<`. O(log n) lookups, and allows range queries.
+template<auto KeyExtractor>
+struct OrderedUniqueIndex : IndexDescription<KeyExtractor, true, true> {};
+/// Any number of objects per key. Keys need to be comparable with `<`. O(log n) lookups, and allows range queries.
+template<auto KeyExtractor>
+struct OrderedMultiIndex : IndexDescription<KeyExtractor, false, true> {};
+
+namespace internal {
+
+/// Wraps a registry (`RegistryImpl`) and maintains secondary indices over the values of its objects, so that you can find them by something else than their id.
+/// The indices are updated whenever an object is created, modified through `set()` or `with_mutable_ref()`, or destroyed (including by a `UniqueId` or `SharedId` going out of scope),
+/// and they are guarded by the same mutex as the registry, so a lookup always sees a consistent state.
+/// It has the same interface as a registry, except for the functions that would allow you to modify an object without the indices knowing about it (`get_mutable_ref()` and non-const iteration).
+template<typename Registry, typename... Indices>
+class IndexedRegistryImpl {
+public:
+    /// The type of values stored in this registry.
+    using ValueType = typename Registry::ValueType;
+    /// The type of mutex used to guard this registry.
+    using LockType = typename Registry::LockType;
+
+private:
+    using T = ValueType;
+
+    static constexpr bool has_unique_index = (Indices::is_unique || ...);
+    static_assert(!has_unique_index || std::is_copy_constructible_v<T>, "Unique indices need to copy the objects, so that they can restore them if a modification done through `with_mutable_ref()` creates a duplicate key.");
+
+public:
+    IndexedRegistryImpl()
+    {
+        _registry.underlying_wrapped_registry()->add_observer({
+            .on_insert = [indices = _indices](Id<T> const& id, T const& value) { std::apply([&](auto&... index) { (index.insert(id, value), ...); }, *indices); },
+            .on_erase  = [indices = _indices](Id<T> const& id, T const&) { std::apply([&](auto&... index) { (index.erase(id), ...); }, *indices); },
+            .on_change = [indices = _indices](Id<T> const& id, T const& value) { std::apply([&](auto&... index) { (index.change(id, value), ...); }, *indices); },
+            .validate  = has_unique_index
+                             ? [indices = _indices](Id<T> const& id, T const& value) { std::apply([&](auto const&... index) { (index.validate(id, value), ...); }, *indices); }
+                             : std::function<void(Id<T> const&, T const&)>{},
+        });
+    }
+    ~IndexedRegistryImpl()                                                  = default;
+    IndexedRegistryImpl(IndexedRegistryImpl&&) noexcept                     = default;
+    auto operator=(IndexedRegistryImpl&&) noexcept -> IndexedRegistryImpl& = default;
+
+    IndexedRegistryImpl(IndexedRegistryImpl const&)                    = delete; // This class is non-copyable
+    auto operator=(IndexedRegistryImpl const&) -> IndexedRegistryImpl& = delete; // because it is the unique owner of the objects it stores
+
+    /// Thread-safe.
+    /// If `Index` is a unique index, returns the id of the object whose key is `key`, or null if there is none.
+    /// Otherwise, returns the ids of all the objects whose key is `key`.
+    template<typename Index>
+    [[nodiscard]] auto find_by(typename SecondaryIndex<T, Index>::Key const& key) const
+    {
+        std::shared_lock lock{mutex()};
+        return index<Index>().find(key);
+    }
+
+    /// Thread-safe.
+    /// Returns the ids of all the objects whose key is in the range [`first`, `last`], sorted by key.
+    /// `Index` must be an ordered index.
+    template<typename Index>
+    [[nodiscard]] auto find_range_by(typename SecondaryIndex<T, Index>::Key const& first, typename SecondaryIndex<T, Index>::Key const& last) const -> std::vector<Id<T>>
+    {
+        std::shared_lock lock{mutex()};
+        return index<Index>().find_range(first, last);
+    }
+
+    /// Thread-safe.
+    /// Returns the value of the objet referenced by `id`, or null if the `id` doesn't refer to a an object in this registry.
+    [[nodiscard]] auto get(Id<T> const& id) const -> std::optional<T> { return _registry.get(id); }
+
+    /// Thread-safe.
+    /// Sets the value of the object referenced by `id` to `value`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    /// Throws `std::invalid_argument` (and leaves the object unchanged) if `value` has the same key as another object in a unique index.
+    auto set(Id<T> const& id, T const& value) -> bool { return _registry.set(id, value); }
+    auto set(Id<T> const& id, T&& value) -> bool { return _registry.set(id, std::move(value)); }
+
+    /// Thread-safe.
+    /// Returns true iff `id` references an object in the registry.
+    [[nodiscard]] auto contains(Id<T> const& id) const -> bool { return _registry.contains(id); }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_ref(Id<T> const& id, std::function<void(T const&)> const& callback) const -> bool { return _registry.with_ref(id, callback); }
+
+    /// Thread-safe.
+    /// Applies `callback` to the object referenced by `id`, and then updates the indices.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    /// Throws `std::invalid_argument` (and restores the previous value of the object) if `callback` gave it the same key as another object in a unique index.
+    auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool { return _registry.with_mutable_ref(id, callback); }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    /// Only use this if you need to avoid the copy that `get()` would perform and `with_ref()` doesn't fit your needs.
+    [[nodiscard]] auto get_ref(Id<T> const& id) const -> T const* { return _registry.get_ref(id); }
+
+    /// Thread-safe.
+    /// All the creation functions throw `std::invalid_argument` (and don't create anything) if the new object has the same key as another object in a unique index.
+    [[nodiscard]] auto create_unique(T const& value) -> UniqueId<T> { return _registry.create_unique(value); }
+    [[nodiscard]] auto create_unique(T&& value) -> UniqueId<T> { return _registry.create_unique(std::move(value)); }
+    [[nodiscard]] auto create_shared(T const& value) -> SharedId<T> { return _registry.create_shared(value); }
+    [[nodiscard]] auto create_shared(T&& value) -> SharedId<T> { return _registry.create_shared(std::move(value)); }
+    [[nodiscard]] auto create_raw(T const& value) -> Id<T> { return _registry.create_raw(value); }
+    [[nodiscard]] auto create_raw(T&& value) -> Id<T> { return _registry.create_raw(std::move(value)); }
+    template<typename... Args>
+    [[nodiscard]] auto emplace_unique(Args&&... args) -> UniqueId<T> { return _registry.emplace_unique(std::forward<Args>(args)...); }
+    template<typename... Args>
+    [[nodiscard]] auto emplace_shared(Args&&... args) -> SharedId<T> { return _registry.emplace_shared(std::forward<Args>(args)...); }
+    template<typename... Args>
+    [[nodiscard]] auto emplace_raw(Args&&... args) -> Id<T> { return _registry.emplace_raw(std::forward<Args>(args)...); }
+
+    /// Thread-safe.
+    /// Destroys the object and removes it from the registry and from the indices.
+    void destroy(Id<T> const& id) { _registry.destroy(id); }
+
+    /// Thread-safe.
+    /// Returns true iff the registry contains no objects at all.
+    [[nodiscard]] auto is_empty() const -> bool { return _registry.is_empty(); }
+
+    /// Thread-safe.
+    /// Destroys all the objects in the registry.
+    void clear() { _registry.clear(); }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    [[nodiscard]] auto begin() const { return _registry.begin(); }
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    [[nodiscard]] auto end() const { return _registry.end(); }
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    [[nodiscard]] auto cbegin() const { return _registry.cbegin(); }
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    [[nodiscard]] auto cend() const { return _registry.cend(); }
+
+    /// Returns the mutex guarding this registry and its indices, see `RegistryImpl::mutex()`.
+    [[nodiscard]] auto mutex() const -> auto& { return _registry.mutex(); }
+
+    /// Gives read-only access to the registry that is wrapped.
+    /// (Modifying it directly through `get_mutable_ref()` or its iterators would make the indices out of date, which is why we don't give you a mutable access to it.)
+    [[nodiscard]] auto underlying_registry() const -> Registry const& { return _registry; }
+
+private:
+    template<typename Index>
+    [[nodiscard]] auto index() const -> SecondaryIndex<T, Index> const&
+    {
+        return std::get<SecondaryIndex<T, Index>>(*_indices);
+    }
+
+private:
+    // The indices are shared with the observer that keeps them up to date, because the registry can outlive us (a `UniqueId` can keep it alive while it destroys its object).
+    std::shared_ptr<std::tuple<SecondaryIndex<T, Indices>...>> _indices = std::make_shared<std::tuple<SecondaryIndex<T, Indices>...>>();
+    Registry                                                   _registry{};
+};
+
+} // namespace internal
+
+template<typename T, typename... Indices>
+using IndexedRegistry = internal::IndexedRegistryImpl<Registry<T>, Indices...>;
+
+template<typename T, typename... Indices>
+using IndexedOrderedRegistry = internal::IndexedRegistryImpl<OrderedRegistry<T>, Indices...>;
+
+} // namespace reg
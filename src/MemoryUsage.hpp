@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+
+namespace reg {
+
+/// An estimation of the memory used by a registry, in bytes, see `registry.memory_usage()`.
+/// It only counts the memory used by the registry itself: if your objects allocate some memory (e.g. a `std::string` or a `std::vector`), it is not included.
+struct MemoryUsage {
+    /// The ids of the objects.
+    std::size_t keys{0};
+    /// The objects themselves (`sizeof(T)` for each of them).
+    std::size_t values{0};
+    /// Everything that the storage needs in addition to the keys and the values: buckets and nodes of a hash map, unused capacity of a vector, nodes of a trie, etc.
+    std::size_t overhead{0};
+    /// The control blocks allocated by the `UniqueId`s and `SharedId`s that currently refer to objects in the registry.
+    std::size_t owning_ids{0};
+
+    [[nodiscard]] auto total() const -> std::size_t { return keys + values + overhead + owning_ids; }
+
+    auto operator+=(MemoryUsage const& other) -> MemoryUsage&
+    {
+        keys += other.keys;
+        values += other.values;
+        overhead += other.overhead;
+        owning_ids += other.owning_ids;
+        return *this;
+    }
+
+    friend auto operator==(MemoryUsage const&, MemoryUsage const&) -> bool = default;
+};
+
+} // namespace reg
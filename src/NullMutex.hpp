@@ -0,0 +1,18 @@
+#pragma once
+
+namespace reg {
+
+/// A mutex that doesn't do anything.
+/// Use it as the `Lock` of a registry that is only ever accessed by one thread, to avoid paying for any locking.
+class NullMutex {
+public:
+    void lock() {}
+    [[nodiscard]] auto try_lock() -> bool { return true; }
+    void unlock() {}
+
+    void lock_shared() {}
+    [[nodiscard]] auto try_lock_shared() -> bool { return true; }
+    void unlock_shared() {}
+};
+
+} // namespace reg
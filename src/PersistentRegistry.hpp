@@ -0,0 +1,32 @@
+#pragma once
+#include <shared_mutex>
+#include <vector>
+#include "RegistryDiff.hpp"
+#include "internal/PersistentMap.hpp"
+#include "internal/RegistryImpl.hpp"
+
+namespace reg {
+
+/// A registry whose storage is a persistent map (a hash array mapped trie): `snapshot()` and `restore()` are O(1),
+/// modifications are O(log32(n)) and always keep the storage shared with the snapshots as much as possible (instead of copying it all the first time the registry is modified after a snapshot),
+/// and you can efficiently compute the `diff()` between two snapshots.
+/// This makes it a great fit to implement undo / redo.
+/// NB: iterating over the registry only gives you read-only access to the objects, use `set()` or `with_mutable_ref()` to modify them.
+template<typename T, typename Lock = std::shared_mutex>
+using PersistentRegistry = internal::RegistryImpl<T, internal::PersistentMap<Id<T>, T>, Lock>;
+
+/// Thread-safe.
+/// Returns the differences between `before` and `after`, which are typically two snapshots of the same registry.
+/// This is proportional to the number of differences (times log32(n)), not to the size of the registries, because the parts of the storage that they still share are skipped entirely.
+template<typename T, typename Lock>
+[[nodiscard]] auto diff(PersistentRegistry<T, Lock> const& before, PersistentRegistry<T, Lock> const& after) -> RegistryDiff<T>
+{
+    auto const storage_before = before.snapshot(); // The snapshots allow us to compare the registries without keeping them locked
+    auto const storage_after  = after.snapshot();
+
+    auto result = RegistryDiff<T>{};
+    internal::PersistentMap<Id<T>, T>::diff(storage_before.underlying_container(), storage_after.underlying_container(), result.added, result.removed, result.modified);
+    return result;
+}
+
+} // namespace reg
@@ -1,4 +1,5 @@
 #pragma once
+#include <shared_mutex>
 #include <unordered_map>
 #include "internal/OrderPreservingMap.hpp"
 #include "internal/RawRegistryImpl.hpp"
@@ -8,10 +9,10 @@ namespace reg {
 /// A `RawRegistry` has all the interface of a Registry
 /// except it doesn't have `create_unique()` and `create_shared()`.
 
-template<typename T>
-using RawRegistry = internal::RawRegistryImpl<T, std::unordered_map<Id<T>, T>>;
+template<typename T, typename Lock = std::shared_mutex>
+using RawRegistry = internal::RawRegistryImpl<T, std::unordered_map<Id<T>, T>, Lock>;
 
-template<typename T>
-using RawOrderedRegistry = internal::RawRegistryImpl<T, internal::OrderPreservingMap<Id<T>, T>>;
+template<typename T, typename Lock = std::shared_mutex>
+using RawOrderedRegistry = internal::RawRegistryImpl<T, internal::OrderPreservingMap<Id<T>, T>, Lock>;
 
 } // namespace reg
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include "internal/cpu_relax.hpp"
+#include "internal/current_cpu_slot.hpp"
+
+namespace reg {
+
+/// A reader-writer lock optimized for registries that are read very often by many threads, and rarely modified.
+/// Instead of having all the readers increment the same counter (which makes the corresponding cache line bounce between all the CPUs),
+/// each CPU increments its own counter, from a small array of counters that each live in their own cache line.
+/// A reader that gets moved to another CPU while it holds the lock decrements the counter of its new CPU: a single counter can therefore be "negative", and writers only look at the sum of all the counters.
+/// On platforms where we can't know the current CPU (i.e. everywhere but Linux), each thread gets its own counter instead, shared with other threads once there are more threads than counters.
+/// The downside is that writers are more expensive, because they have to sum all the counters, and that this mutex is bigger: 64 counters of one cache line each, i.e. 4 KiB per mutex.
+class ReaderBiasedSharedMutex {
+public:
+    void lock()
+    {
+        _writers_mutex.lock();
+        _writer_is_active.store(true, std::memory_order_seq_cst);
+        internal::spin_until([&]() { return readers_count() == 0; });
+    }
+
+    [[nodiscard]] auto try_lock() -> bool
+    {
+        if (!_writers_mutex.try_lock())
+            return false;
+        _writer_is_active.store(true, std::memory_order_seq_cst);
+        if (readers_count() != 0)
+        {
+            unlock();
+            return false;
+        }
+        return true;
+    }
+
+    void unlock()
+    {
+        _writer_is_active.store(false, std::memory_order_release);
+        _writers_mutex.unlock();
+    }
+
+    void lock_shared()
+    {
+        internal::spin_until([&]() { return try_lock_shared(); });
+    }
+
+    [[nodiscard]] auto try_lock_shared() -> bool
+    {
+        auto& counter = readers_count_of_current_cpu();
+        counter.fetch_add(1, std::memory_order_seq_cst);
+        if (!_writer_is_active.load(std::memory_order_seq_cst))
+            return true;
+        counter.fetch_sub(1, std::memory_order_release); // A writer is active (or about to be): back off and let it proceed. We use the same counter, so that it stays balanced even if we have been moved to another CPU
+        return false;
+    }
+
+    void unlock_shared()
+    {
+        readers_count_of_current_cpu().fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    static constexpr std::size_t counters_count = 64;
+
+    auto readers_count_of_current_cpu() -> std::atomic<std::uint32_t>&
+    {
+        return _readers_counts[internal::current_cpu_slot(counters_count)].value;
+    }
+
+    /// The number of threads that currently hold a shared lock (or are trying to get one).
+    /// Once `_writer_is_active` is set, no new reader can get the lock: the increments of all the current readers are visible, and the sum can only be too big (if we miss a decrement), never too small.
+    /// The counters wrap around, but their sum is still correct modulo 2^32.
+    [[nodiscard]] auto readers_count() const -> std::uint32_t
+    {
+        auto sum = std::uint32_t{0};
+        for (auto const& counter : _readers_counts)
+            sum += counter.value.load(std::memory_order_seq_cst);
+        return sum;
+    }
+
+    struct alignas(64) Counter { // Each counter lives in its own cache line
+        std::atomic<std::uint32_t> value{0};
+    };
+
+    std::array<Counter, counters_count> _readers_counts{};
+    std::atomic<bool>                   _writer_is_active{false};
+    std::mutex                          _writers_mutex;
+};
+
+} // namespace reg
@@ -0,0 +1,37 @@
+#pragma once
+#include <type_traits>
+#include "AnyId.hpp"
+
+namespace reg {
+
+namespace internal {
+struct NoReferences {};
+} // namespace internal
+
+/// Tells `Registries::enable_reference_index()` which objects an object of type `T` references.
+/// By default, objects don't reference anything. If your type stores ids of other objects, specialize this trait with a static `for_each` function that calls `callback` on each of them:
+/// ```cpp
+/// template<>
+/// struct reg::References<Car> {
+///     template<typename Callback>
+///     static void for_each(Car const& car, Callback&& callback)
+///     {
+///         callback(car.engine); // Any `Id<T>` (or `AnyId`)
+///         for (auto const& wheel : car.wheels)
+///             callback(wheel);
+///     }
+/// };
+/// ```
+template<typename T>
+struct References : internal::NoReferences {
+    template<typename Callback>
+    static void for_each(T const&, Callback&&)
+    {
+    }
+};
+
+/// True iff `References<T>` has been specialized, i.e. objects of type `T` can reference other objects.
+template<typename T>
+concept HasReferences = !std::is_base_of_v<internal::NoReferences, References<T>>;
+
+} // namespace reg
@@ -1,14 +1,26 @@
 #pragma once
+#include <array>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <tuple>
+#include <type_traits>
+#include <utility>
+#include "AnyId.hpp"
+#include "References.hpp"
 #include "Registry.hpp"
+#include "internal/IdDirectory.hpp"
+#include "internal/ReferenceIndex.hpp"
 
 namespace reg {
 
 /// Thanks to https://ngathanasiou.wordpress.com/2020/07/09/avoiding-compile-time-recursion/
 namespace internal {
 
+/// Registries are identified by the type of values they store.
 template<class T, std::size_t I, class Tuple>
-constexpr bool match_v = std::is_same_v<T, std::tuple_element_t<I, Tuple>>;
+constexpr bool match_v = std::is_same_v<T, typename std::tuple_element_t<I, Tuple>::ValueType>;
 
 template<class T, class Tuple, class Idxs = std::make_index_sequence<std::tuple_size_v<Tuple>>>
 struct type_index;
@@ -28,16 +40,20 @@ constexpr std::size_t type_index_v = type_index<T, Tuple>::value;
 template<typename... Ts>
 class Registries {
 public:
+    Registries() = default;
+
+    /// Returns the registry storing values of type `T`.
     template<typename T>
-    auto of() -> Registry<T>&
+    auto of() -> auto&
     {
-        return std::get<internal::type_index_v<reg::Registry<T>, Tuple>>(_registries);
+        return std::get<internal::type_index_v<T, Tuple>>(_registries);
     }
 
+    /// Returns the registry storing values of type `T`.
     template<typename T>
-    auto of() const -> Registry<T> const&
+    auto of() const -> auto const&
     {
-        return std::get<internal::type_index_v<reg::Registry<T>, Tuple>>(_registries);
+        return std::get<internal::type_index_v<T, Tuple>>(_registries);
     }
 
     /// Thread-safe.
@@ -58,6 +74,17 @@ public:
         return of<T>().set(id, value);
     }
 
+    /// Thread-safe.
+    /// Sets the value of the object referenced by `id` to `value`, by moving `value` into it.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    template<typename T>
+        requires(!std::is_reference_v<T>)
+    auto set(Id<T> const& id, T&& value) -> bool
+    {
+        return of<T>().set(id, std::move(value));
+    }
+
     /// Thread-safe.
     /// Applies `callback` to the object referenced by `id`.
     /// Does nothing if the `id` doesn't refer to an object in this registry.
@@ -78,6 +105,39 @@ public:
         return of<T>().with_mutable_ref(id, callback);
     }
 
+    /// Thread-safe.
+    /// Looks `id` up once and returns a `ResolvedId` that caches the location of its object, see `RegistryImpl::resolve()`.
+    /// You can then pass it to `get()`, `with_ref()` and `with_mutable_ref()` (or to any function of `of<T>()` that accepts an `Id<T>`).
+    template<typename T>
+    [[nodiscard]] auto resolve(Id<T> const& id) const -> ResolvedId<T>
+    {
+        return of<T>().resolve(id);
+    }
+
+    /// Thread-safe (as long as each thread uses its own `ResolvedId`).
+    /// Same as `get(Id<T>)`, but uses (and refreshes if needed) the location cached in `id`.
+    template<typename T>
+    [[nodiscard]] auto get(ResolvedId<T>& id) const -> std::optional<T>
+    {
+        return of<T>().get(id);
+    }
+
+    /// Thread-safe (as long as each thread uses its own `ResolvedId`).
+    /// Same as `with_ref(Id<T>, callback)`, but uses (and refreshes if needed) the location cached in `id`.
+    template<typename T>
+    auto with_ref(ResolvedId<T>& id, std::function<void(std::type_identity_t<T> const&)> const& callback) const -> bool
+    {
+        return of<T>().with_ref(id, callback);
+    }
+
+    /// Thread-safe (as long as each thread uses its own `ResolvedId`).
+    /// Same as `with_mutable_ref(Id<T>, callback)`, but uses (and refreshes if needed) the location cached in `id`.
+    template<typename T>
+    auto with_mutable_ref(ResolvedId<T>& id, std::function<void(std::type_identity_t<T>&)> const& callback) -> bool
+    {
+        return of<T>().with_mutable_ref(id, callback);
+    }
+
     /// Thread-safe.
     /// Inserts a copy of `value` into the registry.
     /// Returns the id that will then be used to reference the object that has just been created.
@@ -87,6 +147,25 @@ public:
         return of<T>().create_unique(value);
     }
 
+    /// Thread-safe.
+    /// Moves `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    template<typename T>
+        requires(!std::is_reference_v<T>)
+    [[nodiscard]] auto create_unique(T&& value) -> UniqueId<T>
+    {
+        return of<T>().create_unique(std::move(value));
+    }
+
+    /// Thread-safe.
+    /// Constructs a new object in-place in the registry, by forwarding `args` to the constructor of `T`.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    template<typename T, typename... Args>
+    [[nodiscard]] auto emplace_unique(Args&&... args) -> UniqueId<T>
+    {
+        return of<T>().emplace_unique(std::forward<Args>(args)...);
+    }
+
     /// Thread-safe.
     /// Inserts a copy of `value` into the registry.
     /// Returns the id that will then be used to reference the object that has just been created.
@@ -96,13 +175,51 @@ public:
         return of<T>().create_shared(value);
     }
 
+    /// Thread-safe.
+    /// Moves `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    template<typename T>
+        requires(!std::is_reference_v<T>)
+    [[nodiscard]] auto create_shared(T&& value) -> SharedId<T>
+    {
+        return of<T>().create_shared(std::move(value));
+    }
+
+    /// Thread-safe.
+    /// Constructs a new object in-place in the registry, by forwarding `args` to the constructor of `T`.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    template<typename T, typename... Args>
+    [[nodiscard]] auto emplace_shared(Args&&... args) -> SharedId<T>
+    {
+        return of<T>().emplace_shared(std::forward<Args>(args)...);
+    }
+
     /// Thread-safe.
     /// Inserts a copy of `value` into the registry.
     /// Returns the id that will then be used to reference the object that has just been created.
     template<typename T>
     [[nodiscard]] auto create_raw(T const& value) -> Id<T>
     {
-        return of<T>().create(value);
+        return of<T>().create_raw(value);
+    }
+
+    /// Thread-safe.
+    /// Moves `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    template<typename T>
+        requires(!std::is_reference_v<T>)
+    [[nodiscard]] auto create_raw(T&& value) -> Id<T>
+    {
+        return of<T>().create_raw(std::move(value));
+    }
+
+    /// Thread-safe.
+    /// Constructs a new object in-place in the registry, by forwarding `args` to the constructor of `T`.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    template<typename T, typename... Args>
+    [[nodiscard]] auto emplace_raw(Args&&... args) -> Id<T>
+    {
+        return of<T>().emplace_raw(std::forward<Args>(args)...);
     }
 
     /// Thread-safe.
@@ -130,23 +247,286 @@ public:
         of<T>().clear();
     }
 
+    /// Thread-safe.
+    /// Returns an estimation of the memory used by the registry of `T`s, see `RegistryImpl::memory_usage()`.
+    template<typename T>
+    [[nodiscard]] auto memory_usage() const -> MemoryUsage
+    {
+        return of<T>().memory_usage();
+    }
+
+    /// Thread-safe.
+    /// Returns an estimation of the memory used by each registry, in the same order as the types you gave to `Registries`.
+    /// You can sum them to get the total memory usage.
+    [[nodiscard]] auto memory_usage() const -> std::array<MemoryUsage, sizeof...(Ts)>
+    {
+        return std::apply([](auto const&... registries) { return std::array<MemoryUsage, sizeof...(Ts)>{registries.memory_usage()...}; }, _registries);
+    }
+
     /// Returns the mutex guarding this registry to allow you to lock it manually.
     /// This is only required when using functions that are not already thread-safe: get_ref(), get_mutable_ref(), begin(), end(), cbegin() and cend() (and therefore also using a range-based for loop on this registry).
     /// You should use a std::unique_lock if you want to modify some values, and std::shared_lock if you only need to read them.
     /// See https://stackoverflow.com/a/46050121/15432269 for more details about shared mutexes.
     template<typename T>
-    [[nodiscard]] auto mutex() const -> std::shared_mutex&
+    [[nodiscard]] auto mutex() const -> auto&
     {
         return of<T>().mutex();
     }
 
+    /// Starts maintaining a directory that remembers which registry each id belongs to.
+    /// This makes `visit()` and `contains(AnyId)` find the right registry in a single lookup, instead of querying each registry one after the other.
+    /// The directory is kept up-to-date whenever an object is created or destroyed, even through a `UniqueId` / `SharedId`, at the cost of one extra hash map insertion / deletion.
+    /// NOT Thread-safe: you should call this right after creating the `Registries`, before sharing them with other threads.
+    void enable_id_directory()
+    {
+        if (_id_directory)
+            return;
+        rebuild_id_directory();
+    }
+
+    /// (Re)creates the directory from the current content of the registries.
+    /// You only need to call this if you replaced some of the underlying registries, which is what happens when loading them with ser20 (our ser20 functions already call this for you).
+    /// The observers that kept the previous directory up-to-date are removed.
+    /// NOT Thread-safe.
+    void rebuild_id_directory()
+    {
+        auto const previous_directory = std::exchange(_id_directory, std::make_shared<internal::IdDirectory>());
+        enable_id_directory_impl(previous_directory.get(), std::index_sequence_for<Ts...>{});
+    }
+
+    [[nodiscard]] auto has_id_directory() const -> bool { return _id_directory != nullptr; }
+
+    /// Starts maintaining an index of which objects reference which other objects, as declared by `reg::References<T>`, so that `dependents_of()` doesn't have to scan all the registries.
+    /// The index is kept up-to-date whenever an object is created, modified (through `set()` or `with_mutable_ref()`) or destroyed, even through a `UniqueId` / `SharedId`.
+    /// Only the registries of types that specialize `reg::References` pay for it.
+    /// NB: modifications done through `get_mutable_ref()` and the iterators can't be observed, call `rebuild_reference_index()` after using them.
+    /// NOT Thread-safe: you should call this right after creating the `Registries`, before sharing them with other threads.
+    void enable_reference_index()
+    {
+        if (_reference_index)
+            return;
+        rebuild_reference_index();
+    }
+
+    /// (Re)creates the reference index from the current content of the registries.
+    /// You only need to call this if you replaced some of the underlying registries, which is what happens when loading them with ser20 (our ser20 functions already call this for you).
+    /// The observers that kept the previous index up-to-date are removed.
+    /// NOT Thread-safe.
+    void rebuild_reference_index()
+    {
+        auto const previous_index = std::exchange(_reference_index, std::make_shared<internal::ReferenceIndex>());
+        enable_reference_index_impl(previous_index.get(), std::index_sequence_for<Ts...>{});
+    }
+
+    [[nodiscard]] auto has_reference_index() const -> bool { return _reference_index != nullptr; }
+
+    /// Thread-safe.
+    /// Returns the ids of all the objects that reference `id` (as declared by `reg::References<T>`), in no particular order. This also works after the object referenced by `id` has been destroyed,
+    /// which allows you to find the objects that still hold a dangling id to it.
+    /// This is proportional to the number of dependents if `enable_reference_index()` has been called, and scans all the objects of all the registries otherwise.
+    [[nodiscard]] auto dependents_of(AnyId const& id) const -> std::vector<AnyId>
+    {
+        if (_reference_index)
+            return _reference_index->dependents_of(id.underlying_uuid());
+
+        auto dependents = std::vector<AnyId>{};
+        std::apply([&](auto const&... registries) { (collect_dependents(registries, id, dependents), ...); }, _registries);
+        return dependents;
+    }
+
+    /// Thread-safe.
+    /// Returns true iff `id` references an object in one of the registries.
+    [[nodiscard]] auto contains(AnyId const& id) const -> bool
+    {
+        return visit(id, [](auto const&, auto const&) {});
+    }
+
+    /// Thread-safe.
+    /// Finds the registry containing the object referenced by `id`, and calls `callback(Id<T> const&, T const&)` with that object (while its registry is locked).
+    /// Does nothing if the `id` doesn't refer to an object in any of the registries.
+    /// Returns false iff the object was not found and this function did nothing.
+    template<typename Callback>
+    auto visit(AnyId const& id, Callback&& callback) const -> bool
+    {
+        return visit_impl(*this, id, callback, std::index_sequence_for<Ts...>{});
+    }
+
+    /// Thread-safe.
+    /// Finds the registry containing the object referenced by `id`, and calls `callback(Id<T> const&, T&)` with that object (while its registry is locked).
+    /// The modification is observed (e.g. by the reference index) just like one done with `with_mutable_ref()`.
+    /// Does nothing if the `id` doesn't refer to an object in any of the registries.
+    /// Returns false iff the object was not found and this function did nothing.
+    template<typename Callback>
+    auto visit_mutable(AnyId const& id, Callback&& callback) -> bool
+    {
+        return visit_impl(*this, id, callback, std::index_sequence_for<Ts...>{});
+    }
+
+    /// Thread-safe.
+    /// Returns new registries that start with the current content of these ones.
+    /// The snapshot is consistent across all the registries: they are all locked at the same time while we take it.
+    /// This is O(number of registries): the storage of each registry is shared with the snapshot and only gets copied once it is modified.
+    [[nodiscard]] auto snapshot() const -> Registries
+    {
+        return snapshot_impl(std::index_sequence_for<Ts...>{});
+    }
+
+    /// Thread-safe.
+    /// Takes a `snapshot()` of the registries and calls `save(snapshot)` on a background thread, where you can encode and write it to a file.
+    /// You can keep using (and modifying) the registries while this is happening.
+    /// Returns a future that will contain the result of `save` (or the exception it has thrown).
+    /// NB: like any future returned by `std::async`, its destructor waits for `save` to complete, so make sure you store it somewhere.
+    template<typename SaveCallback>
+    [[nodiscard]] auto async_checkpoint(SaveCallback save) const -> std::future<std::invoke_result_t<SaveCallback&, Registries&>>
+    {
+        return std::async(std::launch::async, [snapshot = snapshot(), save = std::move(save)]() mutable {
+            return save(snapshot);
+        });
+    }
+
     using Tuple = std::tuple<Ts...>;
 
     [[nodiscard]] auto underlying_registries() const -> Tuple const& { return _registries; }
     [[nodiscard]] auto underlying_registries() -> Tuple& { return _registries; }
 
 private:
-    Tuple _registries{};
+    explicit Registries(Tuple registries)
+        : _registries{std::move(registries)}
+    {}
+
+    template<std::size_t... Is>
+    auto snapshot_impl(std::index_sequence<Is...>) const -> Registries
+    {
+        auto locks = std::tuple{std::shared_lock{std::get<Is>(_registries).mutex(), std::defer_lock}...};
+        if constexpr (sizeof...(Ts) > 1)
+            std::apply([](auto&... lock) { std::lock(lock...); }, locks); // Avoids deadlocks with anybody else that would be locking several registries at once
+        else
+            std::apply([](auto&... lock) { (lock.lock(), ...); }, locks);
+
+        return Registries{Tuple{
+            std::tuple_element_t<Is, Tuple>::internal_from_snapshot(std::get<Is>(_registries).underlying_wrapped_registry()->snapshot())...
+        }};
+    }
+
+    template<std::size_t... Is>
+    void enable_id_directory_impl(internal::IdDirectory const* previous_directory, std::index_sequence<Is...>)
+    {
+        (enable_id_directory_for<Is>(previous_directory), ...);
+    }
+
+    template<std::size_t I>
+    void enable_id_directory_for(internal::IdDirectory const* previous_directory)
+    {
+        using T        = typename std::tuple_element_t<I, Tuple>::ValueType;
+        auto& registry = std::get<I>(_registries);
+
+        std::shared_lock lock{registry.mutex()}; // Held until the observer is added, so that we can't miss an object created in-between
+        registry.underlying_wrapped_registry()->remove_observers(previous_directory);
+        for (auto const& [id, value] : std::as_const(registry)) // The non-const iterators are only meant for modifications, under an exclusive lock
+            _id_directory->insert(id.underlying_uuid(), I);
+        registry.underlying_wrapped_registry()->add_observer(internal::RegistryObserver<T>{
+            .on_insert = [directory = _id_directory](Id<T> const& id, T const&) { directory->insert(id.underlying_uuid(), I); },
+            .on_erase  = [directory = _id_directory](Id<T> const& id, T const&) { directory->erase(id.underlying_uuid(), I); },
+            .owner     = _id_directory.get(),
+        });
+    }
+
+    template<std::size_t... Is>
+    void enable_reference_index_impl(internal::ReferenceIndex const* previous_index, std::index_sequence<Is...>)
+    {
+        (enable_reference_index_for<Is>(previous_index), ...);
+    }
+
+    template<typename T>
+    [[nodiscard]] static auto references_of(T const& value) -> std::vector<uuids::uuid>
+    {
+        auto referenced = std::vector<uuids::uuid>{};
+        References<T>::for_each(value, [&](AnyId const& id) { referenced.push_back(id.underlying_uuid()); });
+        return referenced;
+    }
+
+    template<std::size_t I>
+    void enable_reference_index_for([[maybe_unused]] internal::ReferenceIndex const* previous_index)
+    {
+        using T = typename std::tuple_element_t<I, Tuple>::ValueType;
+        if constexpr (HasReferences<T>)
+        {
+            auto& registry = std::get<I>(_registries);
+
+            std::shared_lock lock{registry.mutex()}; // Held until the observer is added, so that we can't miss a modification done in-between
+            registry.underlying_wrapped_registry()->remove_observers(previous_index);
+            for (auto const& [id, value] : std::as_const(registry))
+                _reference_index->set_references(id.underlying_uuid(), references_of(value));
+            auto const on_insert_or_change = [index = _reference_index](Id<T> const& id, T const& value) { index->set_references(id.underlying_uuid(), references_of(value)); };
+            registry.underlying_wrapped_registry()->add_observer(internal::RegistryObserver<T>{
+                .on_insert = on_insert_or_change,
+                .on_erase  = [index = _reference_index](Id<T> const& id, T const&) { index->erase_referrer(id.underlying_uuid()); },
+                .on_change = on_insert_or_change,
+                .owner     = _reference_index.get(),
+            });
+        }
+    }
+
+    template<typename Registry>
+    static void collect_dependents(Registry const& registry, AnyId const& id, std::vector<AnyId>& dependents)
+    {
+        using T = typename Registry::ValueType;
+        if constexpr (HasReferences<T>)
+        {
+            std::shared_lock lock{registry.mutex()};
+            for (auto const& [referrer, value] : registry)
+            {
+                auto is_dependent = false;
+                References<T>::for_each(value, [&](AnyId const& referenced) { is_dependent = is_dependent || referenced == id; });
+                if (is_dependent)
+                    dependents.emplace_back(referrer);
+            }
+        }
+    }
+
+    template<std::size_t I, typename Self, typename Callback>
+    static auto visit_registry(Self& self, AnyId const& id, Callback& callback) -> bool
+    {
+        using T         = typename std::tuple_element_t<I, Tuple>::ValueType;
+        using Value     = std::conditional_t<std::is_const_v<Self>, T const, T>;
+        auto const id_t = Id<T>{id.underlying_uuid()};
+
+        auto& registry = std::get<I>(self._registries);
+        if constexpr (std::is_const_v<Self>)
+        {
+            std::shared_lock lock{registry.mutex()};
+            Value* const     value = registry.get_ref(id_t);
+            if (!value)
+                return false;
+            callback(id_t, *value);
+            return true;
+        }
+        else
+        {
+            // Goes through `with_mutable_ref()` so that the modification gets observed (by the reference index, a WriteAheadLog, ...)
+            return registry.with_mutable_ref(id_t, [&](Value& value) { callback(id_t, value); });
+        }
+    }
+
+    template<typename Self, typename Callback, std::size_t... Is>
+    static auto visit_impl(Self& self, AnyId const& id, Callback& callback, std::index_sequence<Is...>) -> bool
+    {
+        if (!self._id_directory)
+            return (visit_registry<Is>(self, id, callback) || ...); // Query each registry one after the other
+
+        auto const registry_index = self._id_directory->find(id.underlying_uuid());
+        if (!registry_index)
+            return false;
+
+        using VisitFunction                   = auto (*)(Self&, AnyId const&, Callback&)->bool;
+        static constexpr auto visit_functions = std::array<VisitFunction, sizeof...(Ts)>{&visit_registry<Is, Self, Callback>...};
+        return visit_functions[*registry_index](self, id, callback);
+    }
+
+private:
+    Tuple                                     _registries{};
+    std::shared_ptr<internal::IdDirectory>    _id_directory{};
+    std::shared_ptr<internal::ReferenceIndex> _reference_index{};
 };
 
 } // namespace reg
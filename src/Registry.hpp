@@ -1,14 +1,16 @@
 #pragma once
+#include <shared_mutex>
 #include <unordered_map>
 #include "internal/OrderPreservingMap.hpp"
 #include "internal/RegistryImpl.hpp"
 
 namespace reg {
 
-template<typename T>
-using Registry = internal::RegistryImpl<T, std::unordered_map<Id<T>, T>>;
+/// `Lock` is the type of mutex used to guard the registry, see `RawRegistryImpl`.
+template<typename T, typename Lock = std::shared_mutex>
+using Registry = internal::RegistryImpl<T, std::unordered_map<Id<T>, T>, Lock>;
 
-template<typename T>
-using OrderedRegistry = internal::RegistryImpl<T, internal::OrderPreservingMap<Id<T>, T>>;
+template<typename T, typename Lock = std::shared_mutex>
+using OrderedRegistry = internal::RegistryImpl<T, internal::OrderPreservingMap<Id<T>, T>, Lock>;
 
 } // namespace reg
\ No newline at end of file
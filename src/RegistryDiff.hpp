@@ -0,0 +1,19 @@
+#pragma once
+#include <vector>
+#include "Id.hpp"
+
+namespace reg {
+
+/// The differences between two versions of a registry, see `diff()`.
+template<typename T>
+struct RegistryDiff {
+    /// The objects that only exist in the new version.
+    std::vector<Id<T>> added{};
+    /// The objects that only exist in the old version.
+    std::vector<Id<T>> removed{};
+    /// The objects that exist in both versions, and whose value might have been modified.
+    /// (With a `PersistentRegistry`, an object that has been modified and then set back to its previous value will still be listed here.)
+    std::vector<Id<T>> modified{};
+};
+
+} // namespace reg
@@ -0,0 +1,81 @@
+#pragma once
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "Id.hpp"
+
+namespace reg {
+
+namespace internal {
+
+/// Maps that support node handles (e.g. `std::unordered_map`) give their objects away without moving them nor reallocating them.
+/// For the other maps we move the object out of the map.
+template<typename T, typename Map>
+struct NodeStorage {
+    using type = std::optional<std::pair<Id<T>, T>>;
+};
+
+template<typename T, typename Map>
+    requires requires { typename Map::node_type; }
+struct NodeStorage<T, Map> {
+    using type = typename Map::node_type;
+};
+
+} // namespace internal
+
+/// An object that has been extracted from a registry with `extract()`, together with its id.
+/// It can then be inserted back into any registry of `T`s with `insert()`, and keeps its id.
+/// If both registries use the same `Map` and the map supports it (e.g. `Registry<T>`), the object is neither moved nor reallocated.
+/// It behaves just like a `std::unordered_map::node_type`: it owns the object, which gets destroyed with the node if you don't insert it anywhere.
+template<typename T, typename Map>
+class RegistryNode {
+public:
+    RegistryNode() = default;
+
+    [[nodiscard]] auto empty() const -> bool { return !static_cast<bool>(_storage); }
+    explicit operator bool() const { return !empty(); }
+
+    /// Must not be called on an empty node.
+    [[nodiscard]] auto id() const -> Id<T>
+    {
+        if constexpr (holds_map_node)
+            return _storage.key();
+        else
+            return _storage->first;
+    }
+
+    /// Must not be called on an empty node.
+    [[nodiscard]] auto value() -> T&
+    {
+        if constexpr (holds_map_node)
+            return _storage.mapped();
+        else
+            return _storage->second;
+    }
+
+    /// Must not be called on an empty node.
+    [[nodiscard]] auto value() const -> T const&
+    {
+        if constexpr (holds_map_node)
+            return _storage.mapped();
+        else
+            return _storage->second;
+    }
+
+private:
+    template<typename SomeType, typename SomeMap, typename Lock>
+    friend class internal::RawRegistryImpl;
+
+    using Storage = typename internal::NodeStorage<T, Map>::type;
+
+    static constexpr bool holds_map_node = !std::is_same_v<Storage, std::optional<std::pair<Id<T>, T>>>;
+
+    explicit RegistryNode(Storage storage)
+        : _storage{std::move(storage)}
+    {}
+
+private:
+    Storage _storage{};
+};
+
+} // namespace reg
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include "Id.hpp"
+
+namespace reg {
+
+/// An `Id<T>` that remembers where its object is stored, so that accessing the same object over and over doesn't need to look it up in the registry each time.
+/// You get one with `registry.resolve(id)`, and can then pass it to `get()`, `set()`, `contains()`, `with_ref()`, `with_mutable_ref()`, `get_ref()` and `get_mutable_ref()` instead of the id.
+/// The cached location is only used as long as no object has been created or destroyed in the registry since it was cached (and, for a `PersistentRegistry`, as long as no object has been modified);
+/// otherwise the registry does a normal lookup and caches its result again. It also works with ids that don't refer to any object: the absence of the object gets cached too.
+/// NOT Thread-safe: accessing an object through a `ResolvedId` updates its cache, so each thread should use its own copy (they are cheap to copy).
+template<typename T>
+class ResolvedId {
+public:
+    /// The type of values referenced by this id.
+    using ValueType = T;
+
+    ResolvedId() = default;
+    explicit ResolvedId(Id<T> const& id)
+        : _id{id}
+    {}
+
+    [[nodiscard]] auto id() const -> Id<T> const& { return _id; }
+
+private:
+    template<typename SomeType, typename Map, typename Lock>
+    friend class internal::RawRegistryImpl;
+
+private:
+    Id<T>         _id{};
+    T const*      _value{nullptr}; // Null if the object was not in the registry
+    std::uint64_t _generation{0};  // The generation of the registry at the time `_value` was cached. 0 is never used by a registry, so this starts out as invalid.
+};
+
+} // namespace reg
@@ -22,6 +22,7 @@ public:
     {
         auto ret          = SharedId<T>{};
         ret._id_destroyer = std::make_shared<internal::IdDestroyer<T>>(id, registry);
+        ret._id_destroyer->mark_as_shared();
         return ret;
     }
 
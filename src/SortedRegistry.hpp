@@ -0,0 +1,78 @@
+#pragma once
+#include <mutex>
+#include <shared_mutex>
+#include "AnyId.hpp"
+#include "internal/BPlusTreeMap.hpp"
+#include "internal/RawRegistryImpl.hpp"
+#include "internal/RegistryImpl.hpp"
+
+namespace reg {
+
+/// A registry that keeps its objects sorted by id, in a B+-tree: lookups are O(log(n)), and iterating over the registry always visits the objects in the same order
+/// (which makes the serialized registries deterministic, so that save files diff and compress well).
+/// It also allows you to scan a range of ids (`for_each_in_range()`), and to join two registries on their ids in linear time (`merge_join()`).
+template<typename T, typename Lock = std::shared_mutex>
+using SortedRegistry = internal::RegistryImpl<T, internal::BPlusTreeMap<Id<T>, T>, Lock>;
+
+template<typename T, typename Lock = std::shared_mutex>
+using RawSortedRegistry = internal::RawRegistryImpl<T, internal::BPlusTreeMap<Id<T>, T>, Lock>;
+
+/// Returns true iff `a` comes before `b` in a `SortedRegistry`.
+template<typename T>
+[[nodiscard]] auto id_less(Id<T> const& a, Id<T> const& b) -> bool
+{
+    return internal::compare_uuids(a.underlying_uuid(), b.underlying_uuid()) < 0;
+}
+
+/// Thread-safe.
+/// Calls `callback(id, value)` on each object whose id is in the range [first, last), in increasing order of id. This is O(log(n)) plus the size of the range.
+/// The registry is (shared-)locked during the whole scan: `callback` must not modify it.
+template<typename T, typename Lock, typename Callback>
+void for_each_in_range(SortedRegistry<T, Lock> const& registry, Id<T> const& first, Id<T> const& last, Callback&& callback)
+{
+    std::shared_lock lock{registry.mutex()};
+
+    auto const& map = registry.underlying_container();
+    for (auto it = map.lower_bound(first), end = map.lower_bound(last); it != end; ++it)
+        callback(it->first, it->second);
+}
+
+/// Thread-safe.
+/// Calls `callback(id, a_value, b_value)` on each id that refers to an object in both `a` and `b`, in increasing order of id. This is O(n + m).
+/// The registries can store different types: the ids are compared by their underlying UUID (e.g. to join a registry of positions and a registry of velocities that share their ids).
+/// Both registries are (shared-)locked together, in a deadlock-free way, during the whole join: `callback` must not modify them.
+template<typename A, typename LockA, typename B, typename LockB, typename Callback>
+void merge_join(SortedRegistry<A, LockA> const& a, SortedRegistry<B, LockB> const& b, Callback&& callback)
+{
+    auto lock_a = std::shared_lock{a.mutex(), std::defer_lock};
+    auto lock_b = std::shared_lock{b.mutex(), std::defer_lock};
+    if (static_cast<void const*>(&a) == static_cast<void const*>(&b))
+        lock_a.lock();
+    else
+        std::lock(lock_a, lock_b);
+
+    auto const& map_a = a.underlying_container();
+    auto const& map_b = b.underlying_container();
+    auto        it_a  = map_a.begin();
+    auto        it_b  = map_b.begin();
+    while (it_a != map_a.end() && it_b != map_b.end())
+    {
+        auto const comparison = internal::compare_uuids(it_a->first.underlying_uuid(), it_b->first.underlying_uuid());
+        if (comparison < 0)
+        {
+            ++it_a;
+        }
+        else if (comparison > 0)
+        {
+            ++it_b;
+        }
+        else
+        {
+            callback(AnyId{it_a->first}, it_a->second, it_b->second);
+            ++it_a;
+            ++it_b;
+        }
+    }
+}
+
+} // namespace reg
@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include "internal/cpu_relax.hpp"
+
+namespace reg {
+
+/// A reader-writer lock that busy-waits instead of putting the thread to sleep.
+/// It is cheaper than a `std::shared_mutex` when the critical sections are very short (e.g. `get()`, `set()` and `contains()` on small objects),
+/// but wastes CPU time if the lock is held for a long time.
+/// Writers have priority: as soon as a writer is waiting, new readers wait too, so that writers can't get starved.
+class SpinSharedMutex {
+public:
+    void lock()
+    {
+        internal::spin_until([&]() {
+            auto state = _state.load(std::memory_order_relaxed);
+            if ((state & ~writer_is_waiting) == 0) // No reader nor writer
+                return _state.compare_exchange_weak(state, writer_has_lock, std::memory_order_acquire, std::memory_order_relaxed);
+            if ((state & writer_is_waiting) == 0)
+                _state.fetch_or(writer_is_waiting, std::memory_order_relaxed);
+            return false;
+        });
+    }
+
+    [[nodiscard]] auto try_lock() -> bool
+    {
+        auto state = _state.load(std::memory_order_relaxed);
+        return (state & ~writer_is_waiting) == 0
+               && _state.compare_exchange_strong(state, writer_has_lock, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock()
+    {
+        _state.fetch_and(~writer_has_lock, std::memory_order_release);
+    }
+
+    void lock_shared()
+    {
+        internal::spin_until([&]() { return try_lock_shared(); });
+    }
+
+    [[nodiscard]] auto try_lock_shared() -> bool
+    {
+        auto state = _state.load(std::memory_order_relaxed);
+        return (state & (writer_has_lock | writer_is_waiting)) == 0
+               && _state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void unlock_shared()
+    {
+        _state.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    static constexpr std::uint32_t writer_has_lock   = 1u << 31;
+    static constexpr std::uint32_t writer_is_waiting = 1u << 30;
+
+    /// The two highest bits are the flags above, and the other ones count the number of readers.
+    std::atomic<std::uint32_t> _state{0};
+};
+
+} // namespace reg
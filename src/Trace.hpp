@@ -0,0 +1,160 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <uuid.h>
+
+namespace reg {
+
+/// The operations that a `TraceRecorder` can record.
+enum class TraceOp : std::uint8_t {
+    Get,
+    GetRef,
+    GetMutableRef,
+    Set,
+    Contains,
+    WithRef,
+    WithMutableRef,
+    Create,
+    Destroy,
+    Clear,
+    Iterate,      // A call to `begin()`, typically at the start of a range-based for loop
+    Lock,         // A manual lock of `registry.mutex()`
+    Unlock,       //
+    LockShared,   //
+    UnlockShared, //
+};
+
+/// One operation of a trace.
+struct TraceRecord {
+    /// Nanoseconds since the creation of the recorder.
+    std::uint64_t timestamp;
+    /// Each thread that used the registry gets a small index, in the order in which they first used it.
+    std::uint32_t thread_index;
+    TraceOp       op;
+    /// The id of the object the operation applied to (nil for the operations that don't apply to a specific object).
+    uuids::uuid id;
+};
+
+/// Records the operations done on a registry to a compact binary trace, that you can then replay with the `reg-replay` tool to evaluate the performance of the different backends on your real workload.
+/// Use it with `registry.set_trace_recorder(std::make_shared<reg::TraceRecorder>(file))`.
+/// Recording has a cost (each operation locks the recorder's mutex), so you should only enable it while capturing a trace.
+/// Format: the magic bytes "REGTRACE", a little-endian u32 version, and then records of 29 bytes each: u64 timestamp, u32 thread index, u8 op, 16 bytes of UUID (all little-endian).
+class TraceRecorder {
+public:
+    static constexpr std::array<char, 8> magic       = {'R', 'E', 'G', 'T', 'R', 'A', 'C', 'E'};
+    static constexpr std::uint32_t       version     = 1;
+    static constexpr std::size_t         record_size = 8 + 4 + 1 + 16;
+
+    /// `output` must outlive the recorder.
+    explicit TraceRecorder(std::ostream& output)
+        : _output{&output}
+    {
+        _output->write(magic.data(), magic.size());
+        auto header = std::array<char, 4>{};
+        write_little_endian(header.data(), version);
+        _output->write(header.data(), header.size());
+    }
+    ~TraceRecorder() { flush(); }
+    TraceRecorder(TraceRecorder const&)                    = delete;
+    auto operator=(TraceRecorder const&) -> TraceRecorder& = delete;
+    TraceRecorder(TraceRecorder&&)                         = delete;
+    auto operator=(TraceRecorder&&) -> TraceRecorder&      = delete;
+
+    /// Thread-safe.
+    void record(TraceOp op, uuids::uuid const& id = {})
+    {
+        auto const timestamp = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count());
+
+        std::unique_lock lock{_mutex};
+        auto const thread_index = _threads_indices.try_emplace(std::this_thread::get_id(), static_cast<std::uint32_t>(_threads_indices.size())).first->second;
+
+        auto const offset = _buffer.size();
+        _buffer.resize(offset + record_size);
+        auto* record = _buffer.data() + offset;
+        write_little_endian(record, timestamp);
+        write_little_endian(record + 8, thread_index);
+        record[12] = static_cast<char>(op);
+        std::memcpy(record + 13, id.as_bytes().data(), 16);
+
+        if (_buffer.size() >= flush_threshold)
+            flush_while_locked();
+    }
+
+    /// Thread-safe.
+    /// Writes all the records that are still buffered to the output.
+    void flush()
+    {
+        std::unique_lock lock{_mutex};
+        flush_while_locked();
+    }
+
+private:
+    static constexpr std::size_t flush_threshold = 64 * 1024;
+
+    template<typename UnsignedInt>
+    static void write_little_endian(char* destination, UnsignedInt value)
+    {
+        for (std::size_t i = 0; i < sizeof(UnsignedInt); ++i)
+            destination[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+
+    void flush_while_locked()
+    {
+        _output->write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _buffer.clear();
+    }
+
+private:
+    std::ostream*                                       _output;
+    std::chrono::steady_clock::time_point               _start{std::chrono::steady_clock::now()};
+    std::mutex                                          _mutex{};
+    std::vector<char>                                   _buffer{};
+    std::unordered_map<std::thread::id, std::uint32_t> _threads_indices{};
+};
+
+/// Reads a whole trace written by a `TraceRecorder`.
+/// Throws if `input` doesn't contain a valid trace.
+inline auto read_trace(std::istream& input) -> std::vector<TraceRecord>
+{
+    auto header = std::array<char, 12>{};
+    if (!input.read(header.data(), header.size()) || std::memcmp(header.data(), TraceRecorder::magic.data(), TraceRecorder::magic.size()) != 0)
+        throw std::runtime_error{"[read_trace()] This is not a trace written by a reg::TraceRecorder"};
+
+    auto const read_little_endian = [](char const* source, std::size_t size) {
+        auto value = std::uint64_t{0};
+        for (std::size_t i = 0; i < size; ++i)
+            value |= static_cast<std::uint64_t>(static_cast<unsigned char>(source[i])) << (8 * i);
+        return value;
+    };
+    if (read_little_endian(header.data() + 8, 4) != TraceRecorder::version)
+        throw std::runtime_error{"[read_trace()] Unsupported trace version"};
+
+    auto records = std::vector<TraceRecord>{};
+    auto bytes   = std::array<char, TraceRecorder::record_size>{};
+    while (input.read(bytes.data(), bytes.size()))
+    {
+        auto uuid_bytes = std::array<uuids::uuid::value_type, 16>{};
+        std::memcpy(uuid_bytes.data(), bytes.data() + 13, 16);
+        records.push_back({
+            .timestamp    = read_little_endian(bytes.data(), 8),
+            .thread_index = static_cast<std::uint32_t>(read_little_endian(bytes.data() + 8, 4)),
+            .op           = static_cast<TraceOp>(bytes[12]),
+            .id           = uuids::uuid{uuid_bytes},
+        });
+    }
+    if (input.gcount() != 0)
+        throw std::runtime_error{"[read_trace()] Truncated record"};
+    return records;
+}
+
+} // namespace reg
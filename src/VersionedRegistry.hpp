@@ -0,0 +1,173 @@
+#pragma once
+#include <memory>
+#include "SharedId.hpp"
+#include "UniqueId.hpp"
+#include "internal/RawVersionedRegistry.hpp"
+
+namespace reg {
+
+/// A registry for trivially copyable types (numbers, small POD structs, etc.) that are read very often by many threads.
+/// Each object has its own version counter (a seqlock), so reading or modifying the value of an existing object never waits for the other readers and writers of that object:
+/// the readers copy the value optimistically and retry if a writer modified it in the meantime.
+/// Reading and modifying existing objects doesn't lock the registry at all: its mutex is only locked to create and destroy objects.
+/// Destroying an object (or resizing the internal table when creating one) also waits until the readers that might still be looking at the old data are done, see `internal::GracePeriod`.
+/// This costs 8 KiB of reader counters per registry. NB: the callback of `with_mutable_ref()` must therefore not create nor destroy objects of the same registry.
+/// You can also do optimistic updates, that only succeed if nobody else modified the object in the meantime, with `compare_and_set()` and `update_if_unchanged()`.
+template<typename T, typename Lock = std::shared_mutex>
+class VersionedRegistry {
+public:
+    /// The type of values stored in this registry.
+    using ValueType = T;
+    /// The type of mutex used to guard this registry.
+    using LockType = Lock;
+
+    VersionedRegistry()                                                = default;
+    ~VersionedRegistry()                                               = default;
+    VersionedRegistry(VersionedRegistry&&) noexcept                    = default;
+    auto operator=(VersionedRegistry&&) noexcept -> VersionedRegistry& = default;
+
+    VersionedRegistry(VersionedRegistry const&)                    = delete; // This class is non-copyable
+    auto operator=(VersionedRegistry const&) -> VersionedRegistry& = delete; // because it is the unique owner of the objects it stores
+
+    /// Thread-safe.
+    /// Returns the value of the objet referenced by `id`, or null if the `id` doesn't refer to a an object in this registry.
+    [[nodiscard]] auto get(Id<T> const& id) const -> std::optional<T>
+    {
+        auto const versioned = get_versioned(id);
+        if (!versioned)
+            return std::nullopt;
+        return versioned->value;
+    }
+
+    /// Thread-safe.
+    /// Returns the value of the objet referenced by `id` along with its version, or null if the `id` doesn't refer to a an object in this registry.
+    /// You can then pass that version to `compare_and_set()`.
+    [[nodiscard]] auto get_versioned(Id<T> const& id) const -> std::optional<Versioned<T>>
+    {
+        return _wrapped->get_versioned(id);
+    }
+
+    /// Thread-safe.
+    /// Sets the value of the object referenced by `id` to `value`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto set(Id<T> const& id, T const& value) -> bool
+    {
+        return _wrapped->set(id, value);
+    }
+
+    /// Thread-safe.
+    /// Sets the value of the object referenced by `id` to `value`, but only if its version is still `expected_version` (i.e. nobody modified it since you read that version with `get_versioned()`).
+    /// Returns false iff the object was not found in the registry or has been modified in the meantime, and this function did nothing.
+    auto compare_and_set(Id<T> const& id, std::uint64_t expected_version, T const& value) -> bool
+    {
+        return _wrapped->compare_and_set(id, expected_version, value);
+    }
+
+    /// Thread-safe.
+    /// Reads the value of the object referenced by `id`, computes its new value with `compute_new_value(T const&) -> T`, and stores it if the object hasn't been modified in the meantime.
+    /// Otherwise, starts over with the latest value, so `compute_new_value` might be called several times and should have no side effects.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    template<typename Callback>
+    auto update_if_unchanged(Id<T> const& id, Callback&& compute_new_value) -> bool
+    {
+        while (true)
+        {
+            auto const versioned = get_versioned(id);
+            if (!versioned)
+                return false;
+            if (compare_and_set(id, versioned->version, compute_new_value(std::as_const(versioned->value))))
+                return true;
+        }
+    }
+
+    /// Thread-safe.
+    /// Returns true iff `id` references an object in the registry.
+    [[nodiscard]] auto contains(Id<T> const& id) const -> bool
+    {
+        return _wrapped->contains(id);
+    }
+
+    /// Thread-safe.
+    /// Applies `callback` to a copy of the object referenced by `id`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_ref(Id<T> const& id, std::function<void(T const&)> const& callback) const -> bool
+    {
+        auto const value = get(id);
+        if (!value)
+            return false;
+        callback(*value);
+        return true;
+    }
+
+    /// Thread-safe.
+    /// Applies `callback` to a copy of the object referenced by `id`, and stores the result if nobody modified the object in the meantime, like `update_if_unchanged()`.
+    /// Otherwise, starts over with the latest value, so `callback` might be called several times and should have no side effects. Readers never wait for `callback`.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool
+    {
+        return _wrapped->with_mutable_ref(id, callback);
+    }
+
+    /// Thread-safe.
+    /// Inserts a copy of `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    [[nodiscard]] auto create_unique(T const& value) -> UniqueId<T>
+    {
+        return UniqueId<T>::internal_constructor(create_raw(value), internal::make_any_raw_registry<T>(_wrapped));
+    }
+
+    /// Thread-safe.
+    /// Inserts a copy of `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    [[nodiscard]] auto create_shared(T const& value) -> SharedId<T>
+    {
+        return SharedId<T>::internal_constructor(create_raw(value), internal::make_any_raw_registry<T>(_wrapped));
+    }
+
+    /// Thread-safe.
+    /// Inserts a copy of `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    [[nodiscard]] auto create_raw(T const& value) -> Id<T>
+    {
+        return _wrapped->create_raw(value);
+    }
+
+    /// Thread-safe.
+    /// Destroys the object and removes it from the registry.
+    /// From then on, trying to get an object using `id` is still safe but will return null.
+    void destroy(Id<T> const& id)
+    {
+        _wrapped->destroy(id);
+    }
+
+    /// Thread-safe.
+    /// Returns true iff the registry contains no objects at all.
+    [[nodiscard]] auto is_empty() const -> bool
+    {
+        return _wrapped->is_empty();
+    }
+
+    /// Thread-safe.
+    /// Destroys all the objects in the registry.
+    void clear()
+    {
+        _wrapped->clear();
+    }
+
+    /// Returns the mutex guarding the structure of this registry (i.e. which objects exist), to allow you to lock it manually, e.g. to use `underlying_container()`.
+    /// Reading and modifying the existing objects doesn't lock it.
+    [[nodiscard]] auto mutex() const -> Lock& { return _wrapped->mutex(); }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    /// Maps each id to the node storing its object (the value is in `node->cell`).
+    [[nodiscard]] auto underlying_container() const -> auto const& { return _wrapped->underlying_container(); }
+    [[nodiscard]] auto underlying_wrapped_registry() const -> auto const& { return _wrapped; }
+
+private:
+    std::shared_ptr<internal::RawVersionedRegistry<T, Lock>> _wrapped = std::make_shared<internal::RawVersionedRegistry<T, Lock>>();
+};
+
+} // namespace reg
@@ -0,0 +1,37 @@
+#pragma once
+#include <coroutine>
+#include <utility>
+
+namespace reg::internal {
+
+/// A `Lock` that coroutines can `co_await`, e.g. `reg::AsyncSharedMutex`.
+template<typename Lock>
+concept AwaitableLock = requires(Lock& mutex) {
+    mutex.async_lock();
+    mutex.async_lock_shared();
+};
+
+/// Awaits `lock_awaiter`, and then returns the result of `access()`, which is responsible for releasing the lock.
+/// Since the coroutine is resumed by the thread that handed the lock over to it, `access()` runs on that thread.
+template<typename LockAwaiter, typename Access>
+class AsyncAccess {
+public:
+    AsyncAccess(LockAwaiter lock_awaiter, Access access)
+        : _lock_awaiter{std::move(lock_awaiter)}
+        , _access{std::move(access)}
+    {}
+
+    [[nodiscard]] auto await_ready() -> bool { return _lock_awaiter.await_ready(); }
+    auto               await_suspend(std::coroutine_handle<> continuation) { return _lock_awaiter.await_suspend(continuation); }
+    auto               await_resume()
+    {
+        _lock_awaiter.await_resume();
+        return _access();
+    }
+
+private:
+    LockAwaiter _lock_awaiter;
+    Access      _access;
+};
+
+} // namespace reg::internal
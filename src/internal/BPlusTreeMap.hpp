@@ -0,0 +1,459 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <uuid.h>
+#include "../MemoryUsage.hpp"
+
+namespace reg::internal {
+
+/// Orders the UUIDs by their bytes, which is the same order as `uuids::uuid::operator<`.
+/// Returns a negative number if `a` comes before `b`, 0 if they are equal, and a positive number otherwise.
+[[nodiscard]] inline auto compare_uuids(uuids::uuid const& a, uuids::uuid const& b) -> int
+{
+    return std::memcmp(a.as_bytes().data(), b.as_bytes().data(), 16);
+}
+
+/// A map sorted by key, implemented as a B+-tree: the entries are stored in leaves of up to `NodeCapacity` entries, which are linked together in order.
+/// Lookups are O(log(n)), iterating is a simple walk along the leaves, and `lower_bound()` / `upper_bound()` allow scanning a range of keys.
+/// The values move when their leaf gets split or merged, i.e. when an entry is inserted or erased.
+/// `Key` must be an `Id<T>`.
+template<typename Key, typename Value, std::size_t NodeCapacity = 32>
+class BPlusTreeMap {
+    static_assert(NodeCapacity >= 4, "Nodes need to be able to hold a few entries for the tree to stay balanced");
+
+public:
+    using value_type = std::pair<Key, Value>;
+
+private:
+    /// Leaves only use `entries` and `next`, and inner nodes only use `keys` and `children`.
+    /// `keys[i]` is the smallest key stored in `children[i + 1]`.
+    struct Node {
+        bool                               is_leaf{true};
+        std::vector<value_type>            entries{};
+        Node*                              next{nullptr};
+        std::vector<Key>                   keys{};
+        std::vector<std::unique_ptr<Node>> children{};
+
+        [[nodiscard]] auto size() const -> std::size_t { return is_leaf ? entries.size() : children.size(); }
+    };
+
+    static constexpr std::size_t min_node_size = NodeCapacity / 2;
+
+    [[nodiscard]] static auto less(Key const& a, Key const& b) -> bool
+    {
+        return compare_uuids(a.underlying_uuid(), b.underlying_uuid()) < 0;
+    }
+
+public:
+    template<bool IsConst>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = BPlusTreeMap::value_type;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = std::conditional_t<IsConst, value_type const*, value_type*>;
+        using reference         = std::conditional_t<IsConst, value_type const&, value_type&>;
+
+        Iterator() = default;
+        operator Iterator<true>() const { return Iterator<true>{_leaf, _index}; } // NOLINT(*-explicit-constructor, *-explicit-conversions)
+
+        [[nodiscard]] auto operator*() const -> reference { return _leaf->entries[_index]; }
+        [[nodiscard]] auto operator->() const -> pointer { return &_leaf->entries[_index]; }
+
+        auto operator++() -> Iterator&
+        {
+            if (++_index == _leaf->entries.size())
+            {
+                _leaf  = _leaf->next;
+                _index = 0;
+            }
+            return *this;
+        }
+        auto operator++(int) -> Iterator
+        {
+            auto const copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        friend auto operator==(Iterator const&, Iterator const&) -> bool = default;
+
+    private:
+        friend class BPlusTreeMap;
+        template<bool>
+        friend class Iterator;
+        using NodePointer = std::conditional_t<IsConst, Node const*, Node*>;
+
+        Iterator(NodePointer leaf, std::size_t index)
+            : _leaf{leaf}
+            , _index{index}
+        {
+            if (_leaf && _index == _leaf->entries.size()) // Past the end of a leaf means the beginning of the next one (only the last leaf can be empty, when the whole map is empty)
+            {
+                _leaf  = _leaf->next;
+                _index = 0;
+            }
+        }
+
+    private:
+        NodePointer _leaf{nullptr}; // Null for the end iterator
+        std::size_t _index{0};
+    };
+
+    using iterator       = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    BPlusTreeMap()  = default;
+    ~BPlusTreeMap() = default;
+
+    /// The moved-from map is left empty (with a fresh root), so that it can still be used.
+    BPlusTreeMap(BPlusTreeMap&& other)
+        : _root{std::exchange(other._root, std::make_unique<Node>())}
+        , _size{std::exchange(other._size, 0)}
+    {}
+    auto operator=(BPlusTreeMap&& other) -> BPlusTreeMap&
+    {
+        if (this != &other)
+        {
+            _root = std::exchange(other._root, std::make_unique<Node>());
+            _size = std::exchange(other._size, 0);
+        }
+        return *this;
+    }
+
+    /// Deep copy: the copy doesn't share anything with the original.
+    BPlusTreeMap(BPlusTreeMap const& other)
+        : _size{other._size}
+    {
+        auto* previous_leaf = static_cast<Node*>(nullptr);
+        _root               = copy_node(*other._root, previous_leaf);
+    }
+    auto operator=(BPlusTreeMap const& other) -> BPlusTreeMap&
+    {
+        if (this != &other)
+            *this = BPlusTreeMap{other};
+        return *this;
+    }
+
+    [[nodiscard]] auto begin() { return iterator{first_leaf(), 0}; }
+    [[nodiscard]] auto begin() const { return const_iterator{first_leaf(), 0}; }
+    [[nodiscard]] auto cbegin() const { return begin(); }
+    [[nodiscard]] auto end() { return iterator{}; }
+    [[nodiscard]] auto end() const { return const_iterator{}; }
+    [[nodiscard]] auto cend() const { return end(); }
+
+    [[nodiscard]] auto find(Key const& key) -> iterator
+    {
+        auto const it = lower_bound(key);
+        return it != end() && !less(key, it->first) ? it : end();
+    }
+    [[nodiscard]] auto find(Key const& key) const -> const_iterator
+    {
+        auto const it = lower_bound(key);
+        return it != end() && !less(key, it->first) ? it : end();
+    }
+
+    /// Returns the first entry whose key is not less than `key`.
+    [[nodiscard]] auto lower_bound(Key const& key) -> iterator
+    {
+        auto* const leaf = find_leaf(key);
+        return iterator{leaf, leaf_lower_bound(*leaf, key)};
+    }
+    [[nodiscard]] auto lower_bound(Key const& key) const -> const_iterator
+    {
+        auto const* const leaf = find_leaf(key);
+        return const_iterator{leaf, leaf_lower_bound(*leaf, key)};
+    }
+
+    /// Returns the first entry whose key is greater than `key`.
+    [[nodiscard]] auto upper_bound(Key const& key) -> iterator
+    {
+        auto it = lower_bound(key);
+        if (it != end() && !less(key, it->first))
+            ++it;
+        return it;
+    }
+    [[nodiscard]] auto upper_bound(Key const& key) const -> const_iterator
+    {
+        auto it = lower_bound(key);
+        if (it != end() && !less(key, it->first))
+            ++it;
+        return it;
+    }
+
+    /// Same semantics as `std::unordered_map::try_emplace()`: constructs the value in-place from `args`,
+    /// unless `key` is already present in which case nothing happens.
+    template<typename... Args>
+    auto try_emplace(Key const& key, Args&&... args) -> std::pair<iterator, bool>
+    {
+        auto position = iterator{};
+        auto inserted = false;
+        auto split    = insert_into(*_root, key, position, inserted, std::forward<Args>(args)...);
+        if (split.right) // The root is full, the tree grows by one level
+        {
+            auto new_root     = std::make_unique<Node>();
+            new_root->is_leaf = false;
+            new_root->keys.push_back(std::move(split.separator));
+            new_root->children.push_back(std::move(_root));
+            new_root->children.push_back(std::move(split.right));
+            _root = std::move(new_root);
+        }
+        if (inserted)
+            ++_size;
+        return {position, inserted};
+    }
+
+    /// Returns the number of elements removed (0 or 1).
+    auto erase(Key const& key) -> std::size_t
+    {
+        if (!erase_from(*_root, key))
+            return 0;
+
+        --_size;
+        if (!_root->is_leaf && _root->children.size() == 1) // The tree shrinks by one level
+            _root = std::move(_root->children.front());
+        return 1;
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return _size == 0; }
+    [[nodiscard]] auto size() const -> std::size_t { return _size; }
+
+    void clear()
+    {
+        _root = std::make_unique<Node>();
+        _size = 0;
+    }
+
+    [[nodiscard]] auto memory_usage() const -> MemoryUsage
+    {
+        auto usage = MemoryUsage{
+            .keys   = _size * sizeof(Key),
+            .values = _size * sizeof(Value),
+        };
+        add_overhead(*_root, usage);
+        return usage;
+    }
+
+private:
+    struct Split {
+        Key                   separator{};
+        std::unique_ptr<Node> right{}; // Null if the node didn't need to be split
+    };
+
+    [[nodiscard]] static auto child_index(Node const& node, Key const& key) -> std::size_t
+    {
+        auto const it = std::upper_bound(node.keys.begin(), node.keys.end(), key, [](Key const& a, Key const& b) { return less(a, b); });
+        return static_cast<std::size_t>(it - node.keys.begin());
+    }
+
+    [[nodiscard]] static auto leaf_lower_bound(Node const& leaf, Key const& key) -> std::size_t
+    {
+        auto const it = std::lower_bound(leaf.entries.begin(), leaf.entries.end(), key, [](value_type const& entry, Key const& k) { return less(entry.first, k); });
+        return static_cast<std::size_t>(it - leaf.entries.begin());
+    }
+
+    [[nodiscard]] auto find_leaf(Key const& key) const -> Node*
+    {
+        auto* node = _root.get();
+        while (!node->is_leaf)
+            node = node->children[child_index(*node, key)].get();
+        return node;
+    }
+
+    [[nodiscard]] auto first_leaf() const -> Node*
+    {
+        auto* node = _root.get();
+        while (!node->is_leaf)
+            node = node->children.front().get();
+        return node;
+    }
+
+    template<typename... Args>
+    auto insert_into(Node& node, Key const& key, iterator& position, bool& inserted, Args&&... args) -> Split
+    {
+        if (node.is_leaf)
+        {
+            auto const index = leaf_lower_bound(node, key);
+            if (index < node.entries.size() && !less(key, node.entries[index].first))
+            {
+                position = iterator{&node, index};
+                return {};
+            }
+            node.entries.emplace(node.entries.begin() + static_cast<std::ptrdiff_t>(index), std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+            inserted = true;
+            if (node.entries.size() <= NodeCapacity)
+            {
+                position = iterator{&node, index};
+                return {};
+            }
+            auto split = split_leaf(node);
+            position   = index < node.entries.size()
+                             ? iterator{&node, index}
+                             : iterator{split.right.get(), index - node.entries.size()};
+            return split;
+        }
+
+        auto const index       = child_index(node, key);
+        auto       child_split = insert_into(*node.children[index], key, position, inserted, std::forward<Args>(args)...);
+        if (!child_split.right)
+            return {};
+
+        node.keys.insert(node.keys.begin() + static_cast<std::ptrdiff_t>(index), std::move(child_split.separator));
+        node.children.insert(node.children.begin() + static_cast<std::ptrdiff_t>(index) + 1, std::move(child_split.right));
+        if (node.children.size() <= NodeCapacity)
+            return {};
+        return split_inner(node);
+    }
+
+    [[nodiscard]] static auto split_leaf(Node& leaf) -> Split
+    {
+        auto const half  = leaf.entries.size() / 2;
+        auto       right = std::make_unique<Node>();
+        right->entries.reserve(NodeCapacity);
+        std::move(leaf.entries.begin() + static_cast<std::ptrdiff_t>(half), leaf.entries.end(), std::back_inserter(right->entries));
+        leaf.entries.erase(leaf.entries.begin() + static_cast<std::ptrdiff_t>(half), leaf.entries.end());
+        right->next = leaf.next;
+        leaf.next   = right.get();
+        return {right->entries.front().first, std::move(right)};
+    }
+
+    [[nodiscard]] static auto split_inner(Node& node) -> Split
+    {
+        auto const half  = node.children.size() / 2; // The left node keeps `half` children (and `half - 1` keys), and the key in between goes up to the parent
+        auto       right = std::make_unique<Node>();
+        right->is_leaf   = false;
+        auto separator   = std::move(node.keys[half - 1]);
+        std::move(node.keys.begin() + static_cast<std::ptrdiff_t>(half), node.keys.end(), std::back_inserter(right->keys));
+        std::move(node.children.begin() + static_cast<std::ptrdiff_t>(half), node.children.end(), std::back_inserter(right->children));
+        node.keys.erase(node.keys.begin() + static_cast<std::ptrdiff_t>(half) - 1, node.keys.end());
+        node.children.erase(node.children.begin() + static_cast<std::ptrdiff_t>(half), node.children.end());
+        return {std::move(separator), std::move(right)};
+    }
+
+    /// Returns true iff `key` was found and erased.
+    auto erase_from(Node& node, Key const& key) -> bool
+    {
+        if (node.is_leaf)
+        {
+            auto const index = leaf_lower_bound(node, key);
+            if (index == node.entries.size() || less(key, node.entries[index].first))
+                return false;
+            node.entries.erase(node.entries.begin() + static_cast<std::ptrdiff_t>(index));
+            return true;
+        }
+
+        auto const index = child_index(node, key);
+        if (!erase_from(*node.children[index], key))
+            return false;
+        if (node.children[index]->size() < min_node_size)
+            rebalance_child(node, index);
+        return true;
+    }
+
+    /// `parent.children[index]` has one element less than the minimum: we merge it with one of its siblings, or borrow an element from it.
+    static void rebalance_child(Node& parent, std::size_t index)
+    {
+        auto const left_index = index > 0 ? index - 1 : index; // Work on the pair (left, right) = (children[left_index], children[left_index + 1])
+        auto&      left       = *parent.children[left_index];
+        auto&      right      = *parent.children[left_index + 1];
+        auto&      separator  = parent.keys[left_index];
+
+        if (left.size() + right.size() <= NodeCapacity)
+        {
+            if (left.is_leaf)
+            {
+                std::move(right.entries.begin(), right.entries.end(), std::back_inserter(left.entries));
+                left.next = right.next;
+            }
+            else
+            {
+                left.keys.push_back(std::move(separator));
+                std::move(right.keys.begin(), right.keys.end(), std::back_inserter(left.keys));
+                std::move(right.children.begin(), right.children.end(), std::back_inserter(left.children));
+            }
+            parent.keys.erase(parent.keys.begin() + static_cast<std::ptrdiff_t>(left_index));
+            parent.children.erase(parent.children.begin() + static_cast<std::ptrdiff_t>(left_index) + 1);
+            return;
+        }
+
+        auto const borrow_from_left = index != left_index; // The underflowing child is the right one
+        if (left.is_leaf)
+        {
+            if (borrow_from_left)
+            {
+                right.entries.insert(right.entries.begin(), std::move(left.entries.back()));
+                left.entries.pop_back();
+            }
+            else
+            {
+                left.entries.push_back(std::move(right.entries.front()));
+                right.entries.erase(right.entries.begin());
+            }
+            separator = right.entries.front().first;
+        }
+        else if (borrow_from_left)
+        {
+            right.keys.insert(right.keys.begin(), std::move(separator));
+            right.children.insert(right.children.begin(), std::move(left.children.back()));
+            separator = std::move(left.keys.back());
+            left.keys.pop_back();
+            left.children.pop_back();
+        }
+        else
+        {
+            left.keys.push_back(std::move(separator));
+            left.children.push_back(std::move(right.children.front()));
+            separator = std::move(right.keys.front());
+            right.keys.erase(right.keys.begin());
+            right.children.erase(right.children.begin());
+        }
+    }
+
+    /// Copies the leaves in order, so that we can link each one to the next.
+    static auto copy_node(Node const& node, Node*& previous_leaf) -> std::unique_ptr<Node>
+    {
+        auto copy     = std::make_unique<Node>();
+        copy->is_leaf = node.is_leaf;
+        if (node.is_leaf)
+        {
+            copy->entries.reserve(NodeCapacity);
+            copy->entries = node.entries;
+            if (previous_leaf)
+                previous_leaf->next = copy.get();
+            previous_leaf = copy.get();
+        }
+        else
+        {
+            copy->keys = node.keys;
+            copy->children.reserve(node.children.size());
+            for (auto const& child : node.children)
+                copy->children.push_back(copy_node(*child, previous_leaf));
+        }
+        return copy;
+    }
+
+    static void add_overhead(Node const& node, MemoryUsage& usage)
+    {
+        usage.overhead += sizeof(Node);
+        if (node.is_leaf)
+        {
+            usage.overhead += node.entries.capacity() * sizeof(value_type) - node.entries.size() * (sizeof(Key) + sizeof(Value)); // Unused capacity, and padding inside the pairs
+            return;
+        }
+        usage.overhead += node.keys.capacity() * sizeof(Key) + node.children.capacity() * sizeof(std::unique_ptr<Node>);
+        for (auto const& child : node.children)
+            add_overhead(*child, usage);
+    }
+
+private:
+    std::unique_ptr<Node> _root = std::make_unique<Node>();
+    std::size_t           _size{0};
+};
+
+} // namespace reg::internal
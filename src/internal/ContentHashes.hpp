@@ -0,0 +1,171 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "../Id.hpp"
+#include "../RegistryDiff.hpp"
+#include "BPlusTreeMap.hpp"
+
+namespace reg::internal {
+
+/// A hash tree over the content of a registry, that allows us to find the differences between two registries in a time proportional to the number of differences.
+/// Each object is hashed (its id together with the hash of its value) into one of `buckets_count` buckets, chosen from the bits of its id.
+/// Each node of the tree stores the sum of the hashes of all the objects below it: summing makes it possible to update the tree in O(depth) when an object is added, removed or modified,
+/// without having to rehash its siblings. Two registries with the same content always have the same tree, whatever the order in which the objects were created.
+/// NOT Thread-safe: it is only ever accessed while the registry it hashes is locked.
+template<typename T, typename Hash>
+class ContentHashes {
+public:
+    static constexpr std::size_t fan_out       = 16;
+    static constexpr std::size_t levels_count  = 4; // The root, then 16 nodes, then 256 nodes, and finally the 4096 buckets
+    static constexpr std::size_t buckets_count = 4096;
+
+    void insert(Id<T> const& id, T const& value)
+    {
+        auto const hash   = entry_hash(id, value);
+        auto const bucket = bucket_of(id);
+        _buckets[bucket].emplace_back(id, hash);
+        add_to_path(bucket, hash);
+    }
+
+    void erase(Id<T> const& id)
+    {
+        auto const bucket = bucket_of(id);
+        auto&      hashes = _buckets[bucket];
+        auto const it     = std::find_if(hashes.begin(), hashes.end(), [&](auto const& id_and_hash) { return id_and_hash.first == id; });
+        if (it == hashes.end())
+            return;
+        add_to_path(bucket, std::uint64_t{0} - it->second); // The sums wrap around, so subtracting is just adding the opposite
+        *it = hashes.back();
+        hashes.pop_back();
+    }
+
+    void change(Id<T> const& id, T const& value)
+    {
+        auto const bucket = bucket_of(id);
+        auto&      hashes = _buckets[bucket];
+        auto const it     = std::find_if(hashes.begin(), hashes.end(), [&](auto const& id_and_hash) { return id_and_hash.first == id; });
+        if (it == hashes.end())
+        {
+            insert(id, value);
+            return;
+        }
+        auto const new_hash = entry_hash(id, value);
+        add_to_path(bucket, new_hash - it->second);
+        it->second = new_hash;
+    }
+
+    void clear()
+    {
+        _nodes.fill(0);
+        for (auto& hashes : _buckets)
+            hashes.clear();
+    }
+
+    /// The hash of the whole content. Two registries with the same content have the same root hash.
+    [[nodiscard]] auto root_hash() const -> std::uint64_t
+    {
+        return _nodes[0];
+    }
+
+    /// Only descends into the parts of the trees whose hashes differ.
+    static void diff(ContentHashes const& before, ContentHashes const& after, RegistryDiff<T>& differences)
+    {
+        diff_node(before, after, 0, 0, differences);
+    }
+
+private:
+    /// The offset of the first node of each level in `_nodes`.
+    static constexpr std::array<std::size_t, levels_count> level_offsets{0, 1, 1 + 16, 1 + 16 + 256};
+    static constexpr std::size_t                           nodes_count = 1 + 16 + 256 + 4096;
+
+    [[nodiscard]] static auto mix(std::uint64_t x) -> std::uint64_t
+    {
+        // The finalizer of SplitMix64: spreads every input bit over the whole output, so that the sums of hashes don't cancel each other out
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111eb;
+        x ^= x >> 31;
+        return x;
+    }
+
+    [[nodiscard]] static auto entry_hash(Id<T> const& id, T const& value) -> std::uint64_t
+    {
+        auto halves = std::array<std::uint64_t, 2>{};
+        std::memcpy(halves.data(), id.underlying_uuid().as_bytes().data(), sizeof(halves));
+        return mix(halves[0] ^ mix(halves[1] ^ mix(static_cast<std::uint64_t>(std::invoke(Hash{}, value)))));
+    }
+
+    [[nodiscard]] static auto bucket_of(Id<T> const& id) -> std::size_t
+    {
+        auto const bytes = id.underlying_uuid().as_bytes();
+        return static_cast<std::size_t>(bytes[0]) << 4 | static_cast<std::size_t>(bytes[1]) >> 4; // The first 12 bits of a UUID are random, and there are 2^12 buckets
+    }
+
+    void add_to_path(std::size_t bucket, std::uint64_t delta)
+    {
+        auto index = bucket;
+        for (auto level = levels_count; level-- > 0; index /= fan_out)
+            _nodes[level_offsets[level] + index] += delta;
+    }
+
+    static void diff_node(ContentHashes const& before, ContentHashes const& after, std::size_t level, std::size_t index, RegistryDiff<T>& differences)
+    {
+        if (before._nodes[level_offsets[level] + index] == after._nodes[level_offsets[level] + index])
+            return;
+        if (level + 1 < levels_count)
+        {
+            for (std::size_t child = 0; child < fan_out; ++child)
+                diff_node(before, after, level + 1, index * fan_out + child, differences);
+        }
+        else
+        {
+            diff_bucket(before._buckets[index], after._buckets[index], differences);
+        }
+    }
+
+    static void diff_bucket(std::vector<std::pair<Id<T>, std::uint64_t>> before, std::vector<std::pair<Id<T>, std::uint64_t>> after, RegistryDiff<T>& differences)
+    {
+        auto const by_id = [](auto const& a, auto const& b) { return compare_uuids(a.first.underlying_uuid(), b.first.underlying_uuid()) < 0; };
+        std::sort(before.begin(), before.end(), by_id);
+        std::sort(after.begin(), after.end(), by_id);
+
+        auto it_before = before.begin();
+        auto it_after  = after.begin();
+        while (it_before != before.end() || it_after != after.end())
+        {
+            auto const comparison = it_before == before.end() ? 1
+                                    : it_after == after.end() ? -1
+                                                              : compare_uuids(it_before->first.underlying_uuid(), it_after->first.underlying_uuid());
+            if (comparison < 0)
+            {
+                differences.removed.push_back(it_before->first);
+                ++it_before;
+            }
+            else if (comparison > 0)
+            {
+                differences.added.push_back(it_after->first);
+                ++it_after;
+            }
+            else
+            {
+                if (it_before->second != it_after->second)
+                    differences.modified.push_back(it_before->first);
+                ++it_before;
+                ++it_after;
+            }
+        }
+    }
+
+private:
+    std::array<std::uint64_t, nodes_count>                                  _nodes{};   // All the levels of the tree, one after the other. The last level is the sum of each bucket.
+    std::array<std::vector<std::pair<Id<T>, std::uint64_t>>, buckets_count> _buckets{}; // The id and hash of each object, in no particular order
+};
+
+} // namespace reg::internal
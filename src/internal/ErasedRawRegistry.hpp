@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include "../Id.hpp"
+
+namespace reg::internal {
+
+/// A non-owning reference to any kind of raw registry storing `T`s, that only knows what owning ids need from a registry.
+/// This is what allows owning ids to refer to registries with a custom `Map` or `Lock`.
+template<typename T>
+class ErasedRawRegistry {
+public:
+    ErasedRawRegistry() = default;
+    template<typename RawRegistry>
+    explicit ErasedRawRegistry(std::shared_ptr<RawRegistry> const& registry)
+        : _registry{registry}
+        , _destroy{[](void* registry, Id<T> const& id) {
+            static_cast<RawRegistry*>(registry)->destroy(id);
+        }}
+        , _adjust_owning_ids_count{[](void* registry, std::ptrdiff_t delta) {
+            if constexpr (requires { static_cast<RawRegistry*>(registry)->adjust_owning_ids_count(delta); })
+                static_cast<RawRegistry*>(registry)->adjust_owning_ids_count(delta);
+        }}
+        , _adjust_shared_ids_count{[](void* registry, std::ptrdiff_t delta) {
+            if constexpr (requires { static_cast<RawRegistry*>(registry)->adjust_shared_ids_count(delta); })
+                static_cast<RawRegistry*>(registry)->adjust_shared_ids_count(delta);
+        }}
+    {}
+
+    /// Does nothing if the registry has already been destroyed.
+    void destroy(Id<T> const& id) const
+    {
+        if (auto const registry = _registry.lock())
+            _destroy(registry.get(), id);
+    }
+
+    /// Does nothing if the registry has already been destroyed, or doesn't keep track of its owning ids.
+    void adjust_owning_ids_count(std::ptrdiff_t delta) const
+    {
+        if (auto const registry = _registry.lock())
+            _adjust_owning_ids_count(registry.get(), delta);
+    }
+
+    /// Does nothing if the registry has already been destroyed, or doesn't keep track of its owning ids.
+    void adjust_shared_ids_count(std::ptrdiff_t delta) const
+    {
+        if (auto const registry = _registry.lock())
+            _adjust_shared_ids_count(registry.get(), delta);
+    }
+
+private:
+    std::weak_ptr<void> _registry{};
+    void (*_destroy)(void*, Id<T> const&){nullptr};
+    void (*_adjust_owning_ids_count)(void*, std::ptrdiff_t){nullptr};
+    void (*_adjust_shared_ids_count)(void*, std::ptrdiff_t){nullptr};
+};
+
+} // namespace reg::internal
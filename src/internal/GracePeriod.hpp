@@ -0,0 +1,73 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "cpu_relax.hpp"
+#include "current_cpu_slot.hpp"
+
+namespace reg::internal {
+
+/// Allows readers to use a structure without locking it, while writers unlink parts of that structure: before freeing them, writers wait for a "grace period",
+/// i.e. until all the readers that could still see these parts are done (this is a simplified version of the read-copy-update technique).
+/// Readers increment a counter when they start reading and decrement the same counter when they are done. The counters are spread across the CPUs (each in its own cache line),
+/// so that readers running on different CPUs never write to the same cache line. There are two sets of counters: new readers use the current set,
+/// and writers switch to the other set before waiting for the previous one to drain, so that a steady flow of new readers can't make them wait forever.
+class GracePeriod {
+private:
+    struct alignas(64) Counter { // Each counter lives in its own cache line
+        std::atomic<std::uint32_t> value{0};
+    };
+
+public:
+    /// Marks the current thread as a reader until it gets destroyed.
+    class [[nodiscard]] ReadGuard {
+    public:
+        explicit ReadGuard(std::atomic<std::uint32_t>& counter)
+            : _counter{&counter}
+        {
+            _counter->fetch_add(1, std::memory_order_seq_cst); // Must be ordered before the loads of the structure (and the writers' loads of the counters after their stores to the structure)
+        }
+        ~ReadGuard() { _counter->fetch_sub(1, std::memory_order_release); } // Even if we have been moved to another CPU, so that each counter stays balanced
+
+        ReadGuard(ReadGuard const&)                    = delete;
+        auto operator=(ReadGuard const&) -> ReadGuard& = delete;
+        ReadGuard(ReadGuard&&)                         = delete;
+        auto operator=(ReadGuard&&) -> ReadGuard&      = delete;
+
+    private:
+        std::atomic<std::uint32_t>* _counter;
+    };
+
+    /// Thread-safe, lock-free.
+    /// The structure must be loaded with `std::memory_order_seq_cst` while the guard is alive.
+    [[nodiscard]] auto read() const -> ReadGuard
+    {
+        auto const set = _current_set.load(std::memory_order_relaxed);
+        return ReadGuard{_counters[set][current_cpu_slot(counters_count)].value};
+    }
+
+    /// Waits until all the readers that started before this call are done. The parts of the structure that have been unlinked (with `std::memory_order_seq_cst` stores) before this call can then be freed.
+    /// NOT Thread-safe: writers must be serialized. Must not be called by a thread that is currently reading, otherwise it would wait for itself forever.
+    void wait_for_readers()
+    {
+        // A reader that has loaded the index of a set right before we switched it might increment the counters of that set after we have seen them at 0.
+        // It is fine because that reader will then see our modifications of the structure, but it would be wrong for the next writer, that only waits for the other set:
+        // this is why we wait for both sets, one after the other.
+        for (int round = 0; round < 2; ++round)
+        {
+            auto const previous_set = _current_set.load(std::memory_order_relaxed);
+            _current_set.store(1 - previous_set, std::memory_order_relaxed);
+            for (auto const& counter : _counters[previous_set])
+                spin_until([&]() { return counter.value.load(std::memory_order_seq_cst) == 0; });
+        }
+    }
+
+private:
+    static constexpr std::size_t counters_count = 64;
+
+    mutable std::array<std::array<Counter, counters_count>, 2> _counters{};
+    std::atomic<std::size_t>                                   _current_set{0};
+};
+
+} // namespace reg::internal
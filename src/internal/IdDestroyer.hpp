@@ -1,13 +1,32 @@
 #pragma once
+#include <atomic>
+#include <cstddef>
 #include <functional>
+#include <type_traits>
 #include <variant>
 #include "../Id.hpp"
 #include "../RawRegistry.hpp"
+#include "ErasedRawRegistry.hpp"
 
 namespace reg::internal {
 
+/// The default registries are stored by type, which allows ser20 to serialize them along with the owning ids.
+/// All the other registries (e.g. with a custom `Lock`) are type-erased.
 template<typename T>
-using AnyRawRegistry = std::variant<std::weak_ptr<RawRegistry<T>>, std::weak_ptr<RawOrderedRegistry<T>>>;
+using AnyRawRegistry = std::variant<std::weak_ptr<RawRegistry<T>>, std::weak_ptr<RawOrderedRegistry<T>>, ErasedRawRegistry<T>>;
+
+template<typename T, typename SomeRawRegistry>
+auto make_any_raw_registry(std::shared_ptr<SomeRawRegistry> const& registry) -> AnyRawRegistry<T>
+{
+    if constexpr (std::is_same_v<SomeRawRegistry, RawRegistry<T>> || std::is_same_v<SomeRawRegistry, RawOrderedRegistry<T>>)
+        return std::weak_ptr<SomeRawRegistry>{registry};
+    else
+        return ErasedRawRegistry<T>{registry};
+}
+
+/// The memory allocated by `std::make_shared()` for the control block of a `SharedId`, in addition to its `IdDestroyer`.
+/// This is the usual layout of a control block (a pointer to its vtable, and two reference counts), not necessarily the exact one of your standard library.
+inline constexpr std::size_t shared_id_control_block_size = sizeof(void*) + 2 * sizeof(std::atomic<int>);
 
 /// Responsible for destroying the id automatically when it goes out of scope.
 /// It does so by using the `destroy` function that you have to pass to it (this
@@ -19,14 +38,20 @@ public:
     IdDestroyer(Id<T> const& id, AnyRawRegistry<T> registry)
         : _id{id}
         , _registry{std::move(registry)}
-    {}
+    {
+        count_in_registry();
+    }
     ~IdDestroyer()
     {
-        std::visit([&](auto&& registry) {
-            if (auto shared_ptr = registry.lock())
-                shared_ptr->destroy(_id);
-        },
-                   _registry);
+        with_registry([&](auto& registry) {
+            registry.destroy(_id);
+            if (_is_counted)
+            {
+                registry.adjust_owning_ids_count(-1);
+                if (_is_shared)
+                    registry.adjust_shared_ids_count(-1);
+            }
+        });
     }
     IdDestroyer(IdDestroyer const&)                        = delete;
     IdDestroyer(IdDestroyer&&) noexcept                    = delete;
@@ -35,12 +60,58 @@ public:
 
     auto id() const -> Id<T> const& { return _id; }
 
+    /// Lets the registry know that we exist, so that it can take us into account in its `memory_usage()`.
+    /// This function is only meant to be called by the implementation (it is called automatically, including when the id is deserialized).
+    void count_in_registry()
+    {
+        if (_is_counted)
+            return;
+        with_registry([&](auto& registry) {
+            registry.adjust_owning_ids_count(+1);
+            if (_is_shared)
+                registry.adjust_shared_ids_count(+1);
+            _is_counted = true;
+        });
+    }
+
+    /// Lets the registry know that we are owned by a `SharedId`, and therefore live next to the control block of a `std::shared_ptr`.
+    /// This function is only meant to be called by the implementation (it is called automatically, including when the id is deserialized).
+    void mark_as_shared()
+    {
+        if (_is_shared)
+            return;
+        _is_shared = true;
+        if (_is_counted)
+            with_registry([&](auto& registry) { registry.adjust_shared_ids_count(+1); });
+    }
+
     auto underlying_uuid() -> auto& { return _id.underlying_uuid(); }
     auto underlying_registry() -> auto& { return _registry; }
 
+private:
+    /// Calls `callback` with the registry, unless it has already been destroyed.
+    template<typename Callback>
+    void with_registry(Callback&& callback) const
+    {
+        std::visit([&](auto&& registry) {
+            if constexpr (std::is_same_v<std::remove_cvref_t<decltype(registry)>, ErasedRawRegistry<T>>)
+            {
+                callback(registry);
+            }
+            else
+            {
+                if (auto shared_ptr = registry.lock())
+                    callback(*shared_ptr);
+            }
+        },
+                   _registry);
+    }
+
 private:
     Id<T>             _id;
     AnyRawRegistry<T> _registry;
+    bool              _is_counted{false};
+    bool              _is_shared{false};
 };
 
 } // namespace reg::internal
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <uuid.h>
+
+namespace reg::internal {
+
+/// Remembers, for each id, the index of the registry that contains it inside of a `Registries`.
+/// This allows us to go from an `AnyId` to the right registry in a single lookup.
+class IdDirectory {
+public:
+    void insert(uuids::uuid const& uuid, std::size_t registry_index)
+    {
+        std::unique_lock lock{_mutex};
+        _registry_index_from_uuid.insert_or_assign(uuid, registry_index);
+    }
+
+    void erase(uuids::uuid const& uuid, std::size_t registry_index)
+    {
+        std::unique_lock lock{_mutex};
+
+        auto const it = _registry_index_from_uuid.find(uuid);
+        if (it != _registry_index_from_uuid.end() && it->second == registry_index) // The same uuid might have been inserted into several registries
+            _registry_index_from_uuid.erase(it);
+    }
+
+    [[nodiscard]] auto find(uuids::uuid const& uuid) const -> std::optional<std::size_t>
+    {
+        std::shared_lock lock{_mutex};
+
+        auto const it = _registry_index_from_uuid.find(uuid);
+        if (it == _registry_index_from_uuid.end())
+            return std::nullopt;
+
+        return it->second;
+    }
+
+    void clear()
+    {
+        std::unique_lock lock{_mutex};
+        _registry_index_from_uuid.clear();
+    }
+
+private:
+    std::unordered_map<uuids::uuid, std::size_t> _registry_index_from_uuid;
+    mutable std::shared_mutex                    _mutex;
+};
+
+} // namespace reg::internal
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <uuid.h>
+
+namespace reg::internal {
+
+/// A counting Bloom filter over ids, that tells us that an id is definitely not in a registry without having to lock it.
+/// The filter is split into blocks of one cache line each, and all the counters of an id are in the same block, so that a query only touches one cache line.
+/// Each counter is a byte, so that ids can also be removed. A counter that reaches 255 stays there forever (it can't know how many times it has been incremented anymore): this only costs a few false positives.
+/// The counters are only modified while the registry is locked exclusively, but they are atomics because they are read without any lock.
+class MembershipFilter {
+public:
+    /// Uses about 10 bytes per expected object, for roughly 1% of false positives. The filter still works with more objects, but gives more false positives.
+    explicit MembershipFilter(std::size_t expected_objects_count)
+        : _expected_objects_count{expected_objects_count}
+        , _blocks_count{std::bit_ceil(std::max<std::size_t>(expected_objects_count * counters_per_object / counters_per_block, 1))}
+        , _blocks{std::make_unique<Block[]>(_blocks_count)} // NOLINT(*-avoid-c-arrays)
+    {
+    }
+
+    void insert(uuids::uuid const& uuid)
+    {
+        for_each_counter(*this, uuid, [](std::atomic<std::uint8_t>& counter) {
+            auto const value = counter.load(std::memory_order_relaxed);
+            if (value != saturated)
+                counter.store(static_cast<std::uint8_t>(value + 1), std::memory_order_relaxed); // No need for an atomic increment, there is only one writer at a time
+        });
+    }
+
+    void erase(uuids::uuid const& uuid)
+    {
+        for_each_counter(*this, uuid, [](std::atomic<std::uint8_t>& counter) {
+            auto const value = counter.load(std::memory_order_relaxed);
+            if (value != saturated && value != 0)
+                counter.store(static_cast<std::uint8_t>(value - 1), std::memory_order_relaxed);
+        });
+    }
+
+    /// Thread-safe, without any lock.
+    /// Returns false if `uuid` has definitely not been inserted (or has been erased since). Returns true if it probably has.
+    [[nodiscard]] auto may_contain(uuids::uuid const& uuid) const -> bool
+    {
+        auto result = true;
+        for_each_counter(*this, uuid, [&](std::atomic<std::uint8_t> const& counter) {
+            result = result && counter.load(std::memory_order_relaxed) != 0;
+        });
+        return result;
+    }
+
+    void clear()
+    {
+        for (std::size_t i = 0; i < _blocks_count; ++i)
+        {
+            for (auto& counter : _blocks[i].counters)
+                counter.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    [[nodiscard]] auto expected_objects_count() const -> std::size_t { return _expected_objects_count; }
+
+    [[nodiscard]] auto memory_usage() const -> std::size_t
+    {
+        return _blocks_count * sizeof(Block);
+    }
+
+private:
+    static constexpr std::size_t  counters_per_block  = 64;
+    static constexpr std::size_t  counters_per_object = 10;
+    static constexpr std::size_t  hashes_count        = 4;
+    static constexpr std::uint8_t saturated           = 255;
+
+    struct alignas(64) Block {
+        std::array<std::atomic<std::uint8_t>, counters_per_block> counters{};
+    };
+
+    template<typename Self, typename Callback>
+    static void for_each_counter(Self& self, uuids::uuid const& uuid, Callback&& callback)
+    {
+        auto halves = std::array<std::uint64_t, 2>{};
+        std::memcpy(halves.data(), uuid.as_bytes().data(), sizeof(halves));
+        auto const hash = mix(halves[0] ^ mix(halves[1])); // The ids are not always random (e.g. the ones inserted with `insert_raw()`), so we can't use their bits directly
+
+        // The low bits choose the block, and the 24 high bits choose the 4 counters inside the block
+        auto& block = self._blocks[hash & (self._blocks_count - 1)];
+        for (std::size_t i = 0; i < hashes_count; ++i)
+            callback(block.counters[(hash >> (40 + 6 * i)) & (counters_per_block - 1)]);
+    }
+
+    [[nodiscard]] static auto mix(std::uint64_t x) -> std::uint64_t
+    {
+        // The finalizer of SplitMix64
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111eb;
+        x ^= x >> 31;
+        return x;
+    }
+
+private:
+    std::size_t              _expected_objects_count;
+    std::size_t              _blocks_count;
+    std::unique_ptr<Block[]> _blocks; // NOLINT(*-avoid-c-arrays)
+};
+
+} // namespace reg::internal
@@ -0,0 +1,419 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "../MemoryUsage.hpp"
+
+namespace reg::internal {
+
+/// A persistent map from ids to values, implemented as a hash array mapped trie (HAMT) over the bits of the ids' UUIDs.
+/// Copying the map is O(1): the copy shares all its nodes with the original, and both of them only copy the nodes that they modify (and their parents).
+/// This makes `snapshot()` and `restore()` O(1) for a registry using this map, and modifications O(log32(n)).
+/// Since the nodes are shared between several maps, the values can only be modified through `find()` and `try_emplace()` (which copy the nodes they need to),
+/// and the iterators returned by `begin()` only give read-only access to the values.
+/// `Key` must be an `Id<T>`.
+template<typename Key, typename Value>
+class PersistentMap {
+public:
+    using value_type = std::pair<Key const, Value>;
+    /// `find()` copies the leaf it returns if it is shared with another map, so the address of a value can change each time it is modified.
+    static constexpr bool modifications_relocate_values = true;
+
+private:
+    struct Node;
+    using LeafPtr = std::shared_ptr<value_type>;
+    using NodePtr = std::shared_ptr<Node>;
+
+    static constexpr unsigned    bits_per_level = 5;
+    static constexpr std::size_t max_depth      = (128 + bits_per_level - 1) / bits_per_level; // A UUID is 128 bits long
+
+    /// Each of the 32 slots of a node is either empty, or contains a leaf (an entry of the map), or a child node.
+    struct Node {
+        std::uint32_t        leaves_bitmap{0};   // Which slots contain a leaf
+        std::uint32_t        children_bitmap{0}; // Which slots contain a child node
+        std::vector<LeafPtr> leaves{};           // Sorted by slot
+        std::vector<NodePtr> children{};         // Sorted by slot
+
+        [[nodiscard]] auto leaf_index(std::uint32_t bit) const -> std::size_t { return static_cast<std::size_t>(std::popcount(leaves_bitmap & (bit - 1))); }
+        [[nodiscard]] auto child_index(std::uint32_t bit) const -> std::size_t { return static_cast<std::size_t>(std::popcount(children_bitmap & (bit - 1))); }
+    };
+
+    /// One level of the path from the root to the current leaf of an iterator.
+    /// `position` enumerates the leaves of the node, then its children.
+    /// When it refers to a child, this is the next child that we will visit once we are done with the current one.
+    struct Frame {
+        Node const* node{nullptr};
+        std::size_t position{0};
+    };
+
+public:
+    template<bool IsConst>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = PersistentMap::value_type;
+        using difference_type   = std::ptrdiff_t;
+        using reference         = std::conditional_t<IsConst, value_type const&, value_type&>;
+        using pointer           = std::conditional_t<IsConst, value_type const*, value_type*>;
+
+        Iterator() = default;
+        operator Iterator<true>() const // NOLINT(*-explicit-constructor, *-explicit-conversions)
+            requires(!IsConst)
+        {
+            return Iterator<true>{_frames, _depth};
+        }
+
+        [[nodiscard]] auto operator*() const -> reference { return *current_leaf(); }
+        [[nodiscard]] auto operator->() const -> pointer { return current_leaf().get(); }
+
+        auto operator++() -> Iterator&
+        {
+            ++_frames[_depth - 1].position;
+            settle();
+            return *this;
+        }
+        auto operator++(int) -> Iterator
+        {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        template<bool OtherIsConst>
+        [[nodiscard]] auto operator==(Iterator<OtherIsConst> const& other) const -> bool
+        {
+            if (_depth == 0 || other._depth == 0)
+                return _depth == other._depth;
+            return current_leaf() == other.current_leaf();
+        }
+
+    private:
+        friend class PersistentMap;
+        template<bool>
+        friend class Iterator;
+
+        Iterator(std::array<Frame, max_depth + 1> const& frames, std::size_t depth)
+            : _frames{frames}
+            , _depth{depth}
+        {}
+
+        [[nodiscard]] auto current_leaf() const -> LeafPtr const&
+        {
+            auto const& frame = _frames[_depth - 1];
+            return frame.node->leaves[frame.position];
+        }
+
+        void push(Node const* node)
+        {
+            _frames[_depth++] = Frame{node, 0};
+        }
+
+        /// Moves to the next leaf, unless we are already on one.
+        void settle()
+        {
+            while (_depth > 0)
+            {
+                auto&      frame        = _frames[_depth - 1];
+                auto const leaves_count = frame.node->leaves.size();
+                if (frame.position < leaves_count)
+                    return;
+                if (frame.position < leaves_count + frame.node->children.size())
+                {
+                    auto const* child = frame.node->children[frame.position - leaves_count].get();
+                    ++frame.position;
+                    push(child);
+                    continue;
+                }
+                --_depth;
+            }
+        }
+
+    private:
+        std::array<Frame, max_depth + 1> _frames{};
+        std::size_t                      _depth{0}; // 0 means that this is the end iterator
+    };
+
+    using iterator       = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    [[nodiscard]] auto begin() const -> const_iterator
+    {
+        auto it = const_iterator{};
+        if (_root)
+        {
+            it.push(_root.get());
+            it.settle();
+        }
+        return it;
+    }
+    [[nodiscard]] auto end() const -> const_iterator { return {}; }
+    [[nodiscard]] auto cbegin() const -> const_iterator { return begin(); }
+    [[nodiscard]] auto cend() const -> const_iterator { return end(); }
+
+    [[nodiscard]] auto find(Key const& key) const -> const_iterator
+    {
+        auto it = const_iterator{};
+        for (auto const* node = _root.get(); node != nullptr;)
+        {
+            auto const bit = bit_of(key, it._depth);
+            if (node->leaves_bitmap & bit)
+            {
+                auto const index = node->leaf_index(bit);
+                if (node->leaves[index]->first != key)
+                    return end();
+                it._frames[it._depth++] = {node, index};
+                return it;
+            }
+            if (!(node->children_bitmap & bit))
+                return end();
+            auto const index        = node->child_index(bit);
+            it._frames[it._depth++] = {node, node->leaves.size() + index + 1};
+            node                    = node->children[index].get();
+        }
+        return end();
+    }
+
+    /// Copies the nodes leading to `key` if they are shared with other maps, so that you can modify its value through the returned iterator.
+    [[nodiscard]] auto find(Key const& key) -> iterator
+    {
+        if (std::as_const(*this).find(key) == end())
+            return {};
+
+        auto* slot = &_root;
+        for (std::size_t depth = 0;; ++depth)
+        {
+            auto&      node = make_unique(*slot);
+            auto const bit  = bit_of(key, depth);
+            if (node.leaves_bitmap & bit)
+            {
+                auto& leaf = node.leaves[node.leaf_index(bit)];
+                if (leaf.use_count() > 1)
+                    leaf = std::make_shared<value_type>(*leaf);
+                break;
+            }
+            slot = &node.children[node.child_index(bit)];
+        }
+        return mutable_iterator(std::as_const(*this).find(key));
+    }
+
+    /// Same semantics as `std::unordered_map::try_emplace()`: constructs the value in-place from `args`,
+    /// unless `key` is already present in which case nothing happens.
+    template<typename... Args>
+    auto try_emplace(Key const& key, Args&&... args) -> std::pair<iterator, bool>
+    {
+        if (auto const it = std::as_const(*this).find(key); it != end())
+            return {mutable_iterator(it), false};
+
+        auto new_leaf = std::make_shared<value_type>(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        if (!_root)
+            _root = std::make_shared<Node>();
+
+        auto* slot = &_root;
+        for (std::size_t depth = 0;; ++depth)
+        {
+            auto&      node = make_unique(*slot);
+            auto const bit  = bit_of(key, depth);
+            if (node.children_bitmap & bit)
+            {
+                slot = &node.children[node.child_index(bit)];
+                continue;
+            }
+            if (node.leaves_bitmap & bit)
+            {
+                // The slot is already taken by another key: push that key one level down, and try again in the new child node
+                auto const leaf_index = node.leaf_index(bit);
+                auto       child      = std::make_shared<Node>();
+                auto const child_bit  = bit_of(node.leaves[leaf_index]->first, depth + 1);
+                child->leaves_bitmap  = child_bit;
+                child->leaves.push_back(std::move(node.leaves[leaf_index]));
+                node.leaves.erase(node.leaves.begin() + static_cast<std::ptrdiff_t>(leaf_index));
+                node.leaves_bitmap &= ~bit;
+
+                auto const child_index = node.child_index(bit);
+                node.children.insert(node.children.begin() + static_cast<std::ptrdiff_t>(child_index), std::move(child));
+                node.children_bitmap |= bit;
+                slot = &node.children[child_index];
+                continue;
+            }
+            node.leaves.insert(node.leaves.begin() + static_cast<std::ptrdiff_t>(node.leaf_index(bit)), std::move(new_leaf));
+            node.leaves_bitmap |= bit;
+            break;
+        }
+        ++_size;
+        return {mutable_iterator(std::as_const(*this).find(key)), true};
+    }
+
+    /// Returns the number of elements removed (0 or 1).
+    auto erase(Key const& key) -> std::size_t
+    {
+        if (std::as_const(*this).find(key) == end())
+            return 0;
+
+        erase_from(_root, key, 0);
+        if (_root->leaves.empty() && _root->children.empty())
+            _root.reset();
+        --_size;
+        return 1;
+    }
+
+    [[nodiscard]] auto empty() const -> bool { return _size == 0; }
+    [[nodiscard]] auto size() const -> std::size_t { return _size; }
+
+    void clear()
+    {
+        _root.reset();
+        _size = 0;
+    }
+
+    /// NB: the nodes that are shared with other maps (e.g. snapshots) are counted fully in each of these maps.
+    [[nodiscard]] auto memory_usage() const -> MemoryUsage
+    {
+        auto usage = MemoryUsage{
+            .keys   = _size * sizeof(Key),
+            .values = _size * sizeof(Value),
+        };
+        // Each leaf is allocated along with its shared_ptr control block (two reference counts and a vtable pointer), and might contain some padding
+        usage.overhead = _size * (sizeof(value_type) - sizeof(Key) - sizeof(Value) + control_block_size);
+        add_nodes_memory_usage(_root.get(), usage.overhead);
+        return usage;
+    }
+
+    /// Lists the keys that are only in `after`, only in `before`, and in both but with a value that might have been modified.
+    /// This is O(number of differences * log32(n)), because the subtrees that are still shared between the two maps are skipped entirely.
+    /// NB: a value that has been modified and then set back to its previous value will still be reported as modified.
+    static void diff(PersistentMap const& before, PersistentMap const& after, std::vector<Key>& added, std::vector<Key>& removed, std::vector<Key>& modified)
+    {
+        diff_nodes(before._root.get(), after._root.get(), added, removed, modified);
+    }
+
+private:
+    /// Returns the bit corresponding to the slot that `key` occupies at the given depth in the trie.
+    [[nodiscard]] static auto bit_of(Key const& key, std::size_t depth) -> std::uint32_t
+    {
+        auto const bytes      = key.underlying_uuid().as_bytes();
+        auto const first_bit  = depth * bits_per_level;
+        auto const byte_index = first_bit / 8;
+        auto const window     = (static_cast<unsigned>(bytes[byte_index]) << 8) | (byte_index + 1 < bytes.size() ? static_cast<unsigned>(bytes[byte_index + 1]) : 0u);
+        auto const slot       = (window >> (16 - bits_per_level - first_bit % 8)) & ((1u << bits_per_level) - 1);
+        return std::uint32_t{1} << slot;
+    }
+
+    /// Copies `node` if it is shared with another map, so that we can modify it.
+    static auto make_unique(NodePtr& node) -> Node&
+    {
+        if (node.use_count() > 1)
+            node = std::make_shared<Node>(*node);
+        return *node;
+    }
+
+    [[nodiscard]] static auto mutable_iterator(const_iterator const& it) -> iterator
+    {
+        return iterator{it._frames, it._depth}; // Safe because the nodes leading to `it` are not shared with any other map (see `find()` and `try_emplace()`)
+    }
+
+    static void erase_from(NodePtr& slot, Key const& key, std::size_t depth)
+    {
+        auto&      node = make_unique(slot);
+        auto const bit  = bit_of(key, depth);
+        if (node.leaves_bitmap & bit)
+        {
+            node.leaves.erase(node.leaves.begin() + static_cast<std::ptrdiff_t>(node.leaf_index(bit)));
+            node.leaves_bitmap &= ~bit;
+            return;
+        }
+
+        auto const child_index = node.child_index(bit);
+        auto&      child       = node.children[child_index];
+        erase_from(child, key, depth + 1);
+        if (!child->children.empty() || child->leaves.size() > 1)
+            return;
+
+        // Keep the trie compact: a child that is left with a single leaf (or nothing) gets merged back into its parent
+        auto last_leaf = child->leaves.empty() ? LeafPtr{} : std::move(child->leaves.front());
+        node.children.erase(node.children.begin() + static_cast<std::ptrdiff_t>(child_index));
+        node.children_bitmap &= ~bit;
+        if (last_leaf)
+        {
+            node.leaves.insert(node.leaves.begin() + static_cast<std::ptrdiff_t>(node.leaf_index(bit)), std::move(last_leaf));
+            node.leaves_bitmap |= bit;
+        }
+    }
+
+    static constexpr std::size_t control_block_size = 2 * sizeof(long) + sizeof(void*);
+
+    static void add_nodes_memory_usage(Node const* node, std::size_t& overhead)
+    {
+        if (!node)
+            return;
+        overhead += sizeof(Node) + control_block_size
+                    + node->leaves.capacity() * sizeof(LeafPtr)
+                    + node->children.capacity() * sizeof(NodePtr);
+        for (auto const& child : node->children)
+            add_nodes_memory_usage(child.get(), overhead);
+    }
+
+    static void collect_leaves(Node const* node, std::vector<LeafPtr>& leaves)
+    {
+        if (!node)
+            return;
+        leaves.insert(leaves.end(), node->leaves.begin(), node->leaves.end());
+        for (auto const& child : node->children)
+            collect_leaves(child.get(), leaves);
+    }
+
+    static void diff_nodes(Node const* before, Node const* after, std::vector<Key>& added, std::vector<Key>& removed, std::vector<Key>& modified)
+    {
+        if (before == after)
+            return; // This whole subtree is shared, so it is identical in both maps
+
+        for (unsigned slot = 0; slot < (1u << bits_per_level); ++slot)
+        {
+            auto const bit     = std::uint32_t{1} << slot;
+            auto       leaves0 = std::vector<LeafPtr>{}; // What `before` has in this slot
+            auto       leaves1 = std::vector<LeafPtr>{}; // What `after` has in this slot
+            if (before && (before->children_bitmap & bit) && after && (after->children_bitmap & bit))
+            {
+                diff_nodes(before->children[before->child_index(bit)].get(), after->children[after->child_index(bit)].get(), added, removed, modified);
+                continue;
+            }
+            collect_slot(before, bit, leaves0);
+            collect_slot(after, bit, leaves1);
+            for (auto const& leaf : leaves0)
+            {
+                auto const it = std::find_if(leaves1.begin(), leaves1.end(), [&](LeafPtr const& other) { return other->first == leaf->first; });
+                if (it == leaves1.end())
+                    removed.push_back(leaf->first);
+                else if (*it != leaf)
+                    modified.push_back(leaf->first);
+            }
+            for (auto const& leaf : leaves1)
+            {
+                if (std::none_of(leaves0.begin(), leaves0.end(), [&](LeafPtr const& other) { return other->first == leaf->first; }))
+                    added.push_back(leaf->first);
+            }
+        }
+    }
+
+    static void collect_slot(Node const* node, std::uint32_t bit, std::vector<LeafPtr>& leaves)
+    {
+        if (!node)
+            return;
+        if (node->leaves_bitmap & bit)
+            leaves.push_back(node->leaves[node->leaf_index(bit)]);
+        else if (node->children_bitmap & bit)
+            collect_leaves(node->children[node->child_index(bit)].get(), leaves);
+    }
+
+private:
+    NodePtr     _root{};
+    std::size_t _size{0};
+};
+
+} // namespace reg::internal
@@ -0,0 +1,301 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../Id.hpp"
+#include "../generate_uuid.hpp"
+
+namespace reg::internal {
+
+/// The storage of a `HierarchyRegistry`.
+/// All the nodes live in a single vector, and refer to their parent and children by their index in that vector: walking the hierarchy never goes through the map from ids to indices,
+/// and the children of a node are stored contiguously, in the order in which they have been added.
+/// Destroying a node moves the last node of the vector into its slot, so that the vector stays dense.
+template<typename T, typename Lock = std::shared_mutex>
+class RawHierarchyRegistry {
+public:
+    using ValueType = T;
+    using LockType  = Lock;
+
+    static constexpr std::size_t no_parent = std::numeric_limits<std::size_t>::max();
+
+    struct Node {
+        Id<T>                    id;
+        T                        value;
+        std::size_t              parent{no_parent};
+        std::vector<std::size_t> children{};
+    };
+
+    [[nodiscard]] auto get(Id<T> const& id) const -> std::optional<T>
+    {
+        std::shared_lock lock{_mutex};
+
+        auto const index = index_of(id);
+        if (!index)
+            return std::nullopt;
+        return _nodes[*index].value;
+    }
+
+    auto with_ref(Id<T> const& id, std::function<void(T const&)> const& callback) const -> bool
+    {
+        std::shared_lock lock{_mutex};
+
+        auto const index = index_of(id);
+        if (!index)
+            return false;
+        callback(std::as_const(_nodes[*index].value));
+        return true;
+    }
+
+    auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool
+    {
+        std::unique_lock lock{_mutex};
+
+        auto const index = index_of(id);
+        if (!index)
+            return false;
+        callback(_nodes[*index].value);
+        return true;
+    }
+
+    auto set(Id<T> const& id, T value) -> bool
+    {
+        std::unique_lock lock{_mutex};
+
+        auto const index = index_of(id);
+        if (!index)
+            return false;
+        _nodes[*index].value = std::move(value);
+        return true;
+    }
+
+    [[nodiscard]] auto contains(Id<T> const& id) const -> bool
+    {
+        std::shared_lock lock{_mutex};
+        return _indices.contains(id);
+    }
+
+    [[nodiscard]] auto create_raw(T value, std::optional<Id<T>> const& parent) -> Id<T>
+    {
+        auto const id = Id<T>{generate_uuid()};
+
+        std::unique_lock lock{_mutex};
+
+        auto const parent_index = parent ? index_of(*parent) : std::nullopt;
+        if (parent && !parent_index)
+            throw std::runtime_error{"[HierarchyRegistry::create_raw()] The parent is not in the registry"};
+
+        auto const index = _nodes.size();
+        _nodes.push_back(Node{.id = id, .value = std::move(value), .parent = parent_index.value_or(no_parent)});
+        _indices.emplace(id, index);
+        if (parent_index)
+            _nodes[*parent_index].children.push_back(index);
+        return id;
+    }
+
+    [[nodiscard]] auto parent_of(Id<T> const& id) const -> std::optional<Id<T>>
+    {
+        std::shared_lock lock{_mutex};
+
+        auto const index = index_of(id);
+        if (!index || _nodes[*index].parent == no_parent)
+            return std::nullopt;
+        return _nodes[_nodes[*index].parent].id;
+    }
+
+    [[nodiscard]] auto children_of(Id<T> const& id) const -> std::vector<Id<T>>
+    {
+        std::shared_lock lock{_mutex};
+
+        auto children = std::vector<Id<T>>{};
+        if (auto const index = index_of(id))
+        {
+            children.reserve(_nodes[*index].children.size());
+            for (auto const child : _nodes[*index].children)
+                children.push_back(_nodes[child].id);
+        }
+        return children;
+    }
+
+    [[nodiscard]] auto roots() const -> std::vector<Id<T>>
+    {
+        std::shared_lock lock{_mutex};
+
+        auto roots = std::vector<Id<T>>{};
+        for (auto const& node : _nodes)
+        {
+            if (node.parent == no_parent)
+                roots.push_back(node.id);
+        }
+        return roots;
+    }
+
+    auto reparent(Id<T> const& id, std::optional<Id<T>> const& new_parent) -> bool
+    {
+        std::unique_lock lock{_mutex};
+
+        auto const index            = index_of(id);
+        auto const new_parent_index = new_parent ? index_of(*new_parent) : std::nullopt;
+        if (!index || (new_parent && !new_parent_index))
+            return false;
+
+        // Refuse to create a cycle, i.e. to move a node below itself
+        if (new_parent_index)
+        {
+            for (auto ancestor = *new_parent_index; ancestor != no_parent; ancestor = _nodes[ancestor].parent)
+            {
+                if (ancestor == *index)
+                    return false;
+            }
+        }
+
+        detach_from_parent(*index);
+        _nodes[*index].parent = new_parent_index.value_or(no_parent);
+        if (new_parent_index)
+            _nodes[*new_parent_index].children.push_back(*index);
+        return true;
+    }
+
+    template<typename Callback>
+    void for_each_in_subtree(Id<T> const& id, Callback&& callback)
+    {
+        std::unique_lock lock{_mutex};
+        for_each_in_subtree_impl(*this, id, callback);
+    }
+
+    template<typename Callback>
+    void for_each_in_subtree(Id<T> const& id, Callback&& callback) const
+    {
+        std::shared_lock lock{_mutex};
+        for_each_in_subtree_impl(*this, id, callback);
+    }
+
+    auto destroy(Id<T> const& id) -> std::size_t
+    {
+        std::unique_lock lock{_mutex};
+
+        auto const index = index_of(id);
+        if (!index)
+            return 0;
+
+        auto subtree = std::vector<std::size_t>{};
+        collect_subtree(*index, subtree);
+        detach_from_parent(*index);
+
+        // Remove the nodes from the back of the vector to the front: this way, the node that gets moved into a freed slot is never one that we still have to remove
+        std::sort(subtree.begin(), subtree.end(), std::greater<>{});
+        for (auto const removed : subtree)
+            remove_node(removed);
+        return subtree.size();
+    }
+
+    [[nodiscard]] auto is_empty() const -> bool
+    {
+        std::shared_lock lock{_mutex};
+        return _nodes.empty();
+    }
+
+    [[nodiscard]] auto objects_count() const -> std::size_t
+    {
+        std::shared_lock lock{_mutex};
+        return _nodes.size();
+    }
+
+    void clear()
+    {
+        std::unique_lock lock{_mutex};
+        _nodes.clear();
+        _indices.clear();
+    }
+
+    [[nodiscard]] auto mutex() const -> Lock& { return _mutex; }
+
+    [[nodiscard]] auto underlying_container() const -> std::vector<Node> const& { return _nodes; }
+
+private:
+    [[nodiscard]] auto index_of(Id<T> const& id) const -> std::optional<std::size_t>
+    {
+        auto const it = _indices.find(id);
+        if (it == _indices.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    /// Calls `callback(id, value, depth)` on the node at `id` and all its descendants, depth-first, each parent before its children, and the children in order.
+    /// The depth is relative to the node at `id`, which has a depth of 0.
+    template<typename Self, typename Callback>
+    static void for_each_in_subtree_impl(Self& self, Id<T> const& id, Callback& callback)
+    {
+        auto const index = self.index_of(id);
+        if (!index)
+            return;
+
+        auto stack = std::vector<std::pair<std::size_t, std::size_t>>{{*index, 0}}; // The index and the depth of the nodes that we still have to visit
+        while (!stack.empty())
+        {
+            auto const [current, depth] = stack.back();
+            stack.pop_back();
+            auto& node = self._nodes[current];
+            callback(std::as_const(node.id), node.value, depth);
+            for (auto child = node.children.rbegin(); child != node.children.rend(); ++child) // Pushed in reverse order so that the first child is visited first
+                stack.emplace_back(*child, depth + 1);
+        }
+    }
+
+    void collect_subtree(std::size_t index, std::vector<std::size_t>& subtree) const
+    {
+        auto const first = subtree.size();
+        subtree.push_back(index);
+        for (auto i = first; i < subtree.size(); ++i)
+        {
+            for (auto const child : _nodes[subtree[i]].children)
+                subtree.push_back(child);
+        }
+    }
+
+    void detach_from_parent(std::size_t index)
+    {
+        auto const parent = _nodes[index].parent;
+        if (parent == no_parent)
+            return;
+        auto& siblings = _nodes[parent].children;
+        siblings.erase(std::find(siblings.begin(), siblings.end(), index)); // Keeps the order of the other children
+        _nodes[index].parent = no_parent;
+    }
+
+    /// Removes the node at `index`, by moving the last node into its slot. Only the references to the last node need to be updated.
+    void remove_node(std::size_t index)
+    {
+        _indices.erase(_nodes[index].id);
+        auto const last = _nodes.size() - 1;
+        if (index != last)
+        {
+            _nodes[index]      = std::move(_nodes[last]);
+            auto& moved        = _nodes[index];
+            _indices[moved.id] = index;
+            if (moved.parent != no_parent)
+            {
+                auto& siblings                                     = _nodes[moved.parent].children;
+                *std::find(siblings.begin(), siblings.end(), last) = index;
+            }
+            for (auto const child : moved.children)
+                _nodes[child].parent = index;
+        }
+        _nodes.pop_back();
+    }
+
+private:
+    std::vector<Node>                      _nodes;
+    std::unordered_map<Id<T>, std::size_t> _indices;
+    mutable Lock                           _mutex;
+};
+
+} // namespace reg::internal
@@ -1,17 +1,52 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "../Id.hpp"
+#include "../RegistryNode.hpp"
+#include "../ResolvedId.hpp"
 #include "../generate_uuid.hpp"
+#include "AsyncAccess.hpp"
+#include "container_memory_usage.hpp"
+#include "MembershipFilter.hpp"
+#include "RegistryMutex.hpp"
+#include "RegistryObserver.hpp"
+#include "TracedMutex.hpp"
 
 namespace reg::internal {
 
-template<typename T, typename Map>
+/// Each registry gets its own range of 2^32 generations, so that a `ResolvedId` used with another registry than the one it was resolved in never matches its generation by accident.
+inline auto first_generation_of_new_registry() -> std::uint64_t
+{
+    static auto next_registry = std::atomic<std::uint64_t>{1};
+    return next_registry.fetch_add(1, std::memory_order_relaxed) << 32;
+}
+
+/// `Lock` is the type of mutex used to guard the registry. It can be any type that has the same interface as `std::shared_mutex`,
+/// e.g. `reg::NullMutex` if the registry is only used by one thread, or `reg::SpinSharedMutex` / `reg::ReaderBiasedSharedMutex` for very short critical sections.
+template<typename T, typename Map, typename Lock = std::shared_mutex>
 class RawRegistryImpl {
 public:
     /// The type of values stored in this registry.
     using ValueType = T;
+    /// The type of mutex used to guard this registry.
+    using LockType = Lock;
+
+private:
+    /// Maps that share their objects between several copies (e.g. `PersistentMap`) copy an object each time it is modified.
+    static constexpr bool modifications_relocate_values = requires { requires Map::modifications_relocate_values; };
+
+public:
 
     RawRegistryImpl()                                              = default;
     ~RawRegistryImpl()                                             = default;
@@ -21,139 +56,754 @@ public:
     RawRegistryImpl(RawRegistryImpl const&)                    = delete; // This class is non-copyable
     auto operator=(RawRegistryImpl const&) -> RawRegistryImpl& = delete; // because it is the unique owner of the objects it stores
 
+    /// Creates a registry that starts with the content of `snapshot`.
+    /// This is O(1): the storage is shared, and only gets copied once one of its owners modifies it.
+    explicit RawRegistryImpl(std::shared_ptr<Map const> snapshot)
+        : _map{std::const_pointer_cast<Map>(std::move(snapshot))} // Safe because we never modify a map that is shared, see `detach_from_snapshots()`
+    {}
+
     [[nodiscard]] auto get(Id<T> const& id) const -> std::optional<T>
     {
+        trace(TraceOp::Get, id);
+        if (!may_contain(id))
+            return std::nullopt;
         std::shared_lock lock{_mutex};
 
-        auto const it = _map.find(id);
-        if (it == _map.end())
+        auto const it = std::as_const(*_map).find(id);
+        if (it == _map->end())
             return std::nullopt;
 
         return it->second;
     }
 
+    [[nodiscard]] auto get(ResolvedId<T>& id) const -> std::optional<T>
+    {
+        trace(TraceOp::Get, id.id());
+        if (!may_contain(id.id())) // Cheaper than looking the id up, even if its location is cached
+            return std::nullopt;
+        std::shared_lock lock{_mutex};
+
+        auto const* const value = find(id);
+        if (!value)
+            return std::nullopt;
+
+        return *value;
+    }
+
     auto set(Id<T> const& id, T const& value) -> bool
     {
+        trace(TraceOp::Set, id);
+        if (!may_contain(id))
+            return false;
         std::unique_lock lock{_mutex};
+        return assign(id, find_mutable(id), value);
+    }
 
-        auto it = _map.find(id);
-        if (it == _map.end())
+    auto set(Id<T> const& id, T&& value) -> bool
+    {
+        trace(TraceOp::Set, id);
+        if (!may_contain(id))
             return false;
+        std::unique_lock lock{_mutex};
+        return assign(id, find_mutable(id), std::move(value));
+    }
 
-        it->second = value;
-        return true;
+    auto set(ResolvedId<T>& id, T const& value) -> bool
+    {
+        trace(TraceOp::Set, id.id());
+        if (!may_contain(id.id()))
+            return false;
+        std::unique_lock lock{_mutex};
+        return assign(id.id(), find_mutable(id), value);
+    }
+
+    auto set(ResolvedId<T>& id, T&& value) -> bool
+    {
+        trace(TraceOp::Set, id.id());
+        if (!may_contain(id.id()))
+            return false;
+        std::unique_lock lock{_mutex};
+        return assign(id.id(), find_mutable(id), std::move(value));
     }
 
     [[nodiscard]] auto contains(Id<T> const& id) const -> bool
     {
+        trace(TraceOp::Contains, id);
+        if (!may_contain(id))
+            return false;
         std::shared_lock lock{_mutex};
 
-        auto const it = _map.find(id);
-        return it != _map.end();
+        auto const it = std::as_const(*_map).find(id);
+        return it != _map->end();
+    }
+
+    [[nodiscard]] auto contains(ResolvedId<T>& id) const -> bool
+    {
+        trace(TraceOp::Contains, id.id());
+        if (!may_contain(id.id()))
+            return false;
+        std::shared_lock lock{_mutex};
+        return find(id) != nullptr;
     }
 
     auto with_ref(Id<T> const& id, std::function<void(T const&)> const& callback) const -> bool
     {
+        trace(TraceOp::WithRef, id);
+        if (!may_contain(id))
+            return false;
         std::shared_lock lock{_mutex};
 
-        auto const it = _map.find(id);
-        if (it == _map.end())
+        auto const it = std::as_const(*_map).find(id);
+        if (it == _map->end())
             return false;
 
         callback(it->second);
         return true;
     }
 
+    auto with_ref(ResolvedId<T>& id, std::function<void(T const&)> const& callback) const -> bool
+    {
+        trace(TraceOp::WithRef, id.id());
+        if (!may_contain(id.id()))
+            return false;
+        std::shared_lock lock{_mutex};
+
+        auto const* const value = find(id);
+        if (!value)
+            return false;
+
+        callback(*value);
+        return true;
+    }
+
     auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool
     {
+        trace(TraceOp::WithMutableRef, id);
+        if (!may_contain(id))
+            return false;
         std::unique_lock lock{_mutex};
+        return modify(id, find_mutable(id), callback);
+    }
 
-        auto const it = _map.find(id);
-        if (it == _map.end())
+    auto with_mutable_ref(ResolvedId<T>& id, std::function<void(T&)> const& callback) -> bool
+    {
+        trace(TraceOp::WithMutableRef, id.id());
+        if (!may_contain(id.id()))
             return false;
+        std::unique_lock lock{_mutex};
+        return modify(id.id(), find_mutable(id), callback);
+    }
 
-        callback(it->second);
-        return true;
+    /// Only available if `Lock` can be awaited by coroutines, e.g. `reg::AsyncSharedMutex`. The result must be `co_await`ed right away.
+    [[nodiscard]] auto async_with_ref(Id<T> const& id, std::function<void(T const&)> callback) const
+        requires AwaitableLock<Lock>
+    {
+        trace(TraceOp::WithRef, id);
+        return AsyncAccess{_mutex.async_lock_shared(), [this, id, callback = std::move(callback)]() {
+                               std::shared_lock lock{_mutex, std::adopt_lock};
+
+                               auto const it = std::as_const(*_map).find(id);
+                               if (it == _map->end())
+                                   return false;
+
+                               callback(it->second);
+                               return true;
+                           }};
+    }
+
+    /// Only available if `Lock` can be awaited by coroutines, e.g. `reg::AsyncSharedMutex`. The result must be `co_await`ed right away.
+    [[nodiscard]] auto async_with_mutable_ref(Id<T> const& id, std::function<void(T&)> callback)
+        requires AwaitableLock<Lock>
+    {
+        trace(TraceOp::WithMutableRef, id);
+        return AsyncAccess{_mutex.async_lock(), [this, id, callback = std::move(callback)]() {
+                               std::unique_lock lock{_mutex, std::adopt_lock};
+                               return modify(id, find_mutable(id), callback);
+                           }};
     }
 
     [[nodiscard]] auto get_ref(Id<T> const& id) const -> T const*
     {
-        auto const it = _map.find(id);
-        if (it == _map.end())
+        trace(TraceOp::GetRef, id);
+        auto const it = std::as_const(*_map).find(id);
+        if (it == _map->end())
             return nullptr;
 
         return &it->second;
     }
 
+    [[nodiscard]] auto get_ref(ResolvedId<T>& id) const -> T const*
+    {
+        trace(TraceOp::GetRef, id.id());
+        return find(id);
+    }
+
+    /// Must be called while the registry is locked exclusively (or while no other thread uses it).
+    /// Detaches the storage from the snapshots first, in case the registry has not been locked through `mutex()`.
     [[nodiscard]] auto get_mutable_ref(Id<T> const& id) -> T*
     {
-        auto it = _map.find(id);
-        if (it == _map.end())
-            return nullptr;
+        trace(TraceOp::GetMutableRef, id);
+        detach_from_snapshots();
+        return find_mutable(id);
+    }
 
-        return &it->second;
+    [[nodiscard]] auto get_mutable_ref(ResolvedId<T>& id) -> T*
+    {
+        trace(TraceOp::GetMutableRef, id.id());
+        detach_from_snapshots();
+        return find_mutable(id);
+    }
+
+    /// Looks `id` up and caches its location, see `ResolvedId`.
+    [[nodiscard]] auto resolve(Id<T> const& id) const -> ResolvedId<T>
+    {
+        std::shared_lock lock{_mutex};
+
+        auto resolved = ResolvedId<T>{id};
+        std::ignore   = find(resolved);
+        return resolved;
     }
 
     [[nodiscard]] auto create_raw(T const& value) -> Id<T>
     {
-        auto const id = Id<T>{generate_uuid()};
-        insert_raw(id, value);
-        return id;
+        return emplace_raw(value);
     }
 
     [[nodiscard]] auto create_raw(T&& value) -> Id<T>
+    {
+        return emplace_raw(std::move(value));
+    }
+
+    template<typename... Args>
+    [[nodiscard]] auto emplace_raw(Args&&... args) -> Id<T>
     {
         auto const id = Id<T>{generate_uuid()};
-        insert_raw(id, std::move(value));
+        emplace_raw_at(id, std::forward<Args>(args)...);
         return id;
     }
 
     void insert_raw(Id<T> const& id, T const& value)
     {
-        std::unique_lock lock{_mutex};
-        _map.insert({id, value});
+        emplace_raw_at(id, value);
     }
 
     void insert_raw(Id<T> const& id, T&& value)
+    {
+        emplace_raw_at(id, std::move(value));
+    }
+
+    /// Constructs the value in-place, directly inside the map.
+    /// Does nothing if `id` is already present in the registry.
+    template<typename... Args>
+    void emplace_raw_at(Id<T> const& id, Args&&... args)
+    {
+        trace(TraceOp::Create, id);
+        std::unique_lock lock{_mutex};
+
+        auto const [it, has_been_inserted] = _map->try_emplace(id, std::forward<Args>(args)...);
+        if (has_been_inserted)
+        {
+            ++_generation;
+            after_insertion(it);
+        }
+    }
+
+    /// Inserts all the (id, value) pairs of `entries`, moving the values out of them.
+    /// Only locks the registry once, and reserves memory for all the new entries upfront when the map supports it.
+    template<typename Range>
+    void insert_raw_range(Range&& entries)
     {
         std::unique_lock lock{_mutex};
-        _map.insert({id, std::move(value)});
+
+        if constexpr (requires { _map->reserve(_map->size() + std::size(entries)); })
+            _map->reserve(_map->size() + std::size(entries));
+        for (auto&& [id, value] : entries)
+        {
+            trace(TraceOp::Create, id);
+            auto const [it, has_been_inserted] = _map->try_emplace(id, std::move(value));
+            if (has_been_inserted)
+            {
+                ++_generation;
+                after_insertion(it);
+            }
+        }
     }
 
     void destroy(Id<T> const& id)
     {
+        trace(TraceOp::Destroy, id);
+        if (!may_contain(id))
+            return;
+        std::unique_lock lock{_mutex};
+
+        if (!_observers.empty() || _membership_filter)
+        {
+            auto const it = std::as_const(*_map).find(id);
+            if (it == _map->end())
+                return;
+            notify_erase(id, it->second);
+        }
+        if (_map->erase(id) != 0)
+            ++_generation;
+    }
+
+    /// Removes the object from the registry without destroying it, see `RegistryNode`.
+    [[nodiscard]] auto extract(Id<T> const& id) -> RegistryNode<T, Map>
+    {
+        trace(TraceOp::Destroy, id);
         std::unique_lock lock{_mutex};
+        return extract_locked(id);
+    }
 
-        _map.erase(id);
+    /// Returns false (and leaves the object in `node`) if `node` is empty or if its id is already present in the registry.
+    template<typename NodeMap>
+    auto insert(RegistryNode<T, NodeMap>&& node) -> bool
+    {
+        if (node.empty())
+            return false;
+
+        trace(TraceOp::Create, node.id());
+        std::unique_lock lock{_mutex};
+        return insert_locked(node);
+    }
+
+    /// Moves the object referenced by `id` into `destination`, where it keeps the same id.
+    /// Both registries are locked together (in a deadlock-free way), so other threads always see the object in exactly one of them.
+    /// Returns false if `id` doesn't refer to an object in this registry, or if it is already present in `destination`.
+    template<typename OtherMap, typename OtherLock>
+    auto transfer(Id<T> const& id, RawRegistryImpl<T, OtherMap, OtherLock>& destination) -> bool
+    {
+        if (static_cast<void const*>(&destination) == static_cast<void const*>(this))
+            return contains(id);
+
+        trace(TraceOp::Destroy, id);
+        destination.trace(TraceOp::Create, id);
+        std::scoped_lock lock{_mutex, destination._mutex};
+
+        if (std::as_const(*destination._map).find(id) != destination._map->end())
+            return false;
+        auto node = extract_locked(id);
+        if (node.empty())
+            return false;
+        try
+        {
+            std::ignore = destination.insert_locked(node);
+        }
+        catch (...) // Refused by the validators of `destination`: we put the object back where it was
+        {
+            std::ignore = insert_locked(node);
+            throw;
+        }
+        return true;
     }
 
     [[nodiscard]] auto is_empty() const -> bool
     {
         std::shared_lock lock{_mutex};
-        return _map.empty();
+        return _map->empty();
     }
 
     void clear()
     {
+        trace(TraceOp::Clear);
         std::unique_lock lock{_mutex};
-        _map.clear();
+        if (!_observers.empty())
+        {
+            for (auto const& [id, value] : *_map)
+                notify_erase(id, value);
+        }
+        if (_membership_filter)
+            _membership_filter->clear();
+        _map->clear();
+        ++_generation;
     }
 
-    [[nodiscard]] auto begin() { return _map.begin(); }
-    [[nodiscard]] auto end() { return _map.end(); }
-    [[nodiscard]] auto begin() const { return _map.begin(); }
-    [[nodiscard]] auto end() const { return _map.end(); }
-    [[nodiscard]] auto cbegin() const { return _map.cbegin(); }
-    [[nodiscard]] auto cend() const { return _map.cend(); }
+    /// Makes room for at least `capacity` objects, so that creating them won't need to reallocate the storage (does nothing for maps that can't reserve).
+    void reserve(std::size_t capacity)
+    {
+        std::unique_lock lock{_mutex};
+        if constexpr (requires { _map->reserve(capacity); })
+            _map->reserve(capacity);
+    }
 
-    [[nodiscard]] auto mutex() const -> std::shared_mutex& { return _mutex; }
+    /// Gives the unused memory back to the system (e.g. after a `clear()`).
+    void shrink_to_fit()
+    {
+        std::unique_lock lock{_mutex};
+        if constexpr (requires { _map->shrink_to_fit(); })
+            _map->shrink_to_fit();
+        else if constexpr (requires { _map->rehash(0); })
+            _map->rehash(0); // Shrinks the buckets array to the smallest size that can hold the current objects
+    }
 
-    [[nodiscard]] auto underlying_container() const -> Map const& { return _map; }
-    [[nodiscard]] auto underlying_container() -> Map& { return _map; }
+    /// Only counts the storage, see `owning_ids_count()` for the rest.
+    [[nodiscard]] auto memory_usage() const -> MemoryUsage
+    {
+        std::shared_lock lock{_mutex};
+        auto usage = container_memory_usage(std::as_const(*_map));
+        if (_membership_filter)
+            usage.overhead += _membership_filter->memory_usage();
+        return usage;
+    }
+
+    /// The number of `UniqueId`s and `SharedId`s that currently refer to objects in this registry (all the copies of a `SharedId` count as one, since they share the same `IdDestroyer`).
+    [[nodiscard]] auto owning_ids_count() const -> std::size_t
+    {
+        return _owning_ids_count.load(std::memory_order_relaxed);
+    }
+
+    /// Among the `owning_ids_count()`, the number of `SharedId`s, which also allocate the control block of their `std::shared_ptr`.
+    [[nodiscard]] auto shared_ids_count() const -> std::size_t
+    {
+        return _shared_ids_count.load(std::memory_order_relaxed);
+    }
+
+    /// Called by the owning ids when they are created and destroyed, so that we can take them into account in `memory_usage()`.
+    void adjust_owning_ids_count(std::ptrdiff_t delta)
+    {
+        _owning_ids_count.fetch_add(static_cast<std::size_t>(delta), std::memory_order_relaxed); // Wraps around correctly for negative deltas
+    }
+
+    /// Called by the `SharedId`s when they are created and destroyed, in addition to `adjust_owning_ids_count()`.
+    void adjust_shared_ids_count(std::ptrdiff_t delta)
+    {
+        _shared_ids_count.fetch_add(static_cast<std::size_t>(delta), std::memory_order_relaxed); // Wraps around correctly for negative deltas
+    }
+
+    /// NOT Thread-safe: observers should be added right after creating the registry, before it is shared with other threads.
+    void add_observer(RegistryObserver<T> observer)
+    {
+        _has_validators = _has_validators || static_cast<bool>(observer.validate);
+        _observers.push_back(std::move(observer));
+    }
+
+    /// NOT Thread-safe, just like `add_observer()`.
+    /// Removes all the observers that have been added with this `owner`.
+    void remove_observers(void const* owner)
+    {
+        std::erase_if(_observers, [&](RegistryObserver<T> const& observer) { return observer.owner == owner; });
+        _has_validators = std::any_of(_observers.begin(), _observers.end(), [](RegistryObserver<T> const& observer) { return static_cast<bool>(observer.validate); });
+    }
+
+    /// NOT Thread-safe: the filter should be enabled right after creating the registry, before it is shared with other threads.
+    /// Starts maintaining a `MembershipFilter` sized for `expected_objects_count` objects, that lets `get()`, `contains()`, `with_ref()`, `with_mutable_ref()`, `set()` and `destroy()`
+    /// return right away, without locking the registry, for most of the ids that are not in it.
+    void enable_membership_filter(std::size_t expected_objects_count)
+    {
+        _membership_filter = std::make_shared<MembershipFilter>(expected_objects_count);
+        rebuild_membership_filter();
+    }
+
+    /// NOT Thread-safe.
+    /// Refills the filter from the current content of the registry. You only need to call this if you modified the `underlying_container()` directly (our ser20 functions already call this for you).
+    void rebuild_membership_filter()
+    {
+        if (!_membership_filter)
+            return;
+        _membership_filter->clear();
+        for (auto const& [id, value] : std::as_const(*_map))
+            _membership_filter->insert(id.underlying_uuid());
+    }
+
+    [[nodiscard]] auto has_membership_filter() const -> bool { return _membership_filter != nullptr; }
+
+    /// NOT Thread-safe.
+    /// Gives us the observers, the membership filter (with the same size, refilled from our own content) and the trace recorder of `previous`, that we are replacing.
+    /// Our ser20 functions call this when loading a `Registry`, because that creates a new `RawRegistryImpl` instead of loading into the existing one.
+    void copy_settings_from(RawRegistryImpl const& previous)
+    {
+        _observers      = previous._observers;
+        _has_validators = previous._has_validators;
+        if (previous._membership_filter)
+            enable_membership_filter(previous._membership_filter->expected_objects_count());
+        _trace_recorder = previous._trace_recorder;
+    }
+
+    /// Modifying the objects through these iterators requires an exclusive lock of `mutex()`, which detaches the storage from the snapshots.
+    /// They don't detach it themselves, because they are also used to read the registry under a shared lock, while other readers might be using the storage too.
+    [[nodiscard]] auto begin()
+    {
+        trace(TraceOp::Iterate);
+        return _map->begin();
+    }
+    [[nodiscard]] auto end() { return _map->end(); }
+    [[nodiscard]] auto begin() const
+    {
+        trace(TraceOp::Iterate);
+        return std::as_const(*_map).begin();
+    }
+    [[nodiscard]] auto end() const { return std::as_const(*_map).end(); }
+    [[nodiscard]] auto cbegin() const
+    {
+        trace(TraceOp::Iterate);
+        return _map->cbegin();
+    }
+    [[nodiscard]] auto cend() const { return _map->cend(); }
+
+    /// Manual locks of this mutex are recorded by the `TraceRecorder` (if any).
+    [[nodiscard]] auto mutex() const -> TracedMutex<RegistryMutex<RawRegistryImpl, Lock>>& { return _traced_mutex; }
+
+    /// NOT Thread-safe: the recorder should be set before the registry is shared with other threads.
+    /// Starts recording all the operations done on this registry (pass nullptr to stop recording).
+    void set_trace_recorder(std::shared_ptr<TraceRecorder> recorder)
+    {
+        _trace_recorder = std::move(recorder);
+    }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe (a shared lock is enough).
+    /// Returns a copy-on-write view of the current content of the registry, which won't be affected by future modifications of the registry.
+    /// This is O(1): the registry will only copy its storage the next time it gets locked exclusively, or accessed through `get_mutable_ref()` (if the snapshot is still alive by then).
+    [[nodiscard]] auto snapshot() const -> std::shared_ptr<Map const>
+    {
+        static_assert(std::is_copy_constructible_v<T>, "Only registries of copyable types can be snapshotted");
+        return _map;
+    }
+
+    /// Thread-safe.
+    /// Replaces the content of the registry with `snapshot`, which you got from `snapshot()` (on this registry or any other registry of the same type).
+    /// This is O(1), just like `snapshot()` (unless there are observers, which we need to notify about every object that is removed and added).
+    void restore(std::shared_ptr<Map const> snapshot)
+    {
+        std::unique_lock lock{_mutex.underlying_mutex()}; // No need to detach from the snapshots, we won't modify the current map, we will just stop using it
+        for (auto const& [id, value] : std::as_const(*_map))
+            notify_erase(id, value);
+        _map = std::const_pointer_cast<Map>(std::move(snapshot)); // Safe because we never modify a map that is shared, see `detach_from_snapshots()`
+        ++_generation;
+        for (auto const& [id, value] : std::as_const(*_map))
+            notify_insert(id, value);
+    }
+
+    /// Called by our mutex each time it gets locked exclusively, and by `get_mutable_ref()`, i.e. whenever the registry is about to be modified.
+    /// Must only be called under an exclusive lock, because it replaces `_map`, which the readers holding a shared lock are using.
+    void detach_from_snapshots()
+    {
+        if constexpr (std::is_copy_constructible_v<T>)
+        {
+            if (_map.use_count() > 1) // Some snapshots are still reading our storage, so we must not modify it
+            {
+                _map = std::make_shared<Map>(std::as_const(*_map));
+                ++_generation;
+            }
+        }
+    }
+
+    [[nodiscard]] auto underlying_container() const -> Map const& { return *_map; }
+    /// Just like the non-const iterators, modifying the container requires an exclusive lock of `mutex()`.
+    [[nodiscard]] auto underlying_container() -> Map& { return *_map; }
+
+private:
+    template<typename SomeType, typename SomeMap, typename SomeLock>
+    friend class RawRegistryImpl;
+
+    void trace(TraceOp op, Id<T> const& id = {}) const
+    {
+        if (_trace_recorder)
+            _trace_recorder->record(op, id.underlying_uuid());
+    }
+
+    /// Thread-safe, without locking the registry.
+    /// Returns false if `id` is definitely not in the registry. Always returns true if there is no membership filter.
+    [[nodiscard]] auto may_contain(Id<T> const& id) const -> bool
+    {
+        return !_membership_filter || _membership_filter->may_contain(id.underlying_uuid());
+    }
+
+    /// Must be called while the registry is locked (a shared lock is enough).
+    /// Returns the object referenced by `id`, or null if there is none, using the location cached in `id` if the structure of the registry hasn't changed since it was cached.
+    [[nodiscard]] auto find(ResolvedId<T>& id) const -> T const*
+    {
+        if (id._generation != _generation)
+        {
+            auto const it  = std::as_const(*_map).find(id._id);
+            id._value      = it == _map->end() ? nullptr : &it->second;
+            id._generation = _generation;
+        }
+        return id._value;
+    }
+
+    /// Must be called while the registry is locked exclusively.
+    [[nodiscard]] auto find_mutable(Id<T> const& id) -> T*
+    {
+        if constexpr (modifications_relocate_values)
+            ++_generation; // The map is about to copy the object somewhere else, so the locations cached in the `ResolvedId`s won't be valid anymore
+        auto const it = _map->find(id);
+        if (it == _map->end())
+            return nullptr;
+
+        return &it->second;
+    }
+
+    /// Must be called while the registry is locked exclusively.
+    [[nodiscard]] auto find_mutable(ResolvedId<T>& id) -> T*
+    {
+        if constexpr (modifications_relocate_values)
+            return find_mutable(id._id);
+        else
+            return const_cast<T*>(find(id)); // NOLINT(*-const-cast) The objects stored in the map are not const, we only cached a pointer-to-const
+    }
+
+    template<typename Value>
+    auto assign(Id<T> const& id, T* target, Value&& value) -> bool
+    {
+        if (!target)
+            return false;
+
+        validate(id, value);
+        *target = std::forward<Value>(value);
+        notify_change(id, *target);
+        return true;
+    }
+
+    auto modify(Id<T> const& id, T* target, std::function<void(T&)> const& callback) -> bool
+    {
+        if (!target)
+            return false;
+
+        if constexpr (std::is_copy_constructible_v<T>)
+        {
+            if (_has_validators)
+            {
+                auto backup = *target; // Allows us to restore the value if the validators refuse the new one
+                callback(*target);
+                try
+                {
+                    validate(id, *target);
+                }
+                catch (...)
+                {
+                    *target = std::move(backup);
+                    throw;
+                }
+                notify_change(id, *target);
+                return true;
+            }
+        }
+        callback(*target);
+        notify_change(id, *target);
+        return true;
+    }
+
+    /// Must be called while the registry is locked exclusively.
+    [[nodiscard]] auto extract_locked(Id<T> const& id) -> RegistryNode<T, Map>
+    {
+        auto       node = RegistryNode<T, Map>{};
+        auto const it   = std::as_const(*_map).find(id);
+        if (it == _map->end())
+            return node;
+
+        notify_erase(id, it->second);
+        if constexpr (RegistryNode<T, Map>::holds_map_node)
+        {
+            node._storage = _map->extract(it);
+        }
+        else
+        {
+            node._storage.emplace(id, std::move(_map->find(id)->second)); // The non-const `find()` makes sure that we don't steal the value from a snapshot
+            _map->erase(id);
+        }
+        ++_generation;
+        return node;
+    }
+
+    /// Must be called while the registry is locked exclusively.
+    /// The object is validated before being inserted, so that `node` still owns it if it gets refused.
+    template<typename NodeMap>
+    [[nodiscard]] auto insert_locked(RegistryNode<T, NodeMap>& node) -> bool
+    {
+        auto const id = node.id();
+        if (std::as_const(*_map).find(id) != _map->end())
+            return false;
+
+        validate(id, node.value());
+        auto const it = [&]() {
+            if constexpr (std::is_same_v<typename RegistryNode<T, NodeMap>::Storage, typename RegistryNode<T, Map>::Storage> && RegistryNode<T, Map>::holds_map_node)
+            {
+                return _map->insert(std::move(node._storage)).position; // Reuses the allocation of the node
+            }
+            else
+            {
+                auto const position = _map->try_emplace(id, std::move(node.value())).first;
+                node._storage       = {};
+                return position;
+            }
+        }();
+        ++_generation;
+        notify_insert(id, it->second);
+        return true;
+    }
+
+    /// Validates the object that has just been inserted (and removes it if it is refused), then notifies the observers.
+    template<typename Iterator>
+    void after_insertion(Iterator const& it)
+    {
+        if (_has_validators)
+        {
+            try
+            {
+                validate(it->first, it->second);
+            }
+            catch (...)
+            {
+                _map->erase(it->first);
+                throw;
+            }
+        }
+        notify_insert(it->first, it->second);
+    }
+
+    void validate(Id<T> const& id, T const& value) const
+    {
+        if (!_has_validators)
+            return;
+        for (auto const& observer : _observers)
+        {
+            if (observer.validate)
+                observer.validate(id, value);
+        }
+    }
+
+    void notify_insert(Id<T> const& id, T const& value) const
+    {
+        if (_membership_filter)
+            _membership_filter->insert(id.underlying_uuid());
+        for (auto const& observer : _observers)
+        {
+            if (observer.on_insert)
+                observer.on_insert(id, value);
+        }
+    }
+
+    void notify_erase(Id<T> const& id, T const& value) const
+    {
+        if (_membership_filter)
+            _membership_filter->erase(id.underlying_uuid());
+        for (auto const& observer : _observers)
+        {
+            if (observer.on_erase)
+                observer.on_erase(id, value);
+        }
+    }
+
+    void notify_change(Id<T> const& id, T const& value) const
+    {
+        for (auto const& observer : _observers)
+        {
+            if (observer.on_change)
+                observer.on_change(id, value);
+        }
+    }
 
 private:
-    Map                       _map;
-    mutable std::shared_mutex _mutex;
+    std::shared_ptr<Map>                                      _map = std::make_shared<Map>();
+    mutable RegistryMutex<RawRegistryImpl, Lock>              _mutex{*this};
+    std::shared_ptr<TraceRecorder>                            _trace_recorder{};
+    mutable TracedMutex<RegistryMutex<RawRegistryImpl, Lock>> _traced_mutex{_mutex, _trace_recorder};
+    std::vector<RegistryObserver<T>>                          _observers;
+    std::shared_ptr<MembershipFilter>                         _membership_filter{}; // Updated along with the observers, and read without locking the registry
+    bool                                                      _has_validators{false};
+    std::atomic<std::size_t>                                  _owning_ids_count{0};
+    std::atomic<std::size_t>                                  _shared_ids_count{0};
+    std::uint64_t                                             _generation{first_generation_of_new_registry()}; // Changes each time the map moves its objects around, which invalidates the locations cached in the `ResolvedId`s
 };
 
 } // namespace reg::internal
\ No newline at end of file
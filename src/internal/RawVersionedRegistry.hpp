@@ -0,0 +1,249 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../Id.hpp"
+#include "../generate_uuid.hpp"
+#include "GracePeriod.hpp"
+#include "SeqlockCell.hpp"
+
+namespace reg {
+
+/// A value along with its version, as returned by `VersionedRegistry::get_versioned()`.
+template<typename T>
+struct Versioned {
+    T             value;
+    std::uint64_t version;
+};
+
+} // namespace reg
+
+namespace reg::internal {
+
+/// The storage of a `VersionedRegistry`.
+/// Each object lives in its own node, that owns the `SeqlockCell` guarding its value. Readers find the nodes through an open-addressing hash table of atomic pointers,
+/// without locking anything: reading and modifying the values of existing objects never waits for the creation and destruction of other objects.
+/// `_mutex` is only locked (exclusively) by the functions that create and destroy objects. They never modify a table that readers could be using in a way that would confuse them:
+/// they fill empty slots, replace destroyed objects with a tombstone, and when the table is full they publish a bigger copy of it.
+/// The nodes and tables that they unlink are only freed after a grace period, once no reader can still be using them (see `GracePeriod`).
+template<typename T, typename Lock = std::shared_mutex>
+class RawVersionedRegistry {
+public:
+    using ValueType = T;
+    using LockType  = Lock;
+
+    struct Node {
+        Node(Id<T> const& id_, T const& value)
+            : id{id_}
+            , cell{value}
+        {}
+
+        Id<T>          id;
+        SeqlockCell<T> cell;
+    };
+
+    RawVersionedRegistry() = default;
+    ~RawVersionedRegistry()
+    {
+        delete _table.load(std::memory_order_relaxed); // NOLINT(*-owning-memory)
+    }
+    RawVersionedRegistry(RawVersionedRegistry const&)                    = delete;
+    auto operator=(RawVersionedRegistry const&) -> RawVersionedRegistry& = delete;
+    RawVersionedRegistry(RawVersionedRegistry&&)                         = delete;
+    auto operator=(RawVersionedRegistry&&) -> RawVersionedRegistry&      = delete;
+
+    [[nodiscard]] auto get_versioned(Id<T> const& id) const -> std::optional<Versioned<T>>
+    {
+        auto const  guard = _grace_period.read();
+        auto* const node  = find(id);
+        if (!node)
+            return std::nullopt;
+
+        auto const [value, version] = node->cell.load();
+        return Versioned<T>{value, version};
+    }
+
+    auto set(Id<T> const& id, T const& value) -> bool
+    {
+        auto const  guard = _grace_period.read();
+        auto* const node  = find(id);
+        if (!node)
+            return false;
+
+        node->cell.store(value);
+        return true;
+    }
+
+    auto compare_and_set(Id<T> const& id, std::uint64_t expected_version, T const& value) -> bool
+    {
+        auto const  guard = _grace_period.read();
+        auto* const node  = find(id);
+        if (!node)
+            return false;
+
+        return node->cell.compare_and_set(expected_version, value);
+    }
+
+    auto with_mutable_ref(Id<T> const& id, std::function<void(T&)> const& callback) -> bool
+    {
+        auto const  guard = _grace_period.read();
+        auto* const node  = find(id);
+        if (!node)
+            return false;
+
+        node->cell.modify(callback);
+        return true;
+    }
+
+    [[nodiscard]] auto contains(Id<T> const& id) const -> bool
+    {
+        auto const guard = _grace_period.read();
+        return find(id) != nullptr;
+    }
+
+    [[nodiscard]] auto create_raw(T const& value) -> Id<T>
+    {
+        auto const id   = Id<T>{generate_uuid()};
+        auto       node = std::make_unique<Node>(id, value);
+
+        std::unique_lock lock{_mutex};
+        auto*            table = _table.load(std::memory_order_relaxed);
+        if ((table->used_slots_count + 1) * 2 > table->slots.size()) // Keeps at least half of the slots empty, so that the probe sequences stay short
+        {
+            auto const old_table = std::unique_ptr<Table>{table};
+            table                = new Table{std::bit_ceil(std::max<std::size_t>(min_slots_count, (_nodes.size() + 1) * 4))}; // NOLINT(*-owning-memory)
+            for (auto const& [other_id, other_node] : _nodes)
+                table->insert(other_node.get());
+            _table.store(table, std::memory_order_seq_cst);
+            _grace_period.wait_for_readers();
+        }
+        table->insert(node.get());
+        _nodes.emplace(id, std::move(node));
+        return id;
+    }
+
+    void destroy(Id<T> const& id)
+    {
+        std::unique_lock lock{_mutex};
+
+        auto const it = _nodes.find(id);
+        if (it == _nodes.end())
+            return;
+        auto const node = std::move(it->second);
+        _nodes.erase(it);
+        _table.load(std::memory_order_relaxed)->erase(node.get());
+        _grace_period.wait_for_readers(); // Before `node` gets freed
+    }
+
+    [[nodiscard]] auto is_empty() const -> bool
+    {
+        std::shared_lock lock{_mutex};
+        return _nodes.empty();
+    }
+
+    void clear()
+    {
+        std::unique_lock lock{_mutex};
+
+        auto const old_table = std::unique_ptr<Table>{_table.load(std::memory_order_relaxed)};
+        auto const old_nodes = std::exchange(_nodes, {});
+        _table.store(new Table{min_slots_count}, std::memory_order_seq_cst); // NOLINT(*-owning-memory)
+        _grace_period.wait_for_readers(); // Before the old table and nodes get freed
+    }
+
+    /// Locked by the functions that create and destroy objects, not by the ones that read and modify them.
+    [[nodiscard]] auto mutex() const -> Lock& { return _mutex; }
+
+    /// Maps each id to the node storing its object.
+    [[nodiscard]] auto underlying_container() const -> auto const& { return _nodes; }
+
+private:
+    static constexpr std::size_t min_slots_count = 16;
+
+    /// An open-addressing hash table (with linear probing) of pointers to the nodes. Its size is a power of 2.
+    struct Table {
+        explicit Table(std::size_t slots_count)
+            : slots(slots_count)
+        {}
+
+        /// Must be called by a writer. The table must have at least one empty slot.
+        void insert(Node* node)
+        {
+            for (auto index = first_slot_of(node->id);; index = (index + 1) & (slots.size() - 1))
+            {
+                auto* const slot_node = slots[index].load(std::memory_order_relaxed);
+                if (slot_node == nullptr || slot_node == tombstone())
+                {
+                    if (slot_node == nullptr)
+                        ++used_slots_count;
+                    slots[index].store(node, std::memory_order_seq_cst);
+                    return;
+                }
+            }
+        }
+
+        /// Must be called by a writer. The slot keeps a tombstone instead of becoming empty again, so that readers keep probing past it.
+        void erase(Node const* node)
+        {
+            for (auto index = first_slot_of(node->id);; index = (index + 1) & (slots.size() - 1))
+            {
+                if (slots[index].load(std::memory_order_relaxed) == node)
+                {
+                    slots[index].store(tombstone(), std::memory_order_seq_cst);
+                    return;
+                }
+            }
+        }
+
+        [[nodiscard]] auto find(Id<T> const& id) const -> Node*
+        {
+            for (auto index = first_slot_of(id);; index = (index + 1) & (slots.size() - 1))
+            {
+                auto* const node = slots[index].load(std::memory_order_seq_cst);
+                if (node == nullptr)
+                    return nullptr;
+                if (node != tombstone() && node->id == id)
+                    return node;
+            }
+        }
+
+        [[nodiscard]] auto first_slot_of(Id<T> const& id) const -> std::size_t
+        {
+            return std::hash<Id<T>>{}(id) & (slots.size() - 1);
+        }
+
+        std::vector<std::atomic<Node*>> slots;
+        std::size_t                     used_slots_count{0}; // The slots that are not empty, including the tombstones. Only used by the writers
+    };
+
+    /// A pointer that is never dereferenced, and marks the slots of the objects that have been destroyed.
+    [[nodiscard]] static auto tombstone() -> Node*
+    {
+        alignas(Node) static std::byte storage[sizeof(Node)]; // NOLINT(*-avoid-c-arrays)
+        return reinterpret_cast<Node*>(&storage); // NOLINT(*-reinterpret-cast)
+    }
+
+    /// Must be called while holding a `GracePeriod::ReadGuard`.
+    [[nodiscard]] auto find(Id<T> const& id) const -> Node*
+    {
+        return _table.load(std::memory_order_seq_cst)->find(id);
+    }
+
+private:
+    std::unordered_map<Id<T>, std::unique_ptr<Node>> _nodes{}; // Owns the nodes. Guarded by `_mutex`
+    std::atomic<Table*>                              _table{new Table{min_slots_count}}; // NOLINT(*-owning-memory) Read without locking, see `GracePeriod`
+    GracePeriod                                      _grace_period{};
+    mutable Lock                                     _mutex{};
+};
+
+} // namespace reg::internal
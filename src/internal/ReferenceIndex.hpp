@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <uuid.h>
+#include "../AnyId.hpp"
+
+namespace reg::internal {
+
+/// Remembers, for each object, the objects that reference it, so that we can find the dependents of an object without scanning all the registries.
+/// Each referrer stores the list of the objects it references, so that we can remove its old references when it gets modified or destroyed without having to know its previous value.
+class ReferenceIndex {
+public:
+    /// Replaces all the references of `referrer` with `referenced`.
+    void set_references(uuids::uuid const& referrer, std::vector<uuids::uuid> referenced)
+    {
+        std::unique_lock lock{_mutex};
+
+        auto const it = _referenced_by_referrer.find(referrer);
+        if (it != _referenced_by_referrer.end())
+        {
+            if (it->second == referenced)
+                return; // The usual case when an object is modified: its references don't change
+            for (auto const& uuid : it->second)
+                remove_dependent(uuid, referrer);
+            _referenced_by_referrer.erase(it);
+        }
+        for (auto const& uuid : referenced)
+            ++_dependents[uuid][referrer];
+        if (!referenced.empty())
+            _referenced_by_referrer.emplace(referrer, std::move(referenced));
+    }
+
+    /// Removes all the references of `referrer`. The references *to* `referrer` are kept: the objects that reference it still hold its id, and `dependents_of()` keeps returning them.
+    void erase_referrer(uuids::uuid const& referrer)
+    {
+        std::unique_lock lock{_mutex};
+
+        auto const it = _referenced_by_referrer.find(referrer);
+        if (it == _referenced_by_referrer.end())
+            return;
+        for (auto const& uuid : it->second)
+            remove_dependent(uuid, referrer);
+        _referenced_by_referrer.erase(it);
+    }
+
+    [[nodiscard]] auto dependents_of(uuids::uuid const& uuid) const -> std::vector<AnyId>
+    {
+        std::shared_lock lock{_mutex};
+
+        auto       dependents = std::vector<AnyId>{};
+        auto const it         = _dependents.find(uuid);
+        if (it == _dependents.end())
+            return dependents;
+        dependents.reserve(it->second.size());
+        for (auto const& [referrer, count] : it->second)
+            dependents.emplace_back(referrer);
+        return dependents;
+    }
+
+    void clear()
+    {
+        std::unique_lock lock{_mutex};
+        _dependents.clear();
+        _referenced_by_referrer.clear();
+    }
+
+private:
+    void remove_dependent(uuids::uuid const& uuid, uuids::uuid const& referrer)
+    {
+        auto const it = _dependents.find(uuid);
+        if (it == _dependents.end())
+            return;
+        auto const referrer_it = it->second.find(referrer);
+        if (referrer_it != it->second.end() && --referrer_it->second == 0)
+            it->second.erase(referrer_it);
+        if (it->second.empty())
+            _dependents.erase(it);
+    }
+
+private:
+    std::unordered_map<uuids::uuid, std::unordered_map<uuids::uuid, std::size_t>> _dependents;             // For each object, the objects that reference it (and how many times)
+    std::unordered_map<uuids::uuid, std::vector<uuids::uuid>>                     _referenced_by_referrer; // For each object, the objects it references
+    mutable std::shared_mutex                                                     _mutex;
+};
+
+} // namespace reg::internal
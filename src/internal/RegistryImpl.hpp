@@ -6,12 +6,14 @@
 namespace reg::internal {
 
 /// Wraps a `RawRegistry` and makes sure its address is always the same in memory.
-/// It has the whole interface of a Registry and can be configured to use whichever `Map` type you want.
-template<typename T, typename Map>
+/// It has the whole interface of a Registry and can be configured to use whichever `Map` type and `Lock` type you want.
+template<typename T, typename Map, typename Lock = std::shared_mutex>
 class RegistryImpl {
 public:
     /// The type of values stored in this registry.
     using ValueType = T;
+    /// The type of mutex used to guard this registry.
+    using LockType = Lock;
 
     RegistryImpl()                                           = default;
     ~RegistryImpl()                                          = default;
@@ -28,6 +30,13 @@ public:
         return _wrapped->get(id);
     }
 
+    /// Thread-safe (as long as each thread uses its own `ResolvedId`).
+    /// Same as `get(Id<T>)`, but uses (and refreshes if needed) the location cached in `id`.
+    [[nodiscard]] auto get(ResolvedId<T>& id) const -> std::optional<T>
+    {
+        return _wrapped->get(id);
+    }
+
     /// Thread-safe.
     /// Sets the value of the object referenced by `id` to `value`.
     /// Does nothing if the `id` doesn't refer to an object in this registry.
@@ -37,6 +46,29 @@ public:
         return _wrapped->set(id, value);
     }
 
+    /// Thread-safe.
+    /// Sets the value of the object referenced by `id` to `value`, by moving `value` into it.
+    /// Does nothing if the `id` doesn't refer to an object in this registry.
+    /// Returns false iff the object was not found in the registry and this function did nothing.
+    auto set(Id<T> const& id, T&& value) -> bool
+    {
+        return _wrapped->set(id, std::move(value));
+    }
+
+    /// Thread-safe (as long as each thread uses its own `ResolvedId`).
+    /// Same as `set(Id<T>, T const&)`, but uses (and refreshes if needed) the location cached in `id`.
+    auto set(ResolvedId<T>& id, T const& value) -> bool
+    {
+        return _wrapped->set(id, value);
+    }
+
+    /// Thread-safe (as long as each thread uses its own `ResolvedId`).
+    /// Same as `set(Id<T>, T&&)`, but uses (and refreshes if needed) the location cached in `id`.
+    auto set(ResolvedId<T>& id, T&& value) -> bool
+    {
+        return _wrapped->set(id, std::move(value));
+    }
+
     /// Thread-safe.
     /// Returns true iff `id` references an object in the registry.
     [[nodiscard]] auto contains(Id<T> const& id) const -> bool
@@ -44,6 +76,13 @@ public:
         return _wrapped->contains(id);
     }
 
+    /// Thread-safe (as long as each thread uses its own `ResolvedId`).
+    /// Same as `contains(Id<T>)`, but uses (and refreshes if needed) the location cached in `id`.
+    [[nodiscard]] auto contains(ResolvedId<T>& id) const -> bool
+    {
+        return _wrapped->contains(id);
+    }
+
     /// Thread-safe.
     /// Applies `callback` to the object referenced by `id`.
     /// Does nothing if the `id` doesn't refer to an object in this registry.
@@ -53,6 +92,13 @@ public:
         return _wrapped->with_ref(id, callback);
     }
 
+    /// Thread-safe (as long as each thread uses its own `ResolvedId`).
+    /// Same as `with_ref(Id<T>, callback)`, but uses (and refreshes if needed) the location cached in `id`.
+    auto with_ref(ResolvedId<T>& id, std::function<void(T const&)> const& callback) const -> bool
+    {
+        return _wrapped->with_ref(id, callback);
+    }
+
     /// Thread-safe.
     /// Applies `callback` to the object referenced by `id`.
     /// Does nothing if the `id` doesn't refer to an object in this registry.
@@ -62,6 +108,33 @@ public:
         return _wrapped->with_mutable_ref(id, callback);
     }
 
+    /// Thread-safe (as long as each thread uses its own `ResolvedId`).
+    /// Same as `with_mutable_ref(Id<T>, callback)`, but uses (and refreshes if needed) the location cached in `id`.
+    auto with_mutable_ref(ResolvedId<T>& id, std::function<void(T&)> const& callback) -> bool
+    {
+        return _wrapped->with_mutable_ref(id, callback);
+    }
+
+    /// Thread-safe.
+    /// Same as `with_ref()`, but for coroutines: `bool const success = co_await registry.async_with_ref(id, callback);`
+    /// If the registry is locked by a writer, the coroutine is suspended instead of blocking its thread, and `callback` then runs on the thread that releases the lock.
+    /// Only available if the `Lock` of the registry can be awaited, e.g. `reg::AsyncSharedMutex`. The result must be `co_await`ed right away.
+    [[nodiscard]] auto async_with_ref(Id<T> const& id, std::function<void(T const&)> callback) const
+        requires AwaitableLock<Lock>
+    {
+        return _wrapped->async_with_ref(id, std::move(callback));
+    }
+
+    /// Thread-safe.
+    /// Same as `with_mutable_ref()`, but for coroutines: `bool const success = co_await registry.async_with_mutable_ref(id, callback);`
+    /// If the registry is locked, the coroutine is suspended instead of blocking its thread, and `callback` then runs on the thread that releases the lock.
+    /// Only available if the `Lock` of the registry can be awaited, e.g. `reg::AsyncSharedMutex`. The result must be `co_await`ed right away.
+    [[nodiscard]] auto async_with_mutable_ref(Id<T> const& id, std::function<void(T&)> callback)
+        requires AwaitableLock<Lock>
+    {
+        return _wrapped->async_with_mutable_ref(id, std::move(callback));
+    }
+
     /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
     /// Only use this if you need to avoid the copy that `get()` would perform and `with_ref()` doesn't fit your needs.
     [[nodiscard]] auto get_ref(Id<T> const& id) const -> T const*
@@ -76,12 +149,52 @@ public:
         return _wrapped->get_mutable_ref(id);
     }
 
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    /// Same as `get_ref(Id<T>)`, but uses (and refreshes if needed) the location cached in `id`.
+    [[nodiscard]] auto get_ref(ResolvedId<T>& id) const -> T const*
+    {
+        return _wrapped->get_ref(id);
+    }
+
+    /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
+    /// Same as `get_mutable_ref(Id<T>)`, but uses (and refreshes if needed) the location cached in `id`.
+    [[nodiscard]] auto get_mutable_ref(ResolvedId<T>& id) -> T*
+    {
+        return _wrapped->get_mutable_ref(id);
+    }
+
+    /// Thread-safe.
+    /// Looks `id` up once and returns a `ResolvedId` that caches the location of its object, so that the next accesses through it skip the lookup
+    /// (until an object gets created or destroyed in this registry, at which point the next access looks the object up again and caches its new location).
+    /// Useful when you access the same object many times in a row, e.g. once per frame.
+    [[nodiscard]] auto resolve(Id<T> const& id) const -> ResolvedId<T>
+    {
+        return _wrapped->resolve(id);
+    }
+
     /// Thread-safe.
     /// Inserts a copy of `value` into the registry.
     /// Returns the id that will then be used to reference the object that has just been created.
     [[nodiscard]] auto create_unique(T const& value) -> UniqueId<T>
     {
-        return UniqueId<T>::internal_constructor(_wrapped->create_raw(value), _wrapped);
+        return emplace_unique(value);
+    }
+
+    /// Thread-safe.
+    /// Moves `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    [[nodiscard]] auto create_unique(T&& value) -> UniqueId<T>
+    {
+        return emplace_unique(std::move(value));
+    }
+
+    /// Thread-safe.
+    /// Constructs a new object in-place in the registry, by forwarding `args` to the constructor of `T`.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    template<typename... Args>
+    [[nodiscard]] auto emplace_unique(Args&&... args) -> UniqueId<T>
+    {
+        return UniqueId<T>::internal_constructor(_wrapped->emplace_raw(std::forward<Args>(args)...), make_any_raw_registry<T>(_wrapped));
     }
 
     /// Thread-safe.
@@ -89,7 +202,24 @@ public:
     /// Returns the id that will then be used to reference the object that has just been created.
     [[nodiscard]] auto create_shared(T const& value) -> SharedId<T>
     {
-        return SharedId<T>::internal_constructor(_wrapped->create_raw(value), _wrapped);
+        return emplace_shared(value);
+    }
+
+    /// Thread-safe.
+    /// Moves `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    [[nodiscard]] auto create_shared(T&& value) -> SharedId<T>
+    {
+        return emplace_shared(std::move(value));
+    }
+
+    /// Thread-safe.
+    /// Constructs a new object in-place in the registry, by forwarding `args` to the constructor of `T`.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    template<typename... Args>
+    [[nodiscard]] auto emplace_shared(Args&&... args) -> SharedId<T>
+    {
+        return SharedId<T>::internal_constructor(_wrapped->emplace_raw(std::forward<Args>(args)...), make_any_raw_registry<T>(_wrapped));
     }
 
     /// Thread-safe.
@@ -100,6 +230,23 @@ public:
         return _wrapped->create_raw(value);
     }
 
+    /// Thread-safe.
+    /// Moves `value` into the registry.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    [[nodiscard]] auto create_raw(T&& value) -> Id<T>
+    {
+        return _wrapped->create_raw(std::move(value));
+    }
+
+    /// Thread-safe.
+    /// Constructs a new object in-place in the registry, by forwarding `args` to the constructor of `T`.
+    /// Returns the id that will then be used to reference the object that has just been created.
+    template<typename... Args>
+    [[nodiscard]] auto emplace_raw(Args&&... args) -> Id<T>
+    {
+        return _wrapped->emplace_raw(std::forward<Args>(args)...);
+    }
+
     /// Thread-safe.
     /// Destroys the object and removes it from the registry.
     /// From then on, trying to get an object using `id` is still safe but will return null.
@@ -108,6 +255,36 @@ public:
         _wrapped->destroy(id);
     }
 
+    /// Thread-safe.
+    /// Removes the object referenced by `id` from the registry without destroying it, and returns it (or an empty node if the id doesn't refer to an object in this registry).
+    /// You can then `insert()` it into any registry of `T`s, where it will keep the same id. See `RegistryNode`.
+    /// NB: the `UniqueId`s and `SharedId`s of the object keep referring to this registry, so use this with raw ids.
+    [[nodiscard]] auto extract(Id<T> const& id) -> RegistryNode<T, Map>
+    {
+        return _wrapped->extract(id);
+    }
+
+    /// Thread-safe.
+    /// Inserts an object that has been extracted from a registry (this one or another one), with the id it had there.
+    /// If both registries use the same `Map` and the map supports it (e.g. `Registry<T>`), this reuses the allocation of the node instead of moving the object.
+    /// Returns false (and leaves the object in `node`) if `node` is empty or if its id is already present in this registry.
+    template<typename NodeMap>
+    auto insert(RegistryNode<T, NodeMap>&& node) -> bool
+    {
+        return _wrapped->insert(std::move(node));
+    }
+
+    /// Thread-safe.
+    /// Moves the object referenced by `id` into `destination`, where it keeps the same id. This is the same as `destination.insert(extract(id))`,
+    /// except that both registries are locked together (in a deadlock-free way), so other threads always see the object in exactly one of the two registries.
+    /// Returns false if `id` doesn't refer to an object in this registry, or if it is already present in `destination`.
+    /// NB: the `UniqueId`s and `SharedId`s of the object keep referring to this registry, so use this with raw ids.
+    template<typename OtherMap, typename OtherLock>
+    auto transfer(Id<T> const& id, RegistryImpl<T, OtherMap, OtherLock>& destination) -> bool
+    {
+        return _wrapped->transfer(id, *destination.underlying_wrapped_registry());
+    }
+
     /// Thread-safe.
     /// Returns true iff the registry contains no objects at all.
     [[nodiscard]] auto is_empty() const -> bool
@@ -127,26 +304,99 @@ public:
     /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
     [[nodiscard]] auto end() { return _wrapped->end(); }
     /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
-    [[nodiscard]] auto begin() const { return _wrapped->begin(); }
+    [[nodiscard]] auto begin() const { return std::as_const(*_wrapped).begin(); }
     /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
-    [[nodiscard]] auto end() const { return _wrapped->end(); }
+    [[nodiscard]] auto end() const { return std::as_const(*_wrapped).end(); }
     /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
     [[nodiscard]] auto cbegin() const { return _wrapped->cbegin(); }
     /// NOT Thread-safe; see the `mutex()` method to make this thread-safe.
     [[nodiscard]] auto cend() const { return _wrapped->cend(); }
 
+    /// Thread-safe.
+    /// Makes room for at least `capacity` objects, so that creating them won't need to reallocate the storage. Useful before a bulk load.
+    /// Does nothing for maps that can't reserve memory in advance (e.g. a `PersistentRegistry`).
+    void reserve(std::size_t capacity)
+    {
+        _wrapped->reserve(capacity);
+    }
+
+    /// Thread-safe.
+    /// Gives the memory that the registry doesn't currently need back to the system, e.g. after a `clear()` or after destroying many objects.
+    void shrink_to_fit()
+    {
+        _wrapped->shrink_to_fit();
+    }
+
+    /// Thread-safe.
+    /// Returns an estimation of the memory used by the registry, with a breakdown between the ids, the objects, the storage's own structures and the owning ids.
+    [[nodiscard]] auto memory_usage() const -> MemoryUsage
+    {
+        auto usage       = _wrapped->memory_usage();
+        usage.owning_ids = _wrapped->owning_ids_count() * sizeof(IdDestroyer<T>) + _wrapped->shared_ids_count() * shared_id_control_block_size;
+        return usage;
+    }
+
+    /// NOT Thread-safe: the filter should be enabled right after creating the registry, before it is shared with other threads.
+    /// Starts maintaining a small filter (about 10 bytes per object) that lets `get()`, `contains()`, `with_ref()`, `with_mutable_ref()`, `set()` and `destroy()` return right away,
+    /// without locking the registry nor looking into its map, for about 99% of the ids that are not in the registry (e.g. ids of objects that have been destroyed).
+    /// `expected_objects_count` is used to size the filter: the registry keeps working if it holds more objects, the filter just rejects fewer missing ids.
+    void enable_membership_filter(std::size_t expected_objects_count)
+    {
+        _wrapped->enable_membership_filter(expected_objects_count);
+    }
+
+    /// NOT Thread-safe: the recorder should be set before the registry is shared with other threads.
+    /// Starts recording all the operations done on this registry (including the manual locks of its `mutex()`) into a trace, that you can then replay with the `reg-replay` tool.
+    /// Pass nullptr to stop recording.
+    void set_trace_recorder(std::shared_ptr<TraceRecorder> recorder)
+    {
+        _wrapped->set_trace_recorder(std::move(recorder));
+    }
+
     /// Returns the mutex guarding this registry to allow you to lock it manually.
     /// This is only required when using functions that are not already thread-safe: get_ref(), get_mutable_ref(), begin(), end(), cbegin() and cend() (and therefore also using a range-based for loop on this registry).
     /// You should use a std::unique_lock if you want to modify some values, and std::shared_lock if you only need to read them.
+    /// (Always use a std::unique_lock before modifying values: this is also what tells the registry to stop sharing its storage with the snapshots that have been taken.)
     /// See https://stackoverflow.com/a/46050121/15432269 for more details about shared mutexes.
-    [[nodiscard]] auto mutex() const -> std::shared_mutex& { return _wrapped->mutex(); }
+    [[nodiscard]] auto mutex() const -> auto& { return _wrapped->mutex(); }
+
+    /// Thread-safe.
+    /// Returns a new registry that starts with the current content of this one.
+    /// This is O(1): the storage is shared between the two registries and only gets copied once one of them is modified.
+    [[nodiscard]] auto snapshot() const -> RegistryImpl
+    {
+        std::shared_lock lock{mutex()};
+        return internal_from_snapshot(_wrapped->snapshot());
+    }
+
+    /// Thread-safe.
+    /// Replaces the content of this registry with the content of `snapshot` (typically a registry that you got from `snapshot()`, e.g. to implement undo / redo).
+    /// This is O(1): the storage is shared between the two registries and only gets copied once one of them is modified.
+    void restore(RegistryImpl const& snapshot)
+    {
+        auto storage = [&]() {
+            std::shared_lock lock{snapshot.mutex()};
+            return snapshot._wrapped->snapshot();
+        }();
+        _wrapped->restore(std::move(storage));
+    }
+
+    /// This function is only meant to be called by the implementation.
+    /// You should use `registry.snapshot()` instead.
+    static auto internal_from_snapshot(std::shared_ptr<Map const> snapshot) -> RegistryImpl
+    {
+        auto ret     = RegistryImpl{};
+        ret._wrapped = std::make_shared<internal::RawRegistryImpl<T, Map, Lock>>(std::move(snapshot));
+        return ret;
+    }
 
-    [[nodiscard]] auto underlying_container() const -> Map const& { return _wrapped->underlying_container(); }
+    [[nodiscard]] auto underlying_container() const -> Map const& { return std::as_const(*_wrapped).underlying_container(); }
     [[nodiscard]] auto underlying_container() -> Map& { return _wrapped->underlying_container(); }
+    [[nodiscard]] auto underlying_wrapped_registry() const -> auto const& { return _wrapped; }
     [[nodiscard]] auto underlying_wrapped_registry() -> auto& { return _wrapped; }
 
 private:
-    std::shared_ptr<internal::RawRegistryImpl<T, Map>> _wrapped = std::make_shared<internal::RawRegistryImpl<T, Map>>();
+    std::shared_ptr<internal::RawRegistryImpl<T, Map, Lock>> _wrapped = std::make_shared<internal::RawRegistryImpl<T, Map, Lock>>();
 };
 
 } // namespace reg::internal
\ No newline at end of file
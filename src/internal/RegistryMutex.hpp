@@ -0,0 +1,97 @@
+#pragma once
+#include <coroutine>
+#include <utility>
+
+namespace reg::internal {
+
+/// The mutex guarding a `RawRegistryImpl`. It can be used exactly like a `std::shared_mutex` (or like the `Lock` you gave to the registry).
+/// The only difference is that taking an exclusive lock gives the registry an opportunity to stop sharing
+/// its storage with the snapshots that have been taken from it, before anybody modifies that storage.
+template<typename Registry, typename Lock>
+class RegistryMutex {
+public:
+    explicit RegistryMutex(Registry& registry)
+        : _registry{&registry}
+    {}
+
+    void lock()
+    {
+        _mutex.lock();
+        after_exclusive_lock();
+    }
+
+    [[nodiscard]] auto try_lock() -> bool
+    {
+        if (!_mutex.try_lock())
+            return false;
+        after_exclusive_lock();
+        return true;
+    }
+
+    void unlock() { _mutex.unlock(); }
+
+    void lock_shared() { _mutex.lock_shared(); }
+    [[nodiscard]] auto try_lock_shared() -> bool { return _mutex.try_lock_shared(); }
+    void unlock_shared() { _mutex.unlock_shared(); }
+
+    /// Only available if `Lock` can be awaited by coroutines, e.g. `reg::AsyncSharedMutex`.
+    /// Just like `lock()`, detaches the registry from its snapshots once the lock has been acquired.
+    [[nodiscard]] auto async_lock()
+        requires requires(Lock& mutex) { mutex.async_lock(); }
+    {
+        return AsyncExclusiveLock<decltype(_mutex.async_lock())>{_mutex.async_lock(), *this};
+    }
+
+    /// Only available if `Lock` can be awaited by coroutines, e.g. `reg::AsyncSharedMutex`.
+    [[nodiscard]] auto async_lock_shared()
+        requires requires(Lock& mutex) { mutex.async_lock_shared(); }
+    {
+        return _mutex.async_lock_shared();
+    }
+
+    /// Locking this mutex directly doesn't detach the registry from its snapshots.
+    /// Only use it if you are not going to modify the storage of the registry.
+    [[nodiscard]] auto underlying_mutex() -> Lock& { return _mutex; }
+
+private:
+    template<typename LockAwaiter>
+    class AsyncExclusiveLock {
+    public:
+        AsyncExclusiveLock(LockAwaiter lock_awaiter, RegistryMutex& mutex)
+            : _lock_awaiter{std::move(lock_awaiter)}
+            , _mutex{&mutex}
+        {}
+
+        [[nodiscard]] auto await_ready() -> bool { return _lock_awaiter.await_ready(); }
+        auto               await_suspend(std::coroutine_handle<> continuation) { return _lock_awaiter.await_suspend(continuation); }
+        void               await_resume()
+        {
+            _lock_awaiter.await_resume();
+            _mutex->after_exclusive_lock();
+        }
+
+    private:
+        LockAwaiter    _lock_awaiter;
+        RegistryMutex* _mutex;
+    };
+
+private:
+    void after_exclusive_lock()
+    {
+        try
+        {
+            _registry->detach_from_snapshots();
+        }
+        catch (...)
+        {
+            _mutex.unlock();
+            throw;
+        }
+    }
+
+private:
+    Lock      _mutex;
+    Registry* _registry;
+};
+
+} // namespace reg::internal
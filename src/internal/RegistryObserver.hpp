@@ -0,0 +1,25 @@
+#pragma once
+#include <functional>
+#include "../Id.hpp"
+
+namespace reg::internal {
+
+/// Callbacks that a registry calls whenever its content changes.
+/// They are called while the registry is locked, so they must not access the registry themselves.
+/// NB: modifications done through `get_mutable_ref()` and the iterators can't be observed.
+template<typename T>
+struct RegistryObserver {
+    /// Called after an object has been added to the registry.
+    std::function<void(Id<T> const&, T const&)> on_insert{};
+    /// Called right before an object gets removed from the registry.
+    std::function<void(Id<T> const&, T const&)> on_erase{};
+    /// Called after the value of an object has been modified (through `set()` or `with_mutable_ref()`).
+    std::function<void(Id<T> const&, T const&)> on_change{};
+    /// Called with the value that an object is about to get (when it is created, or modified through `set()` or `with_mutable_ref()`).
+    /// Throw an exception to refuse that value: the registry will then be left as it was before the operation, and the exception will be propagated to the caller.
+    std::function<void(Id<T> const&, T const&)> validate{};
+    /// Identifies whoever added this observer, so that they can remove it later with `remove_observers()`.
+    void const* owner{};
+};
+
+} // namespace reg::internal
@@ -0,0 +1,132 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "../Id.hpp"
+
+namespace reg::internal {
+
+/// Stores the ids of the objects of a registry, sorted by the key that `Index::key_extractor` computes from their value.
+/// NOT Thread-safe: it is only ever accessed while the registry it indexes is locked.
+template<typename T, typename Index>
+class SecondaryIndex {
+public:
+    using Key = std::remove_cvref_t<std::invoke_result_t<decltype(Index::key_extractor) const&, T const&>>;
+
+    [[nodiscard]] static auto key_of(T const& value) -> Key
+    {
+        return std::invoke(Index::key_extractor, value);
+    }
+
+    /// Throws if `value` can't be given to the object referenced by `id` without breaking the uniqueness of the index.
+    void validate(Id<T> const& id, T const& value) const
+    {
+        if constexpr (Index::is_unique)
+        {
+            auto const it = _ids_by_key.find(key_of(value));
+            if (it != _ids_by_key.end() && it->second != id)
+                throw std::invalid_argument{"[IndexedRegistry] Another object already has this key, and the index requires keys to be unique"};
+        }
+    }
+
+    void insert(Id<T> const& id, T const& value)
+    {
+        auto key = key_of(value);
+        _ids_by_key.emplace(key, id);
+        _key_by_id.insert_or_assign(id, std::move(key));
+    }
+
+    void erase(Id<T> const& id)
+    {
+        auto const it = _key_by_id.find(id);
+        if (it == _key_by_id.end())
+            return;
+        erase_entry(it->second, id);
+        _key_by_id.erase(it);
+    }
+
+    void change(Id<T> const& id, T const& value)
+    {
+        auto       new_key = key_of(value);
+        auto const it      = _key_by_id.find(id);
+        if (it == _key_by_id.end())
+        {
+            insert(id, value);
+            return;
+        }
+        if (it->second == new_key)
+            return;
+
+        erase_entry(it->second, id);
+        _ids_by_key.emplace(new_key, id);
+        it->second = std::move(new_key);
+    }
+
+    void clear()
+    {
+        _ids_by_key.clear();
+        _key_by_id.clear();
+    }
+
+    /// Returns the id of the object whose key is `key`, or null if there is none.
+    [[nodiscard]] auto find(Key const& key) const -> std::optional<Id<T>>
+        requires(Index::is_unique)
+    {
+        auto const it = _ids_by_key.find(key);
+        if (it == _ids_by_key.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    /// Returns the ids of all the objects whose key is `key`.
+    [[nodiscard]] auto find(Key const& key) const -> std::vector<Id<T>>
+        requires(!Index::is_unique)
+    {
+        auto       ids          = std::vector<Id<T>>{};
+        auto const [begin, end] = _ids_by_key.equal_range(key);
+        for (auto it = begin; it != end; ++it)
+            ids.push_back(it->second);
+        return ids;
+    }
+
+    /// Returns the ids of all the objects whose key is in the range [`first`, `last`], sorted by key.
+    [[nodiscard]] auto find_range(Key const& first, Key const& last) const -> std::vector<Id<T>>
+        requires(Index::is_ordered)
+    {
+        auto       ids   = std::vector<Id<T>>{};
+        auto const begin = _ids_by_key.lower_bound(first);
+        auto const end   = _ids_by_key.upper_bound(last);
+        for (auto it = begin; it != end; ++it)
+            ids.push_back(it->second);
+        return ids;
+    }
+
+private:
+    void erase_entry(Key const& key, Id<T> const& id)
+    {
+        auto const [begin, end] = _ids_by_key.equal_range(key);
+        for (auto it = begin; it != end; ++it)
+        {
+            if (it->second == id)
+            {
+                _ids_by_key.erase(it);
+                return;
+            }
+        }
+    }
+
+private:
+    using Container = std::conditional_t<
+        Index::is_ordered,
+        std::conditional_t<Index::is_unique, std::map<Key, Id<T>>, std::multimap<Key, Id<T>>>,
+        std::conditional_t<Index::is_unique, std::unordered_map<Key, Id<T>>, std::unordered_multimap<Key, Id<T>>>>;
+
+    Container                      _ids_by_key{};
+    std::unordered_map<Id<T>, Key> _key_by_id{}; // Allows us to find the previous key of an object once its value has already been modified
+};
+
+} // namespace reg::internal
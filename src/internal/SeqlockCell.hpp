@@ -0,0 +1,124 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "cpu_relax.hpp"
+
+namespace reg::internal {
+
+/// Stores a value that can be read by any number of threads without ever locking, thanks to a sequence lock:
+/// the version is odd while a writer is modifying the value, and readers retry until they get a copy that wasn't modified while they were reading it.
+/// The value is stored as atomic words, so that a reader racing with a writer gets a torn copy (that it will throw away) instead of undefined behaviour.
+template<typename T>
+class SeqlockCell {
+    static_assert(std::is_trivially_copyable_v<T>, "A SeqlockCell can only store trivially copyable types, because readers copy them while they might be modified.");
+
+public:
+    explicit SeqlockCell(T const& value)
+    {
+        store_words(value);
+    }
+
+    /// Thread-safe.
+    /// Returns the value along with its version, which you can then pass to `compare_and_set()`.
+    [[nodiscard]] auto load() const -> std::pair<T, std::uint64_t>
+    {
+        while (true)
+        {
+            auto const version_before = _version.load(std::memory_order_acquire);
+            if (version_before % 2 == 1) // A writer is modifying the value
+            {
+                cpu_relax();
+                continue;
+            }
+            auto bytes = load_bytes();
+            if (_version.load(std::memory_order_relaxed) == version_before)
+                return {std::bit_cast<T>(bytes), version_before};
+        }
+    }
+
+    /// Thread-safe.
+    /// Sets the value iff it hasn't been modified since `load()` returned `expected_version`.
+    /// Returns false iff the value has been modified in the meantime and this function did nothing.
+    auto compare_and_set(std::uint64_t expected_version, T const& value) -> bool
+    {
+        if (expected_version % 2 == 1 || !_version.compare_exchange_strong(expected_version, expected_version + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return false;
+        write_and_release(expected_version, value);
+        return true;
+    }
+
+    /// Thread-safe.
+    void store(T const& value)
+    {
+        write_and_release(acquire_for_writing(), value);
+    }
+
+    /// Thread-safe.
+    /// Applies `callback` to a copy of the value, and stores the result if nobody modified the value in the meantime. Otherwise, starts over with the latest value,
+    /// so `callback` might be called several times. The version is only odd while we store the result: readers never wait for `callback`.
+    template<typename Callback>
+    void modify(Callback&& callback)
+    {
+        while (true)
+        {
+            auto [value, version] = load();
+            callback(value);
+            if (compare_and_set(version, value))
+                return;
+        }
+    }
+
+private:
+    using Word = std::uint64_t;
+
+    static constexpr std::size_t words_count = (sizeof(T) + sizeof(Word) - 1) / sizeof(Word);
+
+    [[nodiscard]] auto acquire_for_writing() -> std::uint64_t
+    {
+        auto version = _version.load(std::memory_order_relaxed);
+        spin_until([&]() {
+            return version % 2 == 0
+                   && _version.compare_exchange_weak(version, version + 1, std::memory_order_acquire, std::memory_order_relaxed);
+        });
+        return version;
+    }
+
+    /// `version` is the (even) version that the value had before we acquired it.
+    void write_and_release(std::uint64_t version, T const& value)
+    {
+        store_words(value);
+        _version.store(version + 2, std::memory_order_release);
+    }
+
+    /// The words are loaded with acquire semantics (and stored with release semantics) so that a reader that sees any word written by a writer
+    /// is guaranteed to also see the odd version that writer has set: the version check that follows will then detect the torn read.
+    /// (This is free on x86, and avoids the standalone fences that a seqlock usually uses, which thread sanitizers don't support.)
+    [[nodiscard]] auto load_bytes() const -> std::array<std::byte, sizeof(T)>
+    {
+        auto words = std::array<Word, words_count>{};
+        for (std::size_t i = 0; i < words_count; ++i)
+            words[i] = _words[i].load(std::memory_order_acquire);
+        auto bytes = std::array<std::byte, sizeof(T)>{};
+        std::memcpy(bytes.data(), words.data(), sizeof(T));
+        return bytes;
+    }
+
+    void store_words(T const& value)
+    {
+        auto words = std::array<Word, words_count>{};
+        std::memcpy(words.data(), &value, sizeof(T));
+        for (std::size_t i = 0; i < words_count; ++i)
+            _words[i].store(words[i], std::memory_order_release);
+    }
+
+private:
+    std::atomic<std::uint64_t>                 _version{0};
+    std::array<std::atomic<Word>, words_count> _words{};
+};
+
+} // namespace reg::internal
@@ -0,0 +1,65 @@
+#pragma once
+#include <memory>
+#include "../Trace.hpp"
+
+namespace reg::internal {
+
+/// Wraps the mutex of a registry to record the manual locks in its trace (if it has a `TraceRecorder`).
+/// The registry itself locks the underlying mutex directly, so that its own locks don't appear in the trace.
+template<typename Mutex>
+class TracedMutex {
+public:
+    TracedMutex(Mutex& mutex, std::shared_ptr<TraceRecorder> const& recorder)
+        : _mutex{&mutex}
+        , _recorder{&recorder}
+    {}
+
+    void lock()
+    {
+        record(TraceOp::Lock);
+        _mutex->lock();
+    }
+    [[nodiscard]] auto try_lock() -> bool
+    {
+        if (!_mutex->try_lock())
+            return false;
+        record(TraceOp::Lock); // Only when we actually got the lock, so that the trace stays balanced
+        return true;
+    }
+    void unlock()
+    {
+        record(TraceOp::Unlock);
+        _mutex->unlock();
+    }
+
+    void lock_shared()
+    {
+        record(TraceOp::LockShared);
+        _mutex->lock_shared();
+    }
+    [[nodiscard]] auto try_lock_shared() -> bool
+    {
+        if (!_mutex->try_lock_shared())
+            return false;
+        record(TraceOp::LockShared); // Only when we actually got the lock, so that the trace stays balanced
+        return true;
+    }
+    void unlock_shared()
+    {
+        record(TraceOp::UnlockShared);
+        _mutex->unlock_shared();
+    }
+
+private:
+    void record(TraceOp op) const
+    {
+        if (*_recorder)
+            (*_recorder)->record(op);
+    }
+
+private:
+    Mutex*                                _mutex;
+    std::shared_ptr<TraceRecorder> const* _recorder; // Points to the recorder of the registry, which can change after we have been created
+};
+
+} // namespace reg::internal
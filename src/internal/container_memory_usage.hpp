@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include "../MemoryUsage.hpp"
+#include "BPlusTreeMap.hpp"
+#include "OrderPreservingMap.hpp"
+#include "PersistentMap.hpp"
+
+namespace reg::internal {
+
+template<typename Key, typename Value, typename Hash, typename KeyEqual, typename Allocator>
+auto container_memory_usage(std::unordered_map<Key, Value, Hash, KeyEqual, Allocator> const& map) -> MemoryUsage
+{
+    // Each node stores a pointer to the next node and (in most implementations) caches the hash of its key.
+    // There is also an array of buckets, that each point to a node.
+    return {
+        .keys     = map.size() * sizeof(Key),
+        .values   = map.size() * sizeof(Value),
+        .overhead = map.size() * (sizeof(void*) + sizeof(std::size_t)) + map.bucket_count() * sizeof(void*),
+    };
+}
+
+template<typename Key, typename Value, std::size_t IndexThreshold>
+auto container_memory_usage(OrderPreservingMap<Key, Value, IndexThreshold> const& map) -> MemoryUsage
+{
+    auto const& vector = map.underlying_container();
+    return {
+        .keys     = vector.size() * sizeof(Key),
+        .values   = vector.size() * sizeof(Value),
+        .overhead = vector.capacity() * sizeof(std::pair<Key, Value>) - vector.size() * (sizeof(Key) + sizeof(Value)) // Unused capacity, and padding inside the pairs
+                    + map.lookup_memory_usage(),
+    };
+}
+
+template<typename Key, typename Value>
+auto container_memory_usage(PersistentMap<Key, Value> const& map) -> MemoryUsage
+{
+    return map.memory_usage();
+}
+
+template<typename Key, typename Value, std::size_t NodeCapacity>
+auto container_memory_usage(BPlusTreeMap<Key, Value, NodeCapacity> const& map) -> MemoryUsage
+{
+    return map.memory_usage();
+}
+
+} // namespace reg::internal
@@ -0,0 +1,35 @@
+#pragma once
+#include <thread>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace reg::internal {
+
+/// Tells the CPU that we are busy-waiting, which saves power and frees resources for the other hyper-thread of the core.
+inline void cpu_relax()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__aarch64__) || defined(__arm__))
+    asm volatile("yield");
+#endif
+}
+
+/// Busy-waits until `is_done()` returns true.
+/// After spinning for a little while we start yielding, so that we don't starve the thread we are waiting for if it has been descheduled.
+template<typename Predicate>
+void spin_until(Predicate&& is_done)
+{
+    for (int spins_count = 0; !is_done(); ++spins_count)
+    {
+        if (spins_count < 64)
+            cpu_relax();
+        else
+            std::this_thread::yield();
+    }
+}
+
+} // namespace reg::internal
@@ -0,0 +1,24 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace reg::internal {
+
+/// Returns an index in [0, slots_count) that identifies the CPU the calling thread is currently running on, so that threads running on different CPUs use different slots.
+/// On platforms where we can't know the current CPU (i.e. everywhere but Linux), each thread gets its own slot instead, shared with other threads once there are more threads than slots.
+/// NB: the thread can be moved to another CPU right after this returns, so this is only a hint to reduce contention.
+inline auto current_cpu_slot(std::size_t slots_count) -> std::size_t
+{
+#if defined(__linux__)
+    if (auto const cpu = sched_getcpu(); cpu >= 0)
+        return static_cast<std::size_t>(cpu) % slots_count;
+#endif
+    static std::atomic<std::size_t> next_thread_index{0};
+    thread_local std::size_t const  thread_index = next_thread_index++; // Threads are spread evenly across the slots
+    return thread_index % slots_count;
+}
+
+} // namespace reg::internal
@@ -0,0 +1,62 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace reg::internal {
+
+/// Returns the number of threads to use when the user didn't specify one.
+inline auto default_thread_count() -> unsigned int
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+/// Calls `function(i)` for each `i` in [0, count), spreading the calls over `thread_count` threads (including the calling thread).
+/// Rethrows the first exception thrown by `function`, once all the threads have finished.
+template<typename Function>
+void parallel_for(std::size_t count, unsigned int thread_count, Function const& function)
+{
+    auto next_index = std::atomic<std::size_t>{0};
+    auto worker     = [&]() {
+        for (auto i = next_index++; i < count; i = next_index++)
+            function(i);
+    };
+
+    auto const threads_count       = std::min<std::size_t>(std::max(thread_count, 1u), count);
+    auto const extra_threads_count = threads_count > 0 ? threads_count - 1 : 0;
+    auto       extra_threads       = std::vector<std::future<void>>{};
+    extra_threads.reserve(extra_threads_count);
+    for (std::size_t i = 0; i < extra_threads_count; ++i)
+        extra_threads.push_back(std::async(std::launch::async, worker));
+
+    auto exception = std::exception_ptr{};
+    try
+    {
+        worker();
+    }
+    catch (...)
+    {
+        exception  = std::current_exception();
+        next_index = count; // Stop the other threads as soon as possible
+    }
+    for (auto& thread : extra_threads)
+    {
+        try
+        {
+            thread.get();
+        }
+        catch (...)
+        {
+            if (!exception)
+                exception = std::current_exception();
+        }
+    }
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+} // namespace reg::internal
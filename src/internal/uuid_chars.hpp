@@ -0,0 +1,131 @@
+#pragma once
+#include <uuid.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REG_UUID_CHARS_USE_SSE2
+#endif
+
+namespace reg::internal {
+
+/// The size of the canonical text form of a UUID, e.g. "00020b79-be62-4749-95f9-938b042f3b6e".
+inline constexpr std::size_t uuid_chars_size = 36;
+
+/// The offsets of the 5 groups of hex digits in the canonical text form, and their size (in bytes of the UUID).
+inline constexpr std::array<std::size_t, 5> uuid_chars_group_offsets{0, 9, 14, 19, 24};
+inline constexpr std::array<std::size_t, 5> uuid_chars_group_bytes{4, 2, 2, 2, 6};
+
+/// Writes the 32 lowercase hex digits of `uuid` (without the dashes) into `hex`.
+inline void encode_uuid_hex(uuids::uuid const& uuid, char* hex)
+{
+    auto const bytes = uuid.as_bytes();
+#if defined(REG_UUID_CHARS_USE_SSE2)
+    auto const input     = _mm_loadu_si128(reinterpret_cast<__m128i const*>(bytes.data())); // NOLINT(*-reinterpret-cast)
+    auto const low_mask  = _mm_set1_epi8(0x0f);
+    auto const high      = _mm_and_si128(_mm_srli_epi16(input, 4), low_mask);
+    auto const low       = _mm_and_si128(input, low_mask);
+    auto const to_digits = [](__m128i nibbles) {
+        // '0' + nibble, plus the gap between '9' and 'a' for the nibbles above 9
+        auto const letters_offset = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+        return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters_offset);
+    };
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(hex), to_digits(_mm_unpacklo_epi8(high, low)));      // NOLINT(*-reinterpret-cast)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 16), to_digits(_mm_unpackhi_epi8(high, low))); // NOLINT(*-reinterpret-cast)
+#else
+    constexpr char digits[] = "0123456789abcdef";
+    for (std::size_t i = 0; i < 16; ++i)
+    {
+        auto const byte = static_cast<unsigned char>(bytes[i]);
+        hex[2 * i]      = digits[byte >> 4];
+        hex[2 * i + 1]  = digits[byte & 0x0f];
+    }
+#endif
+}
+
+/// Parses the 32 hex digits in `hex` (lowercase or uppercase). Returns false if one of them is not a hex digit.
+[[nodiscard]] inline auto decode_uuid_hex(char const* hex, std::array<std::uint8_t, 16>& bytes) -> bool
+{
+#if defined(REG_UUID_CHARS_USE_SSE2)
+    auto       valid         = 0xFFFF;
+    auto const decode_16_hex = [&](char const* chars16) {
+        // The characters above 127 are negative in these signed comparisons, so they are rejected too
+        auto const chars     = _mm_loadu_si128(reinterpret_cast<__m128i const*>(chars16)); // NOLINT(*-reinterpret-cast)
+        auto const lowercase = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+        auto const is_digit  = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+        auto const is_letter = _mm_and_si128(_mm_cmpgt_epi8(lowercase, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lowercase, _mm_set1_epi8('f' + 1)));
+        valid &= _mm_movemask_epi8(_mm_or_si128(is_digit, is_letter));
+        auto const nibbles = _mm_or_si128(
+            _mm_and_si128(is_digit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+            _mm_and_si128(is_letter, _mm_sub_epi8(lowercase, _mm_set1_epi8('a' - 10)))
+        );
+        // Each 16-bit lane holds a high nibble in its low byte and a low nibble in its high byte: merge them into a single byte
+        return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00ff)), 4), _mm_srli_epi16(nibbles, 8));
+    };
+    auto const first_bytes = decode_16_hex(hex);
+    auto const last_bytes  = decode_16_hex(hex + 16);
+    if (valid != 0xFFFF)
+        return false;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes.data()), _mm_packus_epi16(first_bytes, last_bytes)); // NOLINT(*-reinterpret-cast)
+    return true;
+#else
+    auto const nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    };
+    for (std::size_t i = 0; i < 16; ++i)
+    {
+        auto const high = nibble(hex[2 * i]);
+        auto const low  = nibble(hex[2 * i + 1]);
+        if (high < 0 || low < 0)
+            return false;
+        bytes[i] = static_cast<std::uint8_t>(high << 4 | low);
+    }
+    return true;
+#endif
+}
+
+/// Writes the canonical text form of `uuid` (the same as `uuids::to_string()`) into the `uuid_chars_size` characters starting at `out`.
+inline void encode_uuid(uuids::uuid const& uuid, char* out)
+{
+    auto hex = std::array<char, 32>{};
+    encode_uuid_hex(uuid, hex.data());
+    auto const* digits = hex.data();
+    for (std::size_t group = 0; group < uuid_chars_group_offsets.size(); ++group)
+    {
+        if (group != 0)
+            out[uuid_chars_group_offsets[group] - 1] = '-';
+        std::memcpy(out + uuid_chars_group_offsets[group], digits, 2 * uuid_chars_group_bytes[group]);
+        digits += 2 * uuid_chars_group_bytes[group];
+    }
+}
+
+/// Parses the canonical text form of a UUID, from the `uuid_chars_size` characters starting at `text`.
+[[nodiscard]] inline auto decode_uuid(char const* text) -> std::optional<uuids::uuid>
+{
+    auto  hex    = std::array<char, 32>{};
+    auto* digits = hex.data();
+    for (std::size_t group = 0; group < uuid_chars_group_offsets.size(); ++group)
+    {
+        if (group != 0 && text[uuid_chars_group_offsets[group] - 1] != '-')
+            return std::nullopt;
+        std::memcpy(digits, text + uuid_chars_group_offsets[group], 2 * uuid_chars_group_bytes[group]);
+        digits += 2 * uuid_chars_group_bytes[group];
+    }
+    auto bytes = std::array<std::uint8_t, 16>{};
+    if (!decode_uuid_hex(hex.data(), bytes))
+        return std::nullopt;
+    return uuids::uuid{bytes};
+}
+
+} // namespace reg::internal
+
+#undef REG_UUID_CHARS_USE_SSE2
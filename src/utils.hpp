@@ -1,19 +1,66 @@
 #pragma once
+#include <charconv>
 #include <string>
+#include <system_error>
 #include "AnyId.hpp"
 #include "Id.hpp"
+#include "internal/uuid_chars.hpp"
 
 namespace reg {
 
+/// The number of characters that `to_chars()` writes, e.g. "00020b79-be62-4749-95f9-938b042f3b6e".
+inline constexpr std::size_t id_chars_size = internal::uuid_chars_size;
+
+/// Writes the same text as `to_string(id)` into [first, last), without allocating. Like `std::to_chars()`, it doesn't add a null terminator.
+/// Returns `{last, std::errc::value_too_large}` if the buffer is smaller than `id_chars_size`.
+inline auto to_chars(char* first, char* last, AnyId const& id) -> std::to_chars_result
+{
+    if (last - first < static_cast<std::ptrdiff_t>(id_chars_size))
+        return {last, std::errc::value_too_large};
+    internal::encode_uuid(id.underlying_uuid(), first);
+    return {first + id_chars_size, std::errc{}};
+}
+
 template<typename T>
-auto to_string(Id<T> const& id) -> std::string
+auto to_chars(char* first, char* last, Id<T> const& id) -> std::to_chars_result
 {
-    return uuids::to_string(id.underlying_uuid());
+    return to_chars(first, last, AnyId{id});
+}
+
+/// Parses an id written by `to_chars()` or `to_string()` (the hex digits can also be uppercase), from the start of [first, last), without allocating.
+/// Returns `{first, std::errc::invalid_argument}` and leaves `id` untouched if [first, last) doesn't start with a valid id.
+inline auto from_chars(char const* first, char const* last, AnyId& id) -> std::from_chars_result
+{
+    if (last - first < static_cast<std::ptrdiff_t>(id_chars_size))
+        return {first, std::errc::invalid_argument};
+    auto const uuid = internal::decode_uuid(first);
+    if (!uuid)
+        return {first, std::errc::invalid_argument};
+    id = AnyId{*uuid};
+    return {first + id_chars_size, std::errc{}};
+}
+
+template<typename T>
+auto from_chars(char const* first, char const* last, Id<T>& id) -> std::from_chars_result
+{
+    auto       any_id = AnyId{};
+    auto const result = from_chars(first, last, any_id);
+    if (result.ec == std::errc{})
+        id = any_id;
+    return result;
 }
 
 inline auto to_string(AnyId const& id) -> std::string
 {
-    return uuids::to_string(id.underlying_uuid());
+    auto result = std::string(id_chars_size, '\0');
+    internal::encode_uuid(id.underlying_uuid(), result.data());
+    return result;
+}
+
+template<typename T>
+auto to_string(Id<T> const& id) -> std::string
+{
+    return to_string(AnyId{id});
 }
 
 } // namespace reg
@@ -1,7 +1,13 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
+#include <algorithm>
 #include <cassert>
+#include <coroutine>
+#include <future>
+#include <latch>
+#include <thread>
 #include <reg/reg.hpp>
+#include <sstream>
 #include <tuple>
 
 template<typename Registry>
@@ -87,7 +93,41 @@ TEST_CASE_TEMPLATE("An AnyId is equal to the Id it was created from", Registry,
     REQUIRE(!(any_id1 == any_id2));
 }
 
-TEST_CASE_TEMPLATE("Getting an object", Registry, reg::Registry<float>, reg::OrderedRegistry<float>)
+TEST_CASE("Ids can be written to and parsed from text without allocating")
+{
+    for (int i = 0; i < 100; ++i)
+    {
+        auto const id     = reg::Id<float>{reg::generate_uuid()};
+        auto       buffer = std::array<char, reg::id_chars_size>{};
+        auto const result = reg::to_chars(buffer.data(), buffer.data() + buffer.size(), id);
+        REQUIRE(result.ec == std::errc{});
+        REQUIRE(result.ptr == buffer.data() + buffer.size());
+        auto const text = std::string(buffer.data(), buffer.size());
+        REQUIRE(text == uuids::to_string(id.underlying_uuid())); // Same text as stduuid
+        REQUIRE(text == reg::to_string(id));
+
+        auto parsed_id = reg::Id<float>{};
+        REQUIRE(reg::from_chars(text.data(), text.data() + text.size(), parsed_id).ec == std::errc{});
+        CHECK(parsed_id == id);
+    }
+
+    auto       id        = reg::AnyId{};
+    auto const uppercase = std::string{"00020B79-BE62-4749-95F9-938B042F3B6E"};
+    REQUIRE(reg::from_chars(uppercase.data(), uppercase.data() + uppercase.size(), id).ec == std::errc{});
+    CHECK(reg::to_string(id) == "00020b79-be62-4749-95f9-938b042f3b6e");
+
+    for (auto const* invalid : {"00020b79-be62-4749-95f9-938b042f3b6", "00020b79be62-4749-95f9-938b042f3b6e0", "00020b79-be62-4749-95f9-938b042f3b6g", "00020b79-be62-4749-95f9-938b042f3b\xe9"})
+    {
+        auto const text = std::string_view{invalid};
+        CHECK(reg::from_chars(text.data(), text.data() + text.size(), id).ec == std::errc::invalid_argument);
+    }
+    CHECK(reg::to_string(id) == "00020b79-be62-4749-95f9-938b042f3b6e"); // Left untouched by the failed parses
+
+    auto small_buffer = std::array<char, 10>{};
+    CHECK(reg::to_chars(small_buffer.data(), small_buffer.data() + small_buffer.size(), id).ec == std::errc::value_too_large);
+}
+
+TEST_CASE_TEMPLATE("Getting an object", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
 {
     auto       registry = Registry{};
     auto const id       = registry.create_unique(17.f);
@@ -131,7 +171,7 @@ TEST_CASE_TEMPLATE("Getting an object", Registry, reg::Registry<float>, reg::Ord
     }
 }
 
-TEST_CASE_TEMPLATE("Setting an object", Registry, reg::Registry<float>, reg::OrderedRegistry<float>)
+TEST_CASE_TEMPLATE("Setting an object", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
 {
     auto       registry = Registry{};
     auto const id       = registry.create_unique(17.f);
@@ -161,7 +201,7 @@ TEST_CASE_TEMPLATE("Setting an object", Registry, reg::Registry<float>, reg::Ord
     }
 }
 
-TEST_CASE_TEMPLATE("Objects can be created, retrieved and destroyed", Registry, reg::Registry<float>, reg::OrderedRegistry<float>)
+TEST_CASE_TEMPLATE("Objects can be created, retrieved and destroyed", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
 {
     auto registry = Registry{};
 
@@ -205,7 +245,7 @@ TEST_CASE_TEMPLATE("Objects can be created, retrieved and destroyed", Registry,
     }
 }
 
-TEST_CASE_TEMPLATE("You can iterate over the ids and values in the registry", Registry, reg::Registry<float>, reg::OrderedRegistry<float>)
+TEST_CASE_TEMPLATE("You can iterate over the ids and values in the registry", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
 {
     auto       registry = Registry{};
     auto const my_value = 1.f;
@@ -313,7 +353,7 @@ TEST_CASE_TEMPLATE("Registries expose the thread-safe functions of the underlyin
     REQUIRE(!registries.get(id.raw()));
 }
 
-TEST_CASE_TEMPLATE("is_empty()", Registry, reg::Registry<float>, reg::OrderedRegistry<float>)
+TEST_CASE_TEMPLATE("is_empty()", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
 {
     auto registry = Registry{};
     CHECK(registry.is_empty());
@@ -324,7 +364,7 @@ TEST_CASE_TEMPLATE("is_empty()", Registry, reg::Registry<float>, reg::OrderedReg
     CHECK(registry.is_empty());
 }
 
-TEST_CASE_TEMPLATE("clear()", Registry, reg::Registry<float>, reg::OrderedRegistry<float>)
+TEST_CASE_TEMPLATE("clear()", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
 {
     auto registry = Registry{};
     std::ignore   = registry.create_unique(3.f);
@@ -336,7 +376,9 @@ TEST_CASE_TEMPLATE("clear()", Registry, reg::Registry<float>, reg::OrderedRegist
 TEST_CASE_TEMPLATE(
     "UniqueId", Registry,
     reg::Registry<float>,
-    reg::OrderedRegistry<float>
+    reg::OrderedRegistry<float>,
+    reg::PersistentRegistry<float>,
+    reg::SortedRegistry<float>
 )
 {
     auto registry = Registry{};
@@ -385,15 +427,1291 @@ TEST_CASE_TEMPLATE(
 #pragma GCC diagnostic pop
 }
 
+struct CopyMoveCounter {
+    static inline int copies = 0; // NOLINT(*-avoid-non-const-global-variables)
+    static inline int moves  = 0; // NOLINT(*-avoid-non-const-global-variables)
+
+    static void reset()
+    {
+        copies = 0;
+        moves  = 0;
+    }
+
+    CopyMoveCounter() = default;
+    explicit CopyMoveCounter(int value)
+        : value{value}
+    {}
+    CopyMoveCounter(CopyMoveCounter const& other)
+        : value{other.value}
+    {
+        copies++;
+    }
+    CopyMoveCounter(CopyMoveCounter&& other) noexcept
+        : value{other.value}
+    {
+        moves++;
+    }
+    auto operator=(CopyMoveCounter const& other) -> CopyMoveCounter&
+    {
+        value = other.value;
+        copies++;
+        return *this;
+    }
+    auto operator=(CopyMoveCounter&& other) noexcept -> CopyMoveCounter&
+    {
+        value = other.value;
+        moves++;
+        return *this;
+    }
+    ~CopyMoveCounter() = default;
+
+    int value{0};
+};
+
+TEST_CASE_TEMPLATE("Creating and setting objects from temporaries never copies them", Registry, reg::Registry<CopyMoveCounter>, reg::OrderedRegistry<CopyMoveCounter>)
+{
+    auto registry = Registry{};
+
+    SUBCASE("emplace_xxx() constructs the object in-place")
+    {
+        CopyMoveCounter::reset();
+        auto const unique_id = registry.emplace_unique(1);
+        CHECK(CopyMoveCounter::copies == 0);
+        CHECK(CopyMoveCounter::moves == 0);
+        auto const shared_id = registry.emplace_shared(2);
+        auto const raw_id    = registry.emplace_raw(3);
+        CHECK(CopyMoveCounter::copies == 0); // NB: we don't check the moves here because the `std::vector` used by `OrderedRegistry` moves its elements when it grows
+        registry.with_ref(unique_id.raw(), [](CopyMoveCounter const& value) { CHECK(value.value == 1); });
+        registry.with_ref(shared_id.raw(), [](CopyMoveCounter const& value) { CHECK(value.value == 2); });
+        registry.with_ref(raw_id, [](CopyMoveCounter const& value) { CHECK(value.value == 3); });
+    }
+    SUBCASE("create_xxx() moves temporaries")
+    {
+        CopyMoveCounter::reset();
+        auto const unique_id = registry.create_unique(CopyMoveCounter{1});
+        CHECK(CopyMoveCounter::copies == 0);
+        CHECK(CopyMoveCounter::moves == 1);
+        registry.with_ref(unique_id.raw(), [](CopyMoveCounter const& value) { CHECK(value.value == 1); });
+    }
+    SUBCASE("set() moves temporaries")
+    {
+        auto const id = registry.emplace_unique(1);
+        CopyMoveCounter::reset();
+        CHECK(registry.set(id.raw(), CopyMoveCounter{2}));
+        CHECK(CopyMoveCounter::copies == 0);
+        CHECK(CopyMoveCounter::moves == 1);
+        registry.with_ref(id.raw(), [](CopyMoveCounter const& value) { CHECK(value.value == 2); });
+    }
+    SUBCASE("Lvalues are still copied exactly once")
+    {
+        auto const value = CopyMoveCounter{1};
+        CopyMoveCounter::reset();
+        auto const id = registry.create_unique(value);
+        CHECK(CopyMoveCounter::copies == 1);
+        CHECK(CopyMoveCounter::moves == 0);
+        CHECK(registry.set(id.raw(), value));
+        CHECK(CopyMoveCounter::copies == 2);
+    }
+}
+
+TEST_CASE("OrderedRegistry finds its objects whether it is small or big")
+{
+    auto registry = reg::OrderedRegistry<int>{};
+    auto ids      = std::vector<reg::Id<int>>{};
+    for (int i = 0; i < 200; ++i) // Goes above the threshold where the map starts using its hash index
+    {
+        ids.push_back(registry.create_raw(i));
+        for (int j = 0; j <= i; j += 7)
+            CHECK(registry.get(ids[static_cast<size_t>(j)]) == j);
+    }
+    for (int i = 0; i < 190; ++i) // And back below it
+    {
+        registry.destroy(ids[static_cast<size_t>(i)]);
+        CHECK(!registry.contains(ids[static_cast<size_t>(i)]));
+        for (int j = i + 1; j < 200; j += 7)
+            CHECK(registry.get(ids[static_cast<size_t>(j)]) == j);
+    }
+    auto index = 190;
+    for (auto const& [id, value] : std::as_const(registry)) // Still in insertion order
+        CHECK(value == index++);
+}
+
+TEST_CASE("Registries forward temporaries and constructor arguments without copying")
+{
+    using Registries = reg::Registries<
+        reg::Registry<CopyMoveCounter>,
+        reg::Registry<int>>;
+    Registries registries{};
+
+    CopyMoveCounter::reset();
+    auto const id1 = registries.emplace_unique<CopyMoveCounter>(1);
+    auto const id2 = registries.create_shared(CopyMoveCounter{2});
+    auto const id3 = registries.emplace_raw<CopyMoveCounter>(3);
+    CHECK(registries.set(id3, CopyMoveCounter{4}));
+    CHECK(CopyMoveCounter::copies == 0);
+    CHECK(CopyMoveCounter::moves == 2);
+    CHECK(registries.get(id1.raw())->value == 1);
+    CHECK(registries.get(id2.raw())->value == 2);
+    CHECK(registries.get(id3)->value == 4);
+
+    int const value = 5;
+    auto const id4  = registries.create_raw(value);
+    CHECK(registries.get(id4) == 5);
+}
+
+struct Car {
+    reg::Id<int>                engine{};
+    std::vector<reg::Id<float>> wheels{};
+};
+
+template<>
+struct reg::References<Car> {
+    template<typename Callback>
+    static void for_each(Car const& car, Callback&& callback)
+    {
+        callback(car.engine);
+        for (auto const& wheel : car.wheels)
+            callback(wheel);
+    }
+};
+
+TEST_CASE("Registries can find the dependents of an object")
+{
+    using Registries = reg::Registries<
+        reg::Registry<int>,
+        reg::Registry<float>,
+        reg::Registry<Car>>;
+    Registries registries{};
+    auto const engine       = registries.create_raw(1);
+    auto const wheel1       = registries.create_raw(1.f);
+    auto const wheel2       = registries.create_raw(2.f);
+    auto const existing_car = registries.create_raw(Car{.engine = engine, .wheels = {wheel1}});
+
+    SUBCASE("without the reference index") {}
+    SUBCASE("with the reference index")
+    {
+        registries.enable_reference_index();
+        REQUIRE(registries.has_reference_index());
+    }
+    SUBCASE("with a rebuilt reference index")
+    {
+        registries.enable_reference_index();
+        registries.rebuild_reference_index();
+        registries.rebuild_reference_index();
+    }
+    static_assert(reg::HasReferences<Car>);
+    static_assert(!reg::HasReferences<int>);
+
+    auto const sorted_dependents_of = [&](reg::AnyId const& id) {
+        auto dependents = registries.dependents_of(id);
+        std::sort(dependents.begin(), dependents.end(), [](auto const& a, auto const& b) { return reg::internal::compare_uuids(a.underlying_uuid(), b.underlying_uuid()) < 0; });
+        return dependents;
+    };
+    auto const sorted = [](std::vector<reg::AnyId> ids) {
+        std::sort(ids.begin(), ids.end(), [](auto const& a, auto const& b) { return reg::internal::compare_uuids(a.underlying_uuid(), b.underlying_uuid()) < 0; });
+        return ids;
+    };
+
+    auto const new_car = registries.create_raw(Car{.engine = engine, .wheels = {wheel1, wheel1, wheel2}}); // Referencing an object twice only counts once
+    CHECK(sorted_dependents_of(engine) == sorted({existing_car, new_car}));
+    CHECK(sorted_dependents_of(wheel1) == sorted({existing_car, new_car}));
+    CHECK(sorted_dependents_of(wheel2) == std::vector<reg::AnyId>{new_car});
+    CHECK(registries.dependents_of(existing_car).empty());
+
+    registries.of<Car>().with_mutable_ref(new_car, [](Car& car) { car.wheels.pop_back(); });
+    CHECK(registries.dependents_of(wheel2).empty());
+    CHECK(registries.set(existing_car, Car{.wheels = {wheel2}}));
+    CHECK(sorted_dependents_of(engine) == std::vector<reg::AnyId>{new_car});
+
+    // The dependents of a destroyed object can still be found, to fix their dangling ids
+    registries.destroy(engine);
+    CHECK(sorted_dependents_of(engine) == std::vector<reg::AnyId>{new_car});
+    registries.destroy(new_car);
+    CHECK(registries.dependents_of(engine).empty());
+    {
+        auto const owning_car = registries.create_unique(Car{.wheels = {wheel2}});
+        CHECK(sorted_dependents_of(wheel2) == sorted({existing_car, owning_car.raw()}));
+    }
+    CHECK(sorted_dependents_of(wheel2) == std::vector<reg::AnyId>{existing_car});
+}
+
+TEST_CASE("The reference index sees the modifications done with visit_mutable()")
+{
+    using Registries = reg::Registries<
+        reg::Registry<int>,
+        reg::Registry<Car>>;
+    Registries registries{};
+    registries.enable_reference_index();
+    auto const engine_a = registries.create_raw(1);
+    auto const engine_b = registries.create_raw(2);
+    auto const car      = registries.create_raw(Car{.engine = engine_a});
+    REQUIRE(registries.dependents_of(engine_a).size() == 1);
+
+    CHECK(registries.visit_mutable(reg::AnyId{car}, [&](auto const&, auto& value) {
+        if constexpr (std::is_same_v<std::remove_cvref_t<decltype(value)>, Car>)
+            value.engine = engine_b;
+    }));
+    CHECK(registries.dependents_of(engine_a).empty());
+    CHECK(registries.dependents_of(engine_b) == std::vector<reg::AnyId>{car});
+}
+
+TEST_CASE("Registries can find the registry of an AnyId")
+{
+    using Registries = reg::Registries<
+        reg::Registry<int>,
+        reg::Registry<float>,
+        reg::Registry<double>>;
+    Registries registries{};
+    auto const id_created_before_directory = registries.create_raw(1.);
+
+    SUBCASE("without the id directory") {}
+    SUBCASE("with the id directory")
+    {
+        registries.enable_id_directory();
+        REQUIRE(registries.has_id_directory());
+    }
+    SUBCASE("with a rebuilt id directory")
+    {
+        registries.enable_id_directory();
+        registries.rebuild_id_directory();
+        registries.rebuild_id_directory();
+    }
+
+    auto       int_id   = registries.create_unique(3);
+    auto const float_id = registries.create_raw(5.f);
+
+    CHECK(registries.contains(reg::AnyId{int_id.raw()}));
+    CHECK(registries.contains(reg::AnyId{float_id}));
+    CHECK(registries.contains(reg::AnyId{id_created_before_directory}));
+    CHECK(!registries.contains(reg::AnyId{}));
+
+    bool const found = registries.visit(reg::AnyId{float_id}, [&](auto const& id, auto const& value) {
+        using T = std::remove_cvref_t<decltype(value)>;
+        REQUIRE(std::is_same_v<T, float>);
+        if constexpr (std::is_same_v<T, float>)
+        {
+            CHECK(id == float_id);
+            CHECK(value == 5.f);
+        }
+    });
+    CHECK(found);
+
+    registries.visit_mutable(reg::AnyId{int_id.raw()}, [](auto const&, auto& value) {
+        value *= 2;
+    });
+    CHECK(registries.get(int_id.raw()) == 6);
+
+    registries.destroy(float_id);
+    CHECK(!registries.contains(reg::AnyId{float_id}));
+    CHECK(!registries.visit(reg::AnyId{float_id}, [](auto const&, auto const&) { REQUIRE(false); }));
+
+    auto const int_any_id = reg::AnyId{int_id.raw()};
+    {
+        auto const moved_id = std::move(int_id); // Destroying a UniqueId bypasses `Registries` but must still be seen by the directory
+        CHECK(registries.contains(int_any_id));
+    }
+    CHECK(!registries.contains(int_any_id));
+}
+
+TEST_CASE("Observers can be removed by their owner")
+{
+    auto       registry = reg::Registry<int>{};
+    auto       owner1   = 0;
+    auto       owner2   = 0;
+    auto       count1   = 0;
+    auto       count2   = 0;
+    auto const observer = [](int& count, void const* owner) {
+        return reg::internal::RegistryObserver<int>{
+            .on_insert = [&count](reg::Id<int> const&, int const&) { ++count; },
+            .validate  = [](reg::Id<int> const&, int const& value) {
+                if (value < 0)
+                    throw std::runtime_error{"Negative"};
+            },
+            .owner     = owner,
+        };
+    };
+    registry.underlying_wrapped_registry()->add_observer(observer(count1, &owner1));
+    registry.underlying_wrapped_registry()->add_observer(observer(count2, &owner2));
+
+    std::ignore = registry.create_raw(1);
+    registry.underlying_wrapped_registry()->remove_observers(&owner1);
+    std::ignore = registry.create_raw(2);
+    CHECK(count1 == 1);
+    CHECK(count2 == 2);
+    CHECK_THROWS(std::ignore = registry.create_raw(-1));
+
+    registry.underlying_wrapped_registry()->remove_observers(&owner2);
+    std::ignore = registry.create_raw(3);
+    CHECK(count2 == 2);
+    std::ignore = registry.create_raw(-1); // Doesn't throw, the validators are gone too
+}
+
+TEST_CASE_TEMPLATE("A snapshot is not affected by later modifications of the registry", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
+{
+    auto       registry = Registry{};
+    auto const id1      = registry.create_raw(1.f);
+    auto const id2      = registry.create_raw(2.f);
+
+    auto const snapshot = registry.snapshot();
+    REQUIRE(&snapshot.underlying_container() == &std::as_const(registry).underlying_container()); // The storage is shared until one of them is modified
+
+    registry.set(id1, 10.f);
+    registry.destroy(id2);
+    auto const id3 = registry.create_raw(3.f);
+    {
+        std::unique_lock lock{registry.mutex()};
+        *registry.get_mutable_ref(id3) = 30.f;
+    }
+
+    CHECK(&snapshot.underlying_container() != &std::as_const(registry).underlying_container());
+    CHECK(snapshot.get(id1) == 1.f);
+    CHECK(snapshot.get(id2) == 2.f);
+    CHECK(!snapshot.contains(id3));
+    CHECK(registry.get(id1) == 10.f);
+    CHECK(!registry.contains(id2));
+    CHECK(registry.get(id3) == 30.f);
+}
+
+TEST_CASE_TEMPLATE("A snapshot is not affected by modifications done through mutable references", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
+{
+    auto       registry = Registry{};
+    auto const id1      = registry.create_raw(1.f);
+    auto const id2      = registry.create_raw(2.f);
+
+    SUBCASE("get_mutable_ref()")
+    {
+        auto const snapshot = registry.snapshot();
+        *registry.get_mutable_ref(id1) = 10.f;
+        CHECK(snapshot.get(id1) == 1.f);
+        CHECK(registry.get(id1) == 10.f);
+    }
+    SUBCASE("get_mutable_ref() with a ResolvedId")
+    {
+        auto       resolved = registry.resolve(id1);
+        auto const snapshot = registry.snapshot();
+        *registry.get_mutable_ref(resolved) = 10.f;
+        CHECK(snapshot.get(id1) == 1.f);
+        CHECK(registry.get(id1) == 10.f);
+    }
+    if constexpr (!std::is_const_v<std::remove_reference_t<decltype((registry.begin()->second))>>) // The iterators of a PersistentMap are always const
+    {
+        SUBCASE("iterators")
+        {
+            auto const snapshot = registry.snapshot();
+            {
+                std::unique_lock lock{registry.mutex()}; // Detaches the registry from the snapshot
+                for (auto&& [id, value] : registry)
+                    value *= 10.f;
+            }
+            CHECK(snapshot.get(id1) == 1.f);
+            CHECK(snapshot.get(id2) == 2.f);
+            CHECK(registry.get(id1) == 10.f);
+            CHECK(registry.get(id2) == 20.f);
+        }
+    }
+}
+
+TEST_CASE_TEMPLATE("Readers can iterate a registry while snapshots are being taken", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
+{
+    auto registry = Registry{};
+    for (int i = 0; i < 100; ++i)
+        std::ignore = registry.create_raw(static_cast<float>(i));
+
+    auto has_seen_wrong_sum = std::atomic<bool>{false};
+    auto readers            = std::vector<std::thread>{};
+    for (int i = 0; i < 4; ++i)
+    {
+        readers.emplace_back([&]() {
+            for (int j = 0; j < 100; ++j)
+            {
+                std::shared_lock lock{registry.mutex()};
+                auto             sum = 0.f;
+                for (auto const& [id, value] : registry) // The non-const iterators, just like in a range-based for loop over a non-const registry
+                    sum += value;
+                if (sum != 4950.f)
+                    has_seen_wrong_sum = true;
+            }
+        });
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+        auto const snapshot = registry.snapshot(); // Released at the end of the iteration, while the readers might still be iterating
+        std::this_thread::yield();
+    }
+    for (auto& reader : readers)
+        reader.join();
+    CHECK(!has_seen_wrong_sum);
+}
+
+TEST_CASE("A moved-from BPlusTreeMap is empty and can still be used")
+{
+    auto registry = reg::SortedRegistry<float>{};
+    auto ids      = std::vector<reg::Id<float>>{};
+    for (int i = 0; i < 100; ++i) // Enough for the tree to have several levels
+        ids.push_back(registry.create_raw(static_cast<float>(i)));
+
+    auto map   = std::as_const(registry).underlying_container();
+    auto moved = std::move(map);
+    CHECK(moved.size() == 100);
+    CHECK(map.empty()); // NOLINT(bugprone-use-after-move)
+    CHECK(map.begin() == map.end());
+    CHECK(map.find(ids[0]) == map.end());
+    CHECK(map.try_emplace(ids[0], 1.f).second);
+    CHECK(map.size() == 1);
+
+    map = std::move(moved);
+    CHECK(map.size() == 100);
+    CHECK(moved.empty()); // NOLINT(bugprone-use-after-move)
+    CHECK(moved.erase(ids[0]) == 0);
+    CHECK(moved.try_emplace(ids[1], 2.f).second);
+    CHECK(moved.find(ids[1])->second == 2.f);
+}
+
+TEST_CASE_TEMPLATE("A ResolvedId stays valid when the registry changes", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
+{
+    auto       registry = Registry{};
+    auto const id       = registry.create_raw(1.f);
+    auto       resolved = registry.resolve(id);
+    CHECK(resolved.id() == id);
+    CHECK(registry.get(resolved) == 1.f);
+
+    // Moves the objects around (e.g. reallocations of an OrderedRegistry, copies of a PersistentRegistry)
+    auto ids = std::vector<reg::Id<float>>{};
+    for (int i = 0; i < 100; ++i)
+        ids.push_back(registry.create_raw(static_cast<float>(i)));
+    CHECK(registry.set(resolved, 2.f));
+    CHECK(registry.get(id) == 2.f);
+    auto const snapshot = registry.snapshot();
+    CHECK(registry.with_mutable_ref(resolved, [](float& value) { value = 3.f; }));
+    CHECK(registry.get(resolved) == 3.f);
+    CHECK(snapshot.get(id) == 2.f);
+    registry.destroy(ids.front());
+    CHECK(registry.with_ref(resolved, [](float const& value) { CHECK(value == 3.f); }));
+    {
+        std::unique_lock lock{registry.mutex()};
+        *registry.get_mutable_ref(resolved) = 4.f;
+        CHECK(*registry.get_ref(resolved) == 4.f);
+    }
+    registry.restore(snapshot);
+    CHECK(registry.get(resolved) == 2.f);
+
+    registry.destroy(id);
+    CHECK(!registry.contains(resolved));
+    CHECK(!registry.get(resolved));
+    CHECK(!registry.set(resolved, 5.f));
+
+    // A ResolvedId can't mistake an object of another registry for its own
+    auto other = Registry{};
+    other.underlying_wrapped_registry()->insert_raw(ids.back(), 6.f);
+    auto resolved_in_registry = registry.resolve(ids.back());
+    CHECK(other.get(resolved_in_registry) == 6.f);
+    CHECK(registry.get(resolved_in_registry) == 99.f);
+}
+
+TEST_CASE_TEMPLATE("Objects can be moved between registries and keep their id", Registry, reg::Registry<std::string>, reg::OrderedRegistry<std::string>, reg::PersistentRegistry<std::string>, reg::SortedRegistry<std::string>)
+{
+    auto       source      = Registry{};
+    auto       destination = Registry{};
+    auto const id          = source.create_raw(std::string(100, 'a'));
+
+    auto node = source.extract(id);
+    REQUIRE(!node.empty());
+    CHECK(node.id() == id);
+    auto const* const value_address = node.value().data();
+    CHECK(!source.contains(id));
+    CHECK(destination.insert(std::move(node)));
+    CHECK(node.empty());
+    CHECK(destination.get(id) == std::string(100, 'a'));
+    {
+        std::shared_lock lock{destination.mutex()};
+        CHECK(destination.get_ref(id)->data() == value_address); // The string has not been copied
+    }
+    CHECK(source.extract(id).empty());
+
+    CHECK(destination.transfer(id, source));
+    CHECK(source.get(id) == std::string(100, 'a'));
+    CHECK(!destination.contains(id));
+    CHECK(!destination.transfer(id, source));
+
+    // The other kinds of registries accept the node too
+    auto other = reg::Registry<std::string>{};
+    CHECK(other.insert(source.extract(id)));
+    CHECK(other.get(id) == std::string(100, 'a'));
+
+    // The node keeps its object if the id is already taken
+    source.underlying_wrapped_registry()->insert_raw(id, "b");
+    auto taken = source.extract(id);
+    CHECK(!other.insert(std::move(taken)));
+    CHECK(taken.value() == "b");
+}
+
+TEST_CASE("Transferring an object refused by the destination leaves it in the source")
+{
+    auto source      = reg::Registry<int>{};
+    auto destination = reg::Registry<int>{};
+    destination.underlying_wrapped_registry()->add_observer({.validate = [](reg::Id<int>, int const& value) {
+        if (value < 0)
+            throw std::invalid_argument{"negative"};
+    }});
+    auto const positive = source.create_raw(1);
+    auto const negative = source.create_raw(-1);
+
+    CHECK(source.transfer(positive, destination));
+    CHECK_THROWS_AS(source.transfer(negative, destination), std::invalid_argument);
+    CHECK(source.get(negative) == -1);
+    CHECK(!destination.contains(negative));
+    CHECK(destination.get(positive) == 1);
+}
+
+TEST_CASE("Registries can resolve ids")
+{
+    auto       registries = reg::Registries<reg::Registry<float>, reg::Registry<int>>{};
+    auto const id         = registries.create_raw(3);
+    auto       resolved   = registries.resolve(id);
+    CHECK(registries.get(resolved) == 3);
+    CHECK(registries.with_mutable_ref(resolved, [](int& value) { ++value; }));
+    CHECK(registries.with_ref(resolved, [](int const& value) { CHECK(value == 4); }));
+}
+
+TEST_CASE("PersistentRegistry can restore and diff its snapshots")
+{
+    auto registry = reg::PersistentRegistry<int>{};
+    auto ids      = std::vector<reg::Id<int>>{};
+    for (int i = 0; i < 2000; ++i) // Enough objects for the trie to have several levels
+        ids.push_back(registry.create_raw(i));
+    auto const owned_id = registry.create_unique(-1);
+
+    auto const before = registry.snapshot();
+    registry.set(ids[10], 100);
+    registry.with_mutable_ref(ids[20], [](int& value) { value = 200; });
+    registry.destroy(ids[30]);
+    auto const new_id = registry.create_raw(3000);
+
+    auto const changes = reg::diff(before, registry);
+    CHECK(changes.added == std::vector{new_id});
+    CHECK(changes.removed == std::vector{ids[30]});
+    CHECK(changes.modified.size() == 2);
+    CHECK(reg::diff(registry, registry.snapshot()).modified.empty());
+
+    // Undo
+    registry.restore(before);
+    CHECK(registry.get(ids[10]) == 10);
+    CHECK(registry.get(ids[20]) == 20);
+    CHECK(registry.get(ids[30]) == 30);
+    CHECK(!registry.contains(new_id));
+    CHECK(size(registry) == 2001);
+
+    for (int i = 0; i < 2000; ++i)
+        REQUIRE(registry.get(ids[static_cast<size_t>(i)]) == i);
+    for (auto const& id : ids)
+        registry.destroy(id);
+    CHECK(size(registry) == 1);
+    CHECK(registry.contains(owned_id.raw()));
+    CHECK(before.get(ids[1999]) == 1999);
+}
+
+TEST_CASE("SortedRegistry keeps its objects sorted by id")
+{
+    auto registry = reg::SortedRegistry<int>{};
+    auto ids      = std::vector<reg::Id<int>>{};
+    for (int i = 0; i < 3000; ++i) // Enough objects for the tree to have several levels
+        ids.push_back(registry.create_raw(i));
+    for (size_t i = 0; i < ids.size(); i += 3) // Erasing lots of objects makes the tree merge and rebalance its nodes
+        registry.destroy(ids[i]);
+    CHECK(size(registry) == 2000);
+    for (size_t i = 0; i < ids.size(); ++i)
+        REQUIRE(registry.contains(ids[i]) == (i % 3 != 0));
+
+    auto sorted_ids = std::vector<reg::Id<int>>{};
+    for (auto const& [id, value] : std::as_const(registry))
+    {
+        CHECK(registry.get(id) == value);
+        sorted_ids.push_back(id);
+    }
+    CHECK(std::is_sorted(sorted_ids.begin(), sorted_ids.end(), &reg::id_less<int>));
+
+    // Range scans
+    auto in_range = std::vector<reg::Id<int>>{};
+    reg::for_each_in_range(registry, sorted_ids[100], sorted_ids[250], [&](reg::Id<int> const& id, int) { in_range.push_back(id); });
+    CHECK(in_range == std::vector<reg::Id<int>>(sorted_ids.begin() + 100, sorted_ids.begin() + 250));
+
+    // Merge-joins
+    auto other = reg::SortedRegistry<float>{};
+    for (size_t i = 0; i < ids.size(); i += 2)
+        other.underlying_wrapped_registry()->insert_raw(reg::Id<float>{ids[i].underlying_uuid()}, static_cast<float>(i));
+    auto joined_count = 0;
+    reg::merge_join(registry, other, [&](reg::AnyId const&, int value, float other_value) {
+        CHECK(static_cast<float>(value) == other_value);
+        ++joined_count;
+    });
+    CHECK(joined_count == 1000); // The ids that are multiples of 2 but not of 3
+}
+
+TEST_CASE_TEMPLATE("HashedRegistry diffs two registries in a time proportional to their differences", Registry, reg::HashedRegistry<std::string>, reg::HashedOrderedRegistry<std::string>)
+{
+    using UnderlyingRegistry = std::remove_cvref_t<decltype(std::declval<Registry const&>().underlying_registry())>;
+    auto registry            = UnderlyingRegistry{};
+    auto ids                 = std::vector<reg::Id<std::string>>{};
+    for (int i = 0; i < 10000; ++i)
+        ids.push_back(registry.create_raw(std::to_string(i)));
+
+    // Two registries with the same content, created in a different order
+    auto before = Registry{std::move(registry)};
+    auto after  = Registry{};
+    for (size_t i = ids.size(); i-- > 0;)
+        after.underlying_registry().underlying_wrapped_registry()->insert_raw(ids[i], std::to_string(i));
+    CHECK(before.content_hash() == after.content_hash());
+    CHECK(reg::diff(before, after).modified.empty());
+
+    after.set(ids[1], "one");
+    after.with_mutable_ref(ids[2], [](std::string& value) { value += "!"; });
+    after.with_mutable_ref(ids[3], [](std::string&) {}); // Not actually modified
+    after.destroy(ids[4]);
+    auto const new_id = after.create_raw("new");
+    CHECK(before.content_hash() != after.content_hash());
+
+    auto changes = reg::diff(before, after);
+    std::sort(changes.modified.begin(), changes.modified.end(), &reg::id_less<std::string>);
+    auto expected_modified = std::vector{ids[1], ids[2]};
+    std::sort(expected_modified.begin(), expected_modified.end(), &reg::id_less<std::string>);
+    CHECK(changes.added == std::vector{new_id});
+    CHECK(changes.removed == std::vector{ids[4]});
+    CHECK(changes.modified == expected_modified);
+
+    // Undo the changes
+    after.set(ids[1], "1");
+    after.set(ids[2], "2");
+    after.destroy(new_id);
+    after.underlying_registry().underlying_wrapped_registry()->insert_raw(ids[4], "4");
+    CHECK(before.content_hash() == after.content_hash());
+}
+
+TEST_CASE_TEMPLATE("The membership filter rejects missing ids without changing the results", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
+{
+    auto       registry           = Registry{};
+    auto const id_created_earlier = registry.create_raw(1.f);
+    auto const usage_before       = registry.memory_usage().overhead;
+    registry.enable_membership_filter(1000);
+    CHECK(registry.underlying_wrapped_registry()->has_membership_filter());
+    CHECK(registry.memory_usage().overhead > usage_before);
+
+    auto ids = std::vector<reg::Id<float>>{};
+    for (int i = 0; i < 1000; ++i)
+        ids.push_back(registry.create_raw(static_cast<float>(i)));
+    for (size_t i = 0; i < ids.size(); i += 2)
+        registry.destroy(ids[i]);
+
+    CHECK(registry.contains(id_created_earlier));
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        auto const is_alive = i % 2 == 1;
+        REQUIRE(registry.contains(ids[i]) == is_alive);
+        REQUIRE(registry.get(ids[i]).has_value() == is_alive);
+        REQUIRE(registry.with_ref(ids[i], [](float const&) {}) == is_alive);
+        REQUIRE(registry.set(ids[i], 0.f) == is_alive);
+    }
+    CHECK(!registry.contains(reg::Id<float>{}));
+    auto resolved_destroyed_id = registry.resolve(ids[0]);
+    auto resolved_alive_id     = registry.resolve(ids[1]);
+    CHECK(!registry.get(resolved_destroyed_id));
+    CHECK(!registry.set(resolved_destroyed_id, 1.f));
+    CHECK(registry.get(resolved_alive_id) == 0.f);
+
+    auto const kept_id = registry.create_raw(3.f);
+    registry.clear();
+    CHECK(!registry.contains(kept_id));
+    registry.underlying_wrapped_registry()->insert_raw(kept_id, 3.f);
+    CHECK(registry.get(kept_id) == 3.f);
+}
+
+TEST_CASE("The membership filter has few false positives")
+{
+    auto filter = reg::internal::MembershipFilter{1000};
+    auto uuids  = std::vector<uuids::uuid>{};
+    for (int i = 0; i < 1000; ++i)
+    {
+        uuids.push_back(reg::generate_uuid());
+        filter.insert(uuids.back());
+    }
+    for (auto const& uuid : uuids)
+        REQUIRE(filter.may_contain(uuid));
+
+    int false_positives_count = 0;
+    for (int i = 0; i < 10'000; ++i)
+        false_positives_count += filter.may_contain(reg::generate_uuid()) ? 1 : 0;
+    CHECK(false_positives_count < 300);
+
+    for (auto const& uuid : uuids)
+        filter.erase(uuid);
+    for (auto const& uuid : uuids)
+        REQUIRE(!filter.may_contain(uuid));
+}
+
+TEST_CASE_TEMPLATE("memory_usage(), reserve() and shrink_to_fit()", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::PersistentRegistry<float>, reg::SortedRegistry<float>)
+{
+    auto registry = Registry{};
+    auto ids      = std::vector<reg::Id<float>>{};
+    for (int i = 0; i < 100; ++i)
+        ids.push_back(registry.create_raw(static_cast<float>(i)));
+
+    auto const usage = registry.memory_usage();
+    CHECK(usage.keys == 100 * sizeof(reg::Id<float>));
+    CHECK(usage.values == 100 * sizeof(float));
+    CHECK(usage.overhead > 0);
+    CHECK(usage.owning_ids == 0);
+    {
+        auto const owned_id  = registry.create_unique(1.f);
+        auto const shared_id = registry.create_shared(2.f);
+        auto const copy      = shared_id;
+        CHECK(registry.memory_usage().owning_ids == 2 * sizeof(reg::internal::IdDestroyer<float>) + reg::internal::shared_id_control_block_size);
+    }
+    CHECK(registry.memory_usage().owning_ids == 0);
+    {
+        auto const shared_ids = std::vector{registry.create_shared(1.f), registry.create_shared(2.f)};
+        CHECK(registry.memory_usage().owning_ids == 2 * (sizeof(reg::internal::IdDestroyer<float>) + reg::internal::shared_id_control_block_size));
+    }
+    CHECK(registry.memory_usage().owning_ids == 0);
+    CHECK(registry.memory_usage().values == usage.values);
+
+    registry.clear();
+    registry.shrink_to_fit();
+    CHECK(registry.memory_usage().total() < usage.total());
+    registry.reserve(1000);
+    CHECK(registry.is_empty());
+    if constexpr (!std::is_same_v<Registry, reg::PersistentRegistry<float>> && !std::is_same_v<Registry, reg::SortedRegistry<float>>)
+        CHECK(registry.memory_usage().overhead >= 1000 * sizeof(float)); // The capacity has been reserved
+}
+
+TEST_CASE("Registries report the memory usage of each registry")
+{
+    auto registries = reg::Registries<reg::Registry<int>, reg::OrderedRegistry<float>>{};
+    std::ignore     = registries.create_raw(1);
+    std::ignore     = registries.create_raw(1.f);
+    std::ignore     = registries.create_raw(2.f);
+
+    auto const usages = registries.memory_usage();
+    CHECK(usages[0].values == sizeof(int));
+    CHECK(usages[1].values == 2 * sizeof(float));
+    CHECK(usages[1] == registries.memory_usage<float>());
+}
+
+TEST_CASE("Operations can be recorded to a trace")
+{
+    auto trace = std::stringstream{};
+    {
+        auto registry = reg::Registry<float>{};
+        registry.set_trace_recorder(std::make_shared<reg::TraceRecorder>(trace));
+
+        auto const id = registry.create_raw(1.f);
+        std::ignore   = registry.get(id);
+        registry.set(id, 2.f);
+        std::thread{[&]() { registry.with_mutable_ref(id, [](float& value) { value = 3.f; }); }}.join();
+        {
+            std::shared_lock lock{registry.mutex()};
+            for (auto const& [object_id, value] : registry)
+                CHECK(value == 3.f);
+            std::thread{[&]() { CHECK(!registry.mutex().try_lock()); }}.join(); // A failed attempt is not recorded
+        }
+        registry.destroy(id);
+    } // The recorder flushes the trace when it is destroyed
+
+    auto const records = reg::read_trace(trace);
+    auto       ops     = std::vector<reg::TraceOp>{};
+    for (auto const& record : records)
+        ops.push_back(record.op);
+    CHECK(ops == std::vector{reg::TraceOp::Create, reg::TraceOp::Get, reg::TraceOp::Set, reg::TraceOp::WithMutableRef, reg::TraceOp::LockShared, reg::TraceOp::Iterate, reg::TraceOp::UnlockShared, reg::TraceOp::Destroy});
+    CHECK(records[0].id == records[1].id);
+    CHECK(records[4].id.is_nil());
+    CHECK(records[3].thread_index == 1);
+    CHECK(records[4].thread_index == 0);
+    CHECK(std::is_sorted(records.begin(), records.end(), [](auto const& a, auto const& b) { return a.timestamp < b.timestamp; }));
+}
+
+TEST_CASE("Registries can be checkpointed asynchronously")
+{
+    using Registries = reg::Registries<
+        reg::Registry<int>,
+        reg::Registry<float>>;
+    Registries registries{};
+    auto const int_id   = registries.create_raw(1);
+    auto const float_id = registries.create_raw(1.f);
+
+    auto can_start_saving = std::promise<void>{};
+    auto checkpoint       = registries.async_checkpoint([&, start = can_start_saving.get_future()](Registries& snapshot) {
+        start.wait();
+        return std::pair{*snapshot.get(int_id), *snapshot.get(float_id)};
+    });
+
+    // We can keep modifying the registries while the checkpoint is being saved
+    registries.set(int_id, 2);
+    registries.destroy(float_id);
+    can_start_saving.set_value();
+
+    auto const saved_values = checkpoint.get();
+    CHECK(saved_values.first == 1);
+    CHECK(saved_values.second == 1.f);
+    CHECK(registries.get(int_id) == 2);
+    CHECK(!registries.get(float_id));
+}
+
+TEST_CASE_TEMPLATE("Registries can use any Lock", Lock, std::shared_mutex, reg::NullMutex, reg::SpinSharedMutex, reg::ReaderBiasedSharedMutex, reg::AsyncSharedMutex)
+{
+    auto registry = reg::Registry<int, Lock>{};
+    static_assert(std::is_same_v<typename decltype(registry)::LockType, Lock>);
+
+    {
+        auto const id = registry.create_unique(1);
+        CHECK(registry.get(id.raw()) == 1);
+        {
+            std::unique_lock lock{registry.mutex()}; // Manual locking still works the same
+            *registry.get_mutable_ref(id.raw()) = 2;
+        }
+        {
+            std::shared_lock lock{registry.mutex()};
+            CHECK(*registry.get_ref(id.raw()) == 2);
+        }
+    }
+    CHECK(registry.is_empty()); // Owning ids work with any Lock
+}
+
+TEST_CASE_TEMPLATE("Locks protect registries accessed by several threads", Lock, std::shared_mutex, reg::SpinSharedMutex, reg::ReaderBiasedSharedMutex, reg::AsyncSharedMutex)
+{
+    auto       registry = reg::Registry<int, Lock>{};
+    auto const id       = registry.create_raw(0);
+
+    auto threads = std::vector<std::thread>{};
+    for (int thread_index = 0; thread_index < 4; ++thread_index)
+    {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                registry.with_mutable_ref(id, [](int& value) { value++; });
+                std::ignore = registry.get(id);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    CHECK(registry.get(id) == 4000);
+}
+
+#if defined(__linux__)
+#include <sched.h>
+
+TEST_CASE("ReaderBiasedSharedMutex supports readers that move to another CPU")
+{
+    auto allowed_cpus = cpu_set_t{};
+    REQUIRE(sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) == 0);
+    auto cpus = std::vector<std::size_t>{};
+    for (std::size_t cpu = 0; cpu < CPU_SETSIZE && cpus.size() < 2; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &allowed_cpus))
+            cpus.push_back(cpu);
+    }
+    auto const run_on = [](std::size_t cpu) {
+        auto cpu_set = cpu_set_t{};
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        REQUIRE(sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0);
+    };
+
+    std::thread{[&]() { // On its own thread, so that changing the affinity doesn't affect the other tests
+        auto mutex = reg::ReaderBiasedSharedMutex{};
+        run_on(cpus.front());
+        mutex.lock_shared();
+        run_on(cpus.back()); // Unlocks on another CPU than the one that locked (if there are several)
+        CHECK(!mutex.try_lock());
+        mutex.unlock_shared();
+        CHECK(mutex.try_lock());
+        mutex.unlock();
+    }}.join();
+}
+#endif
+
+/// A coroutine that starts right away, and that nobody waits for.
+struct DetachedCoroutine {
+    struct promise_type {
+        auto get_return_object() -> DetachedCoroutine { return {}; }
+        auto initial_suspend() noexcept -> std::suspend_never { return {}; }
+        auto final_suspend() noexcept -> std::suspend_never { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+TEST_CASE("Coroutines wait for the registry without blocking their thread")
+{
+    auto       registry = reg::Registry<int, reg::AsyncSharedMutex>{};
+    auto const id       = registry.create_raw(1);
+
+    auto results         = std::vector<bool>{};
+    auto seen_value      = 0;
+    auto callback_thread = std::thread::id{};
+    auto const increment = [&](reg::Id<int> id_to_increment) -> DetachedCoroutine {
+        results.push_back(co_await registry.async_with_mutable_ref(id_to_increment, [](int& value) { ++value; }));
+    };
+    auto const read = [&]() -> DetachedCoroutine {
+        results.push_back(co_await registry.async_with_ref(id, [&](int const& value) {
+            seen_value      = value;
+            callback_thread = std::this_thread::get_id();
+        }));
+    };
+
+    increment(id); // The registry is not locked, so this completes right away
+    CHECK(results == std::vector{true});
+    CHECK(registry.get(id) == 2);
+
+    auto const snapshot = registry.snapshot();
+    {
+        std::unique_lock lock{registry.mutex()};
+        *registry.get_mutable_ref(id) = 10;
+        std::thread{[&]() { read(); }}.join(); // The coroutine gets suspended, so its thread is free to go
+        std::thread{[&]() { increment(id); }}.join();
+        std::thread{[&]() { increment(reg::Id<int>{}); }}.join();
+        CHECK(results.size() == 1);
+    } // Hands the lock over to the coroutines and resumes them on this thread
+    CHECK(results.size() == 4);
+    CHECK(std::count(results.begin(), results.end(), false) == 1); // Only the coroutine with an invalid id failed
+    CHECK(seen_value == 10);
+    CHECK(callback_thread == std::this_thread::get_id());
+    CHECK(registry.get(id) == 11);
+    CHECK(snapshot.get(id) == 2);
+}
+
+TEST_CASE("AsyncSharedMutex can hand the lock over to a long queue of coroutines")
+{
+    auto       registry = reg::Registry<int, reg::AsyncSharedMutex>{};
+    auto const id       = registry.create_raw(0);
+
+    auto       completed_count = 0;
+    auto const increment       = [&]() -> DetachedCoroutine {
+        if (co_await registry.async_with_mutable_ref(id, [](int& value) { ++value; }))
+            ++completed_count;
+    };
+
+    constexpr int coroutines_count = 200'000;
+    {
+        std::unique_lock lock{registry.mutex()};
+        for (int i = 0; i < coroutines_count; ++i)
+            increment(); // Each coroutine gets suspended and queued
+        CHECK(completed_count == 0);
+    } // Resumes the coroutines one after the other, without nesting them on the stack
+    CHECK(completed_count == coroutines_count);
+    CHECK(registry.get(id) == coroutines_count);
+}
+
+TEST_CASE("A resumed coroutine can use the registry synchronously while other coroutines are waiting to be resumed")
+{
+    auto       registry = reg::Registry<int, reg::AsyncSharedMutex>{};
+    auto const id       = registry.create_raw(0);
+
+    auto       seen_values     = std::vector<int>{};
+    auto const increment_twice = [&]() -> DetachedCoroutine {
+        co_await registry.async_with_mutable_ref(id, [](int& value) { ++value; });
+        seen_values.push_back(*registry.get(id)); // The next coroutine has been taken out of the queue, but it doesn't own the lock until it gets resumed
+        registry.with_mutable_ref(id, [](int& value) { ++value; });
+    };
+
+    {
+        std::unique_lock lock{registry.mutex()};
+        increment_twice();
+        increment_twice();
+        CHECK(seen_values.empty());
+    }
+    CHECK(seen_values == std::vector{1, 3});
+    CHECK(registry.get(id) == 4);
+}
+
+TEST_CASE("Registries can mix registries with different Maps and Locks")
+{
+    using Registries = reg::Registries<
+        reg::Registry<int, reg::NullMutex>,
+        reg::OrderedRegistry<float>>;
+    Registries registries{};
+
+    auto const int_id   = registries.create_unique(1);
+    auto const float_id = registries.create_unique(2.f);
+    CHECK(registries.get(int_id.raw()) == 1);
+    CHECK(registries.get(float_id.raw()) == 2.f);
+    CHECK(registries.of<float>().underlying_container().underlying_container().size() == 1);
+}
+
+struct Person {
+    std::string name;
+    int         age;
+};
+struct ByName : reg::HashedUniqueIndex<&Person::name> {};
+struct ByAge : reg::OrderedMultiIndex<&Person::age> {};
+struct ByInitial : reg::HashedMultiIndex<[](Person const& person) { return person.name.front(); }> {};
+using PeopleRegistry        = reg::IndexedRegistry<Person, ByName, ByAge, ByInitial>;
+using OrderedPeopleRegistry = reg::IndexedOrderedRegistry<Person, ByName, ByAge, ByInitial>;
+
+TEST_CASE_TEMPLATE("Secondary indices stay up to date", Registry, PeopleRegistry, OrderedPeopleRegistry)
+{
+    auto registry = Registry{};
+
+    auto const alice = registry.create_raw(Person{"Alice", 30});
+    auto const bob   = registry.create_raw(Person{"Bob", 25});
+    auto       carl  = registry.create_unique(Person{"Carl", 30});
+    CHECK(registry.template find_by<ByName>("Alice") == alice);
+    CHECK(registry.template find_by<ByName>("Nobody") == std::nullopt);
+    CHECK(registry.template find_by<ByAge>(30).size() == 2);
+    CHECK(registry.template find_range_by<ByAge>(20, 29) == std::vector{bob});
+
+    // Modifications
+    registry.set(bob, Person{"Bobby", 31});
+    CHECK(registry.template find_by<ByName>("Bob") == std::nullopt);
+    CHECK(registry.template find_by<ByName>("Bobby") == bob);
+    registry.with_mutable_ref(alice, [](Person& person) { person.name = "Bella"; });
+    CHECK(registry.template find_by<ByName>("Bella") == alice);
+    CHECK(registry.template find_by<ByInitial>('B').size() == 2);
+    CHECK(registry.template find_range_by<ByAge>(30, 40).size() == 3);
+
+    // Unique keys
+    CHECK_THROWS_AS(std::ignore = registry.create_raw(Person{"Bella", 12}), std::invalid_argument);
+    CHECK_THROWS_AS(registry.set(bob, Person{"Bella", 12}), std::invalid_argument);
+    CHECK_THROWS_AS(registry.with_mutable_ref(bob, [](Person& person) { person.name = "Bella"; }), std::invalid_argument);
+    CHECK(registry.get(bob)->name == "Bobby");
+    CHECK(registry.template find_by<ByName>("Bobby") == bob);
+    CHECK(size(registry) == 3);
+
+    // Destruction, including by an owning id
+    registry.destroy(alice);
+    carl = {};
+    CHECK(registry.template find_by<ByName>("Bella") == std::nullopt);
+    CHECK(registry.template find_by<ByName>("Carl") == std::nullopt);
+    CHECK(registry.template find_by<ByAge>(30).empty());
+    registry.clear();
+    CHECK(registry.template find_by<ByInitial>('B').empty());
+}
+
+TEST_CASE("VersionedRegistry supports optimistic updates")
+{
+    auto       registry = reg::VersionedRegistry<float>{};
+    auto const id       = registry.create_raw(1.f);
+
+    auto const versioned = registry.get_versioned(id);
+    REQUIRE(versioned);
+    CHECK(versioned->value == 1.f);
+    CHECK(registry.compare_and_set(id, versioned->version, 2.f));
+    CHECK(!registry.compare_and_set(id, versioned->version, 3.f)); // The object has been modified since we read its version
+    CHECK(registry.get(id) == 2.f);
+    CHECK(registry.update_if_unchanged(id, [](float value) { return value * 10.f; }));
+    CHECK(registry.get(id) == 20.f);
+
+    {
+        auto const owned_id = registry.create_unique(5.f);
+        CHECK(registry.contains(owned_id.raw()));
+        registry.destroy(id);
+        CHECK(!registry.update_if_unchanged(id, [](float value) { return value; }));
+    }
+    CHECK(registry.is_empty());
+}
+
+TEST_CASE_TEMPLATE("VersionedRegistry never lets readers see a torn value", Lock, std::shared_mutex, reg::ReaderBiasedSharedMutex)
+{
+    struct Pair {
+        int64_t a;
+        int64_t b;
+    };
+    auto       registry = reg::VersionedRegistry<Pair, Lock>{};
+    auto const id       = registry.create_raw(Pair{0, 0});
+
+    auto writers = std::vector<std::thread>{};
+    for (int i = 0; i < 2; ++i)
+    {
+        writers.emplace_back([&]() {
+            for (int j = 0; j < 1000; ++j)
+                registry.update_if_unchanged(id, [](Pair const& pair) { return Pair{pair.a + 1, pair.b + 1}; });
+        });
+    }
+    auto torn_reads_count = 0;
+    auto reader           = std::thread{[&]() {
+        for (int j = 0; j < 1000; ++j)
+        {
+            auto const pair = *registry.get(id);
+            if (pair.a != pair.b)
+                ++torn_reads_count;
+        }
+    }};
+    for (auto& writer : writers)
+        writer.join();
+    reader.join();
+
+    CHECK(torn_reads_count == 0);
+    CHECK(registry.get(id)->a == 2000);
+}
+
+TEST_CASE("VersionedRegistry reads and modifies objects without locking the registry")
+{
+    auto       registry = reg::VersionedRegistry<int>{};
+    auto const id       = registry.create_raw(1);
+
+    std::unique_lock lock{registry.mutex()}; // Would deadlock if reads and modifications locked the registry
+    CHECK(registry.get(id) == 1);
+    CHECK(registry.set(id, 2));
+    CHECK(registry.with_mutable_ref(id, [](int& value) { value *= 10; }));
+    CHECK(registry.update_if_unchanged(id, [](int value) { return value + 1; }));
+    CHECK(registry.get(id) == 21);
+    CHECK(!registry.contains(reg::Id<int>{}));
+}
+
+TEST_CASE("VersionedRegistry doesn't make readers wait for the callback of with_mutable_ref()")
+{
+    auto       registry = reg::VersionedRegistry<int>{};
+    auto const id       = registry.create_raw(1);
+
+    auto calls_count = 0;
+    CHECK(registry.with_mutable_ref(id, [&](int& value) {
+        ++calls_count;
+        auto seen_value = std::optional<int>{};
+        std::thread{[&]() { seen_value = registry.get(id); }}.join(); // Would spin forever if the version was odd during the callback
+        CHECK(seen_value == value);
+        if (calls_count == 1)
+            registry.set(id, 5); // Another writer modifies the object in the meantime, so the callback is called again with its new value
+        value *= 10;
+    }));
+    CHECK(calls_count == 2);
+    CHECK(registry.get(id) == 50);
+}
+
+TEST_CASE("VersionedRegistry can be read while objects are created and destroyed")
+{
+    auto       registry = reg::VersionedRegistry<int>{};
+    auto const id       = registry.create_raw(42);
+
+    auto done        = std::atomic<bool>{false};
+    auto wrong_reads = std::atomic<int>{0};
+    auto readers     = std::vector<std::thread>{};
+    for (int i = 0; i < 3; ++i)
+    {
+        readers.emplace_back([&]() {
+            while (!done)
+            {
+                if (registry.get(id) != 42)
+                    ++wrong_reads;
+            }
+        });
+    }
+    auto ids = std::vector<reg::Id<int>>{};
+    for (int i = 0; i < 2000; ++i) // Grows the table several times, and fills it with tombstones
+    {
+        ids.push_back(registry.create_raw(i));
+        if (i % 2 == 0)
+        {
+            registry.destroy(ids.front());
+            ids.erase(ids.begin());
+        }
+    }
+    done = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    CHECK(wrong_reads == 0);
+    for (auto const& remaining_id : ids)
+        CHECK(registry.contains(remaining_id));
+    registry.clear();
+    CHECK(registry.is_empty());
+    CHECK(!registry.contains(id));
+}
+
+TEST_CASE("HierarchyRegistry walks, moves and destroys whole subtrees")
+{
+    auto       registry = reg::HierarchyRegistry<std::string>{};
+    auto const scene    = registry.create_raw("scene");
+    auto const car      = registry.create_raw("car", scene);
+    auto const wheel1   = registry.create_raw("wheel1", car);
+    auto const wheel2   = registry.create_raw("wheel2", car);
+    auto const house    = registry.create_raw("house", scene);
+    auto const door     = registry.create_raw("door", house);
+    auto const other    = registry.create_raw("other scene");
+    CHECK_THROWS(std::ignore = registry.create_raw("orphan", reg::Id<std::string>{}));
+
+    auto const walk = [&](reg::Id<std::string> const& root) {
+        auto visited = std::vector<std::pair<std::string, size_t>>{};
+        std::as_const(registry).for_each_in_subtree(root, [&](reg::Id<std::string> const&, std::string const& value, size_t depth) {
+            visited.emplace_back(value, depth);
+        });
+        return visited;
+    };
+    using Visited = std::vector<std::pair<std::string, size_t>>;
+
+    CHECK(walk(scene) == Visited{{"scene", 0}, {"car", 1}, {"wheel1", 2}, {"wheel2", 2}, {"house", 1}, {"door", 2}});
+    CHECK(registry.parent_of(wheel2) == car);
+    CHECK(!registry.parent_of(scene));
+    CHECK(registry.children_of(car) == std::vector{wheel1, wheel2});
+    CHECK(registry.roots().size() == 2);
+
+    // Reparenting
+    CHECK(!registry.reparent(car, wheel1)); // Would create a cycle
+    CHECK(registry.reparent(car, house));
+    CHECK(walk(scene) == Visited{{"scene", 0}, {"house", 1}, {"door", 2}, {"car", 2}, {"wheel1", 3}, {"wheel2", 3}});
+    CHECK(registry.reparent(wheel1, other));
+    CHECK(walk(other) == Visited{{"other scene", 0}, {"wheel1", 1}});
+
+    // Modifying a whole subtree
+    registry.for_each_in_subtree(house, [](reg::Id<std::string> const&, std::string& value, size_t) { value += "!"; });
+    CHECK(registry.get(door) == "door!");
+    CHECK(registry.get(scene) == "scene");
+
+    // Destroying a whole subtree
+    CHECK(registry.destroy(house) == 4);
+    CHECK(registry.objects_count() == 3);
+    CHECK(!registry.contains(car));
+    CHECK(!registry.get(wheel2));
+    CHECK(registry.children_of(scene).empty());
+    CHECK(walk(other) == Visited{{"other scene", 0}, {"wheel1", 1}});
+    CHECK(registry.parent_of(wheel1) == other);
+    CHECK(registry.destroy(house) == 0);
+
+    // Random operations keep the hierarchy consistent
+    auto ids = std::vector<reg::Id<std::string>>{scene, other, wheel1};
+    for (size_t i = 0; i < 500; ++i)
+    {
+        auto const& some_id = ids[(i * 7919) % ids.size()];
+        if (i % 5 == 4)
+        {
+            std::ignore = registry.destroy(some_id);
+            std::erase_if(ids, [&](auto const& id) { return !registry.contains(id); });
+            if (ids.empty())
+                ids.push_back(registry.create_raw("root"));
+        }
+        else if (i % 5 == 3)
+            std::ignore = registry.reparent(some_id, ids[(i * 31) % ids.size()]);
+        else
+            ids.push_back(registry.create_raw(std::to_string(i), some_id));
+    }
+    CHECK(registry.objects_count() == ids.size());
+    auto visited = std::vector<reg::Id<std::string>>{};
+    for (auto const& root : registry.roots())
+    {
+        CHECK(!registry.parent_of(root));
+        std::as_const(registry).for_each_in_subtree(root, [&](reg::Id<std::string> const& id, std::string const&, size_t) { visited.push_back(id); });
+    }
+    CHECK(visited.size() == ids.size());
+    for (auto const& id : visited)
+    {
+        for (auto const& child : registry.children_of(id))
+            REQUIRE(registry.parent_of(child) == id);
+    }
+}
+
 #pragma warning(disable : 5054) // "operator '|': deprecated between enumerations of different types"
 #pragma GCC diagnostic push
 #pragma clang diagnostic push
 #pragma GCC diagnostic ignored "-Wsign-conversion"
 #pragma clang diagnostic ignored "-Wimplicit-int-conversion"
+#include <ser20/archives/binary.hpp>
 #include <ser20/archives/json.hpp>
 #pragma GCC diagnostic pop
 #pragma clang diagnostic pop
+#include <filesystem>
 #include <reg/ser20.hpp>
+#include <reg/ser20_bounded.hpp>
+#include <reg/ser20_lazy.hpp>
+#include <reg/ser20_sections.hpp>
+#include <reg/ser20_stream.hpp>
 #include <sstream>
 
 TEST_CASE_TEMPLATE("Serialization()", Registry, reg::Registry<float>, reg::OrderedRegistry<float>)
@@ -422,4 +1740,524 @@ TEST_CASE_TEMPLATE("Serialization()", Registry, reg::Registry<float>, reg::Order
     CHECK(id == out_id);
     CHECK(unique_id.raw() == out_unique_id.raw());
     CHECK(shared_id.raw() == out_shared_id.raw());
-}
\ No newline at end of file
+}
+
+TEST_CASE_TEMPLATE("Loading a registry keeps its observers, membership filter and trace recorder", Registry, reg::Registry<float>, reg::OrderedRegistry<float>, reg::SortedRegistry<float>)
+{
+    auto registry = Registry{};
+    auto ids      = std::vector<reg::Id<float>>{};
+    for (int i = 0; i < 100; ++i)
+        ids.push_back(registry.create_raw(static_cast<float>(i)));
+    auto ss = std::stringstream{};
+    {
+        ser20::JSONOutputArchive out_archive{ss};
+        out_archive(registry);
+    }
+    auto const saved = ss.str();
+
+    auto loaded_registry = Registry{};
+    auto inserts_count   = 0;
+    auto trace           = std::stringstream{};
+    loaded_registry.enable_membership_filter(1000);
+    loaded_registry.underlying_wrapped_registry()->add_observer({.on_insert = [&](reg::Id<float> const&, float const&) { ++inserts_count; }});
+    loaded_registry.set_trace_recorder(std::make_shared<reg::TraceRecorder>(trace));
+    auto reference_registry = Registry{};
+    {
+        auto in_stream  = std::stringstream{saved};
+        auto in_archive = ser20::JSONInputArchive{in_stream};
+        in_archive(loaded_registry);
+        auto reference_stream  = std::stringstream{saved};
+        auto reference_archive = ser20::JSONInputArchive{reference_stream};
+        reference_archive(reference_registry);
+    }
+    reference_registry.enable_membership_filter(1000);
+
+    CHECK(loaded_registry.underlying_wrapped_registry()->has_membership_filter());
+    CHECK(loaded_registry.memory_usage().overhead == reference_registry.memory_usage().overhead); // The filter has kept its size
+    for (std::size_t i = 0; i < ids.size(); ++i)
+        REQUIRE(loaded_registry.get(ids[i]) == static_cast<float>(i)); // The filter has been refilled with the loaded ids
+    CHECK(!loaded_registry.contains(reg::Id<float>{}));
+    std::ignore = loaded_registry.create_raw(1.f);
+    CHECK(inserts_count == 1);
+    loaded_registry.set_trace_recorder(nullptr); // Flushes the trace
+    CHECK(!reg::read_trace(trace).empty());
+}
+
+struct JSONArchives {
+    using Output = ser20::JSONOutputArchive;
+    using Input  = ser20::JSONInputArchive;
+};
+struct BinaryArchives {
+    using Output = ser20::BinaryOutputArchive;
+    using Input  = ser20::BinaryInputArchive;
+};
+
+TEST_CASE_TEMPLATE("Registries can be saved and loaded as sections, in parallel", Archives, JSONArchives, BinaryArchives)
+{
+    using Registries = reg::Registries<
+        reg::Registry<float>,
+        reg::Registry<int>,
+        reg::Registry<double>>;
+    auto const options = reg::SectionsOptions{
+        .max_objects_per_section = 64,
+        .thread_count            = 4,
+    };
+
+    // Save
+    Registries registries{};
+    auto       float_ids = std::vector<reg::Id<float>>{};
+    for (int i = 0; i < 1000; ++i)
+        float_ids.push_back(registries.create_raw(static_cast<float>(i)));
+    auto const int_id   = registries.create_raw(17);
+    auto const sections = reg::save_sections<typename Archives::Output>(registries, options);
+    CHECK(sections.size() == 16 + 1 + 1); // 1000 floats are split into 16 sections. The empty registry of doubles still gets a section
+
+    // Load
+    Registries loaded_registries{};
+    auto const id_that_should_be_erased = loaded_registries.create_raw(3.);
+    for (int i = 0; i < 10; ++i)
+        std::ignore = loaded_registries.create_raw(static_cast<float>(i));
+    loaded_registries.enable_id_directory();
+    auto loading          = std::atomic<bool>{true};
+    auto has_seen_partial = false;
+    auto reader           = std::thread{[&]() {
+        while (loading)
+        {
+            auto const count = size(loaded_registries.template of<float>());
+            has_seen_partial = has_seen_partial || (count != 10 && count != 1000);
+        }
+    }};
+    reg::load_sections<typename Archives::Input>(loaded_registries, sections, options);
+    loading = false;
+    reader.join();
+    CHECK(!has_seen_partial); // The registries are replaced at once, so other threads never see them partially loaded
+
+    // Check
+    for (int i = 0; i < 1000; ++i)
+        REQUIRE(loaded_registries.get(float_ids[static_cast<size_t>(i)]) == static_cast<float>(i));
+    CHECK(loaded_registries.get(int_id) == 17);
+    CHECK(!loaded_registries.get(id_that_should_be_erased));
+    CHECK(loaded_registries.contains(reg::AnyId{float_ids[42]}));
+    CHECK(size(loaded_registries.template of<float>()) == 1000);
+}
+
+TEST_CASE_TEMPLATE("A registry can be streamed in chunks of bounded size", Archives, JSONArchives, BinaryArchives)
+{
+    // Save
+    auto registry = reg::OrderedRegistry<std::string>{};
+    for (int i = 0; i < 100; ++i)
+        std::ignore = registry.create_raw(std::to_string(i));
+
+    auto chunks_sizes = std::vector<size_t>{};
+    auto file         = std::stringstream{};
+    reg::save_stream<typename Archives::Output>(
+        registry,
+        [&, sink = reg::ostream_sink(file)](std::string_view chunk) {
+            chunks_sizes.push_back(chunk.size());
+            sink(chunk);
+        },
+        reg::StreamOptions{.max_objects_per_chunk = 16}
+    );
+    CHECK(chunks_sizes.size() == 7);
+
+    // Load
+    auto loaded_registry = reg::OrderedRegistry<std::string>{};
+    std::ignore          = loaded_registry.create_raw("This should be erased");
+    reg::load_stream<typename Archives::Input>(loaded_registry, reg::istream_source(file));
+
+    // Check
+    CHECK(loaded_registry.underlying_container().underlying_container() == registry.underlying_container().underlying_container());
+
+    // A malformed stream leaves the registry untouched
+    auto truncated_file = std::stringstream{file.str().substr(0, file.str().size() / 2)};
+    auto const id       = loaded_registry.create_raw("This should be kept");
+    CHECK_THROWS(reg::load_stream<typename Archives::Input>(loaded_registry, reg::istream_source(truncated_file)));
+    CHECK(loaded_registry.get(id) == "This should be kept");
+    CHECK(size(loaded_registry) == 101);
+}
+
+TEST_CASE_TEMPLATE("A LazyRegistry only decodes the objects that get accessed", Archives, JSONArchives, BinaryArchives)
+{
+    using LazyRegistry = reg::LazyRegistry<std::string, typename Archives::Input, typename Archives::Output>;
+    auto const path    = std::filesystem::temp_directory_path() / "reg-tests-lazy-registry.bin";
+
+    // Save
+    auto ids = std::vector<reg::Id<std::string>>{};
+    {
+        auto registry = LazyRegistry{};
+        for (int i = 0; i < 100; ++i)
+            ids.push_back(registry.create_raw(std::to_string(i)));
+        registry.save(path);
+    }
+    CHECK(!std::filesystem::exists(path.string() + ".tmp"));
+    { // The integers are stored in little-endian order whatever the machine
+        auto       file         = std::ifstream{path, std::ios::binary};
+        auto const bytes        = std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+        auto const read_integer = [&](std::size_t position) {
+            auto integer = std::uint64_t{};
+            for (std::size_t i = 8; i-- > 0;)
+                integer = (integer << 8) | static_cast<unsigned char>(bytes.at(position + i));
+            return integer;
+        };
+        auto const index_position = read_integer(8);
+        CHECK(read_integer(static_cast<std::size_t>(index_position)) == 100);
+    }
+
+    // Load, modify and save again
+    {
+        auto registry = LazyRegistry{path};
+        CHECK(registry.objects_count() == 100);
+        CHECK(registry.loaded_objects_count() == 0);
+        CHECK(registry.contains(ids[3]));
+        CHECK(registry.loaded_objects_count() == 0);
+        CHECK(registry.get(ids[3]) == "3");
+        CHECK(registry.loaded_objects_count() == 1);
+        CHECK(registry.with_mutable_ref(ids[4], [](std::string& value) { value += "!"; }));
+        CHECK(registry.set(ids[5], "five"));
+        registry.destroy(ids[6]);
+        ids.push_back(registry.create_raw("new"));
+        CHECK(registry.loaded_objects_count() == 4);
+        registry.save(path); // Overwrites the file the registry is reading from
+        CHECK(registry.get(ids[7]) == "7");
+    }
+
+    // Check
+    auto const registry = LazyRegistry{path};
+    CHECK(registry.objects_count() == 100);
+    CHECK(registry.get(ids[3]) == "3");
+    CHECK(registry.get(ids[4]) == "4!");
+    CHECK(registry.get(ids[5]) == "five");
+    CHECK(!registry.get(ids[6]));
+    CHECK(registry.get(ids[100]) == "new");
+    for (size_t i = 7; i < 100; ++i)
+        REQUIRE(registry.get(ids[i]) == std::to_string(i));
+    std::filesystem::remove(path);
+
+    CHECK_THROWS(LazyRegistry{path});
+}
+
+TEST_CASE_TEMPLATE("A BoundedRegistry spills the least recently used objects to a file", Archives, JSONArchives, BinaryArchives)
+{
+    using BoundedRegistry = reg::BoundedRegistry<std::string, typename Archives::Input, typename Archives::Output>;
+    auto const path       = std::filesystem::temp_directory_path() / "reg-tests-bounded-registry.bin";
+
+    {
+        auto registry = BoundedRegistry{{
+            .spill_file            = path,
+            .max_objects_in_memory = 10,
+            .max_bytes_in_memory   = 1000,
+            .size_of               = [](std::string const& value) { return value.size(); },
+        }};
+        auto ids = std::vector<reg::Id<std::string>>{};
+        for (int i = 0; i < 100; ++i)
+            ids.push_back(registry.create_raw(std::to_string(i)));
+        CHECK(registry.objects_count() == 100);
+        CHECK(registry.objects_in_memory_count() == 10);
+        CHECK(std::filesystem::exists(path));
+
+        // Evicted objects are still there, and get read back
+        CHECK(registry.contains(ids[0]));
+        CHECK(registry.get(ids[0]) == "0");
+        CHECK(registry.with_mutable_ref(ids[1], [](std::string& value) { value += "!"; }));
+        CHECK(registry.set(ids[2], "two"));
+        registry.destroy(ids[3]);
+        CHECK(!registry.contains(ids[3]));
+        CHECK(!registry.get(ids[3]));
+        CHECK(registry.objects_in_memory_count() == 10);
+        for (size_t i = 4; i < 100; ++i)
+            REQUIRE(registry.get(ids[i]) == std::to_string(i));
+        CHECK(registry.get(ids[1]) == "1!"); // Modified objects are written again when they get evicted
+        CHECK(registry.get(ids[2]) == "two");
+
+        // The objects that were accessed recently are not evicted
+        for (size_t i = 0; i < 20; ++i)
+        {
+            std::ignore = registry.get(ids[99]);
+            std::ignore = registry.get(ids[(i * 7) % 90]);
+        }
+        CHECK(registry.objects_in_memory_count() == 10);
+        CHECK(registry.bytes_in_memory() <= 20);
+
+        // The byte budget is respected too
+        std::ignore = registry.create_raw(std::string(600, 'a'));
+        std::ignore = registry.create_raw(std::string(600, 'b'));
+        CHECK(registry.bytes_in_memory() <= 1000);
+
+        registry.clear();
+        CHECK(registry.is_empty());
+        CHECK(registry.objects_in_memory_count() == 0);
+    }
+    CHECK(!std::filesystem::exists(path));
+}
+
+TEST_CASE_TEMPLATE("A BoundedRegistry reuses the space of the objects that have been written again", Archives, JSONArchives, BinaryArchives)
+{
+    using BoundedRegistry = reg::BoundedRegistry<std::string, typename Archives::Input, typename Archives::Output>;
+    auto const path       = std::filesystem::temp_directory_path() / "reg-tests-bounded-registry-reuse.bin";
+
+    auto registry = BoundedRegistry{{
+        .spill_file            = path,
+        .max_objects_in_memory = 1,
+    }};
+    auto ids = std::vector<reg::Id<std::string>>{};
+    for (int i = 0; i < 10; ++i)
+        ids.push_back(registry.create_raw(std::string(1000, 'a')));
+
+    // Each modification evicts the previously modified object, which has to be written again
+    for (std::size_t round = 0; round < 100; ++round)
+    {
+        for (std::size_t i = 0; i < ids.size(); ++i)
+            registry.set(ids[i], std::string(900 + (round * 37 + i * 11) % 200, static_cast<char>('a' + round % 26)));
+    }
+    CHECK(std::filesystem::file_size(path) < 3 * ids.size() * 1200); // Instead of ~1000 times the size of an object if the file only grew
+    for (std::size_t i = 0; i < ids.size(); ++i)
+        REQUIRE(registry.get(ids[i]) == std::string(900 + (99 * 37 + i * 11) % 200, static_cast<char>('a' + 99 % 26)));
+
+    // Destroying objects frees their space too
+    for (std::size_t i = 1; i < ids.size(); ++i)
+        registry.destroy(ids[i]);
+    auto const size_after_destroy = std::filesystem::file_size(path);
+    for (int i = 0; i < 9; ++i)
+        std::ignore = registry.create_raw(std::string(900, 'z'));
+    std::ignore = registry.create_raw("evicts the last one");
+    CHECK(std::filesystem::file_size(path) == size_after_destroy);
+}
+
+/// Calls `before_decoding` (once) each time it is set, so that tests can do something while a registry is decoding an object.
+template<typename Input>
+struct InputArchiveWithHook {
+    explicit InputArchiveWithHook(std::istream& stream)
+        : archive{stream}
+    {}
+
+    template<typename... Args>
+    void operator()(Args&&... args)
+    {
+        if (auto const hook = std::exchange(before_decoding, nullptr))
+            hook();
+        archive(std::forward<Args>(args)...);
+    }
+
+    static inline std::function<void()> before_decoding{};
+    Input                               archive;
+};
+
+TEST_CASE_TEMPLATE("A BoundedRegistry never brings back an outdated value", Archives, JSONArchives, BinaryArchives)
+{
+    using BoundedRegistry = reg::BoundedRegistry<std::string, InputArchiveWithHook<typename Archives::Input>, typename Archives::Output>;
+    auto const path       = std::filesystem::temp_directory_path() / "reg-tests-bounded-registry-outdated.bin";
+
+    auto registry = BoundedRegistry{{
+        .spill_file            = path,
+        .max_objects_in_memory = 1,
+    }};
+    auto const id    = registry.create_raw("old");
+    auto const other = registry.create_raw("other"); // Evicts `id`
+
+    // While `get()` decodes the object without holding the lock, another thread modifies it and evicts it again
+    InputArchiveWithHook<typename Archives::Input>::before_decoding = [&]() {
+        std::thread{[&]() {
+            registry.set(id, "new");
+            std::ignore = registry.get(other);
+        }}.join();
+    };
+    CHECK(registry.get(id) == "new");
+    CHECK(registry.get(other) == "other");
+    registry.with_mutable_ref(id, [](std::string& value) { value += "!"; });
+    std::ignore = registry.get(other);
+    CHECK(registry.get(id) == "new!");
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <reg/ser20_wal.hpp>
+#include <reg/shared_memory.hpp>
+
+TEST_CASE("A SharedMemoryRegistry can be opened several times and shares its objects")
+{
+    struct Vec3 {
+        float x, y, z;
+    };
+    auto const name = std::string{"/reg-tests-shared-memory"};
+    reg::SharedMemoryRegistry<Vec3>::remove(name); // In case a previous run crashed
+
+    auto registry1 = reg::SharedMemoryRegistry<Vec3>{name, 1000}; // Creates the segment
+    auto registry2 = reg::SharedMemoryRegistry<Vec3>{name, 0};    // Maps the same segment (at another address), just like another process would
+    CHECK(registry2.max_objects_count() == 1000);
+
+    auto ids = std::vector<reg::Id<Vec3>>{};
+    for (int i = 0; i < 1000; ++i)
+        ids.push_back(registry1.create_raw({static_cast<float>(i), 0.f, 0.f}));
+    CHECK_THROWS(std::ignore = registry1.create_raw({}));
+    CHECK(registry2.objects_count() == 1000);
+    CHECK(registry2.get(ids[10])->x == 10.f);
+
+    CHECK(registry2.with_mutable_ref(ids[20], [](Vec3& value) { value.y = 1.f; }));
+    CHECK(registry1.get(ids[20])->y == 1.f);
+
+    for (size_t i = 0; i < ids.size(); i += 2)
+        registry2.destroy(ids[i]);
+    CHECK(registry1.objects_count() == 500);
+    for (size_t i = 0; i < ids.size(); ++i)
+        REQUIRE(registry1.contains(ids[i]) == (i % 2 == 1));
+    {
+        std::shared_lock lock{registry1.mutex()};
+        auto             sum = 0.f;
+        registry1.for_each([&](reg::Id<Vec3> const&, Vec3 const& value) { sum += value.x; });
+        CHECK(sum == 250000.f); // 1 + 3 + ... + 999
+    }
+
+    registry1.clear();
+    CHECK(registry2.is_empty());
+    CHECK(reg::SharedMemoryRegistry<Vec3>::remove(name));
+    CHECK(!reg::SharedMemoryRegistry<Vec3>::remove(name));
+
+    {
+        auto const registry_of_doubles = reg::SharedMemoryRegistry<double>{name, 10};
+        CHECK_THROWS(reg::SharedMemoryRegistry<Vec3>{name, 10}); // The segment has been created for another type
+    }
+    CHECK(reg::SharedMemoryRegistry<double>::remove(name));
+}
+
+TEST_CASE("Several processes can use the same SharedMemoryRegistry")
+{
+    auto const name = std::string{"/reg-tests-shared-memory-processes"};
+    reg::SharedMemoryRegistry<int>::remove(name);
+
+    auto       registry = reg::SharedMemoryRegistry<int>{name, 100};
+    auto const id       = registry.create_raw(1);
+    auto const pid      = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0)
+    {
+        // In the child process, that maps the segment by itself
+        auto child_registry = reg::SharedMemoryRegistry<int>{name, 100};
+        child_registry.with_mutable_ref(id, [](int& value) { value = 2; });
+        std::ignore = child_registry.create_raw(3);
+        _exit(0);
+    }
+    auto status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(registry.get(id) == 2);
+    CHECK(registry.objects_count() == 2);
+    reg::SharedMemoryRegistry<int>::remove(name);
+}
+
+TEST_CASE_TEMPLATE("A WriteAheadLog recovers the committed modifications", Archives, JSONArchives, BinaryArchives)
+{
+    using WriteAheadLog = reg::WriteAheadLog<typename Archives::Input, typename Archives::Output>;
+    using Registries    = reg::Registries<
+           reg::Registry<float>,
+           reg::Registry<std::string>>;
+    auto const path     = std::filesystem::temp_directory_path() / "reg-tests-write-ahead-log.bin";
+    auto const old_path = std::filesystem::path{path}.concat(".old");
+    std::filesystem::remove(path);
+    std::filesystem::remove(old_path);
+
+    // Each session recovers the registries from the last checkpoint and the log, and checks that they match what we expect
+    auto       expected   = Registries{};
+    auto       checkpoint = Registries{};
+    auto const session    = [&](auto&& modify) {
+        auto registries = checkpoint.snapshot();
+        auto log        = WriteAheadLog{path, registries};
+        REQUIRE(registries.template of<float>().underlying_container() == expected.template of<float>().underlying_container());
+        REQUIRE(registries.template of<std::string>().underlying_container() == expected.template of<std::string>().underlying_container());
+        modify(registries, log);
+        expected = registries.snapshot();
+    };
+
+    session([](Registries& registries, WriteAheadLog& log) {
+        auto const float_id  = registries.create_raw(1.f);
+        auto const string_id = registries.create_raw(std::string{"a"});
+        std::ignore          = registries.create_raw(std::string{"b"});
+        registries.set(float_id, 2.f);
+        registries.of<std::string>().with_mutable_ref(string_id, [](std::string& value) { value += "!"; });
+        registries.visit_mutable(reg::AnyId{string_id}, [](auto const&, auto& value) {
+            if constexpr (std::is_same_v<std::remove_cvref_t<decltype(value)>, std::string>)
+                value += "?";
+        });
+        auto const destroyed_id = registries.create_raw(3.f);
+        registries.destroy(destroyed_id);
+        log.commit();
+        CHECK(log.syncs_count() == 1);
+        log.commit(); // Nothing to write
+        CHECK(log.syncs_count() == 1);
+    });
+
+    // Several threads that commit at the same time share their syncs
+    session([](Registries& registries, WriteAheadLog& log) {
+        auto all_created = std::latch{8};
+        auto threads     = std::vector<std::thread>{};
+        for (int i = 0; i < 8; ++i)
+        {
+            threads.emplace_back([&, i]() {
+                for (int j = 0; j < 50; ++j)
+                    std::ignore = registries.create_raw(static_cast<float>(i * 100 + j));
+                all_created.arrive_and_wait(); // So that the first thread that commits writes the objects of all the others
+                log.commit();
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        CHECK(log.syncs_count() == 1);
+    });
+
+    // A checkpoint empties the log
+    session([&](Registries& registries, WriteAheadLog& log) {
+        log.checkpoint([&]() { checkpoint = registries.snapshot(); });
+        CHECK(std::filesystem::file_size(path) == 8);
+        CHECK(!std::filesystem::exists(old_path));
+        std::ignore = registries.create_raw(std::string{"after the checkpoint"});
+    });
+
+    // If the log can't be moved aside, the checkpoint fails but the log keeps working
+    session([&](Registries& registries, WriteAheadLog& log) {
+        std::filesystem::create_directory(old_path); // Can't be written to
+        CHECK_THROWS(log.checkpoint([]() {}));
+        std::filesystem::remove(old_path);
+        std::ignore = registries.create_raw(std::string{"after the checkpoint that couldn't start"});
+        log.commit();
+    });
+
+    // If saving the checkpoint fails, the previous log is kept and replayed along with the new one
+    session([&](Registries& registries, WriteAheadLog& log) {
+        CHECK_THROWS(log.checkpoint([]() { throw std::runtime_error{"Disk full"}; }));
+        CHECK(std::filesystem::exists(old_path));
+        std::ignore = registries.create_raw(std::string{"after the failed checkpoint"});
+    });
+    session([](Registries& registries, WriteAheadLog& log) {
+        CHECK_THROWS(log.checkpoint([]() { throw std::runtime_error{"Disk full again"}; }));
+        std::ignore = registries.create_raw(std::string{"after the second failed checkpoint"});
+    });
+
+    // A record that was only partially written when we crashed is ignored
+    {
+        auto file = std::ofstream{path, std::ios::binary | std::ios::app};
+        file << "garbage";
+    }
+    session([](Registries& registries, WriteAheadLog&) { std::ignore = registries.create_raw(std::string{"after the garbage"}); });
+    session([](Registries&, WriteAheadLog&) {});
+
+    // It also works with a single registry
+    std::filesystem::remove(path);
+    std::filesystem::remove(old_path);
+    {
+        auto registry = reg::OrderedRegistry<std::string>{};
+        {
+            auto log    = WriteAheadLog{path, registry};
+            std::ignore = registry.create_raw("x");
+        }
+        auto       recovered = reg::OrderedRegistry<std::string>{};
+        auto const log       = WriteAheadLog{path, recovered};
+        CHECK(recovered.underlying_container().underlying_container() == registry.underlying_container().underlying_container());
+    }
+
+    {
+        auto not_a_log = std::ofstream{path, std::ios::binary | std::ios::trunc};
+        not_a_log << "not a log";
+    }
+    auto registry = reg::Registry<float>{};
+    CHECK_THROWS(WriteAheadLog{path, registry});
+    std::filesystem::remove(path);
+}
+#endif
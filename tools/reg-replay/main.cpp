@@ -0,0 +1,261 @@
+// Replays a trace recorded by a reg::TraceRecorder against one of the registry backends, and reports its throughput and latencies.
+// Usage: reg-replay <trace file> [--backend registry|ordered|persistent|sorted] [--lock shared_mutex|null|spin|reader_biased|async] [--threads N]
+// The lock is the mutex that guards the registry ("null" can only be used with a single replay thread).
+// The objects only store a float: the trace doesn't contain the values, it only records which objects are accessed and how.
+// Each thread of the trace is replayed in order on one replay thread, as fast as possible (the timestamps are ignored).
+// If there are more threads in the trace than replay threads, each replay thread replays several of them, one after the other.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <reg/reg.hpp>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string  trace_path{};
+    std::string  backend{"registry"};
+    std::string  lock{"shared_mutex"};
+    unsigned int thread_count{1};
+};
+
+auto parse_options(int argc, char** argv) -> Options
+{
+    auto options = Options{};
+    auto args    = std::vector<std::string_view>(argv + 1, argv + argc);
+    for (std::size_t i = 0; i < args.size(); ++i)
+    {
+        if (args[i] == "--backend" && i + 1 < args.size())
+            options.backend = args[++i];
+        else if (args[i] == "--lock" && i + 1 < args.size())
+            options.lock = args[++i];
+        else if (args[i] == "--threads" && i + 1 < args.size())
+            options.thread_count = static_cast<unsigned int>(std::max(1, std::stoi(std::string{args[++i]})));
+        else
+            options.trace_path = args[i];
+    }
+    if (options.trace_path.empty())
+        throw std::runtime_error{"Usage: reg-replay <trace file> [--backend registry|ordered|persistent|sorted] [--lock shared_mutex|null|spin|reader_biased|async] [--threads N]"};
+    if (options.lock == "null" && options.thread_count > 1)
+        throw std::runtime_error{"--lock null can only be used with --threads 1, because it doesn't protect the registry"};
+    return options;
+}
+
+auto op_name(reg::TraceOp op) -> std::string_view
+{
+    switch (op)
+    {
+    case reg::TraceOp::Get: return "get";
+    case reg::TraceOp::GetRef: return "get_ref";
+    case reg::TraceOp::GetMutableRef: return "get_mutable_ref";
+    case reg::TraceOp::Set: return "set";
+    case reg::TraceOp::Contains: return "contains";
+    case reg::TraceOp::WithRef: return "with_ref";
+    case reg::TraceOp::WithMutableRef: return "with_mutable_ref";
+    case reg::TraceOp::Create: return "create";
+    case reg::TraceOp::Destroy: return "destroy";
+    case reg::TraceOp::Clear: return "clear";
+    case reg::TraceOp::Iterate: return "iterate";
+    case reg::TraceOp::Lock: return "lock";
+    case reg::TraceOp::Unlock: return "unlock";
+    case reg::TraceOp::LockShared: return "lock_shared";
+    case reg::TraceOp::UnlockShared: return "unlock_shared";
+    }
+    return "unknown";
+}
+
+template<typename Registry>
+void replay_op(Registry& registry, reg::TraceRecord const& record, float& sink)
+{
+    auto const id = reg::Id<float>{record.id};
+    switch (record.op)
+    {
+    case reg::TraceOp::Get:
+        sink += registry.get(id).value_or(0.f);
+        break;
+    case reg::TraceOp::GetRef:
+        if (auto const* value = registry.get_ref(id))
+            sink += *value;
+        break;
+    case reg::TraceOp::GetMutableRef:
+        if (auto* value = registry.get_mutable_ref(id))
+            *value += 1.f;
+        break;
+    case reg::TraceOp::Set:
+        registry.set(id, sink);
+        break;
+    case reg::TraceOp::Contains:
+        sink += registry.contains(id) ? 1.f : 0.f;
+        break;
+    case reg::TraceOp::WithRef:
+        registry.with_ref(id, [&](float const& value) { sink += value; });
+        break;
+    case reg::TraceOp::WithMutableRef:
+        registry.with_mutable_ref(id, [](float& value) { value += 1.f; });
+        break;
+    case reg::TraceOp::Create:
+        registry.underlying_wrapped_registry()->insert_raw(id, 0.f);
+        break;
+    case reg::TraceOp::Destroy:
+        registry.destroy(id);
+        break;
+    case reg::TraceOp::Clear:
+        registry.clear();
+        break;
+    case reg::TraceOp::Iterate:
+        for (auto const& [object_id, value] : std::as_const(registry))
+            sink += value;
+        break;
+    case reg::TraceOp::Lock:
+        registry.mutex().lock();
+        break;
+    case reg::TraceOp::Unlock:
+        registry.mutex().unlock();
+        break;
+    case reg::TraceOp::LockShared:
+        registry.mutex().lock_shared();
+        break;
+    case reg::TraceOp::UnlockShared:
+        registry.mutex().unlock_shared();
+        break;
+    }
+}
+
+/// The latencies of each kind of operation, in nanoseconds.
+using Latencies = std::map<reg::TraceOp, std::vector<std::int64_t>>;
+
+template<typename Registry>
+void replay(std::vector<std::vector<reg::TraceRecord>> const& threads_records, unsigned int thread_count)
+{
+    auto registry = Registry{};
+
+    // The objects that already existed when the trace started recording must exist before we replay it
+    auto created_ids = std::unordered_set<reg::Id<float>>{};
+    for (auto const& records : threads_records)
+    {
+        for (auto const& record : records)
+        {
+            if (record.op == reg::TraceOp::Create)
+                created_ids.insert(reg::Id<float>{record.id});
+            else if (!record.id.is_nil() && !created_ids.contains(reg::Id<float>{record.id}))
+                registry.underlying_wrapped_registry()->insert_raw(reg::Id<float>{record.id}, 0.f);
+        }
+    }
+
+    auto latencies = std::vector<Latencies>(thread_count);
+    auto sinks     = std::vector<float>(thread_count);
+    auto threads   = std::vector<std::thread>{};
+    auto start     = Clock::now();
+    for (unsigned int thread_index = 0; thread_index < thread_count; ++thread_index)
+    {
+        threads.emplace_back([&, thread_index]() {
+            for (std::size_t i = thread_index; i < threads_records.size(); i += thread_count)
+            {
+                for (auto const& record : threads_records[i])
+                {
+                    auto const op_start = Clock::now();
+                    replay_op(registry, record, sinks[thread_index]);
+                    latencies[thread_index][record.op].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - op_start).count());
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    auto const duration = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Report
+    auto all_latencies = Latencies{};
+    auto ops_count     = std::size_t{0};
+    for (auto& thread_latencies : latencies)
+    {
+        for (auto& [op, values] : thread_latencies)
+        {
+            ops_count += values.size();
+            all_latencies[op].insert(all_latencies[op].end(), values.begin(), values.end());
+        }
+    }
+    std::cout << ops_count << " operations in " << duration << " s (" << static_cast<double>(ops_count) / duration << " ops/s) with " << thread_count << " thread(s)\n";
+    std::cout << "operation            count      p50 (ns)   p99 (ns)   max (ns)\n";
+    for (auto& [op, values] : all_latencies)
+    {
+        std::sort(values.begin(), values.end());
+        auto const percentile = [&](double p) { return values[static_cast<std::size_t>(p * static_cast<double>(values.size() - 1))]; };
+        std::cout << std::left;
+        std::cout.width(21);
+        std::cout << op_name(op);
+        std::cout.width(11);
+        std::cout << values.size();
+        std::cout.width(11);
+        std::cout << percentile(0.5);
+        std::cout.width(11);
+        std::cout << percentile(0.99);
+        std::cout << values.back() << '\n';
+    }
+}
+
+template<typename Lock>
+void replay_backend(std::string const& backend, std::vector<std::vector<reg::TraceRecord>> const& threads_records, unsigned int thread_count)
+{
+    if (backend == "registry")
+        replay<reg::Registry<float, Lock>>(threads_records, thread_count);
+    else if (backend == "ordered")
+        replay<reg::OrderedRegistry<float, Lock>>(threads_records, thread_count);
+    else if (backend == "persistent")
+        replay<reg::PersistentRegistry<float, Lock>>(threads_records, thread_count);
+    else if (backend == "sorted")
+        replay<reg::SortedRegistry<float, Lock>>(threads_records, thread_count);
+    else
+        throw std::runtime_error{"Unknown backend: " + backend};
+}
+
+} // namespace
+
+auto main(int argc, char** argv) -> int
+{
+    try
+    {
+        auto const options = parse_options(argc, argv);
+
+        auto file = std::ifstream{options.trace_path, std::ios::binary};
+        if (!file)
+            throw std::runtime_error{"Couldn't open " + options.trace_path};
+        auto threads_records = std::vector<std::vector<reg::TraceRecord>>{};
+        for (auto const& record : reg::read_trace(file))
+        {
+            if (record.thread_index >= threads_records.size())
+                threads_records.resize(record.thread_index + 1);
+            threads_records[record.thread_index].push_back(record);
+        }
+
+        if (options.lock == "shared_mutex")
+            replay_backend<std::shared_mutex>(options.backend, threads_records, options.thread_count);
+        else if (options.lock == "null")
+            replay_backend<reg::NullMutex>(options.backend, threads_records, options.thread_count);
+        else if (options.lock == "spin")
+            replay_backend<reg::SpinSharedMutex>(options.backend, threads_records, options.thread_count);
+        else if (options.lock == "reader_biased")
+            replay_backend<reg::ReaderBiasedSharedMutex>(options.backend, threads_records, options.thread_count);
+        else if (options.lock == "async")
+            replay_backend<reg::AsyncSharedMutex>(options.backend, threads_records, options.thread_count);
+        else
+            throw std::runtime_error{"Unknown lock: " + options.lock};
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}